@@ -6,9 +6,7 @@ uniform vec4 icolor;
 in VS_OUT {	
 	vec3 L;	
     vec3 V;
-	vec3 N;
 	vec2 tc;
-	float light_dist;
 	float attenuation;
 } fs_in;
 
@@ -26,7 +24,7 @@ void main(void)
 	if (tcolor.a == 0.0) { discard; }
 
 	// Normalize the incoming N, L and V vectors
-    vec3 N = normalize(fs_in.N);
+    vec3 N = vec3(0.0, 0.0, 1.0); //grass quads always face the camera
     vec3 L = normalize(fs_in.L);
     vec3 V = normalize(fs_in.V);
 	
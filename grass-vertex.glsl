@@ -10,14 +10,11 @@ layout(std140) uniform constants
 };
 
 uniform vec4 light_pos;
-uniform float reflecting;
 
 out VS_OUT {
 	vec3 L;
     vec3 V;
-	vec3 N;
 	vec2 tc;
-	float light_dist;
 	float attenuation;
 } vs_out;
 
@@ -49,8 +46,6 @@ void main(void) {
 	vec4 P = mv_matrix * vec4(position, 1.0);
 	vec3 L = (mv_matrix*light_pos).xyz - P.xyz;
 	float d = distance(P.xyz, L);
-	vs_out.light_dist = d;
-
 	vs_out.attenuation = 1.0 / ( constant_att +	(linear_att*d) + (quadratic_att*d*d));
 
 	int modu = gl_VertexID % 6;
@@ -58,14 +53,13 @@ void main(void) {
 
 	vec3 vout = -P.xyz;
 	vec2 tcout = vec2(tcquad[modu].x + tc_u, tcquad[modu].y);
-	if (reflecting < 0) {
-		vout.y = -vout.y;
-		tcout.y = -tcout.y;
-	}
+#ifdef REFLECTED
+	vout.y = -vout.y;
+	tcout.y = -tcout.y;
+#endif
 	
 	vs_out.V = vout;
 	vs_out.tc = tcout;
 	vs_out.L = L;
-	vs_out.N = vec3(0.0, 0.0, 1.0);
 	gl_Position = proj_matrix * P; //finally put into proper space
 }
\ No newline at end of file
@@ -50,6 +50,9 @@
 #include <string.h>
 #include <math.h>
 
+#include <chrono>
+#include <thread>
+
 namespace sb7
 {
 
@@ -97,6 +100,7 @@ public:
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
         glfwWindowHint(GLFW_SAMPLES, info.samples);
         glfwWindowHint(GLFW_STEREO, info.flags.stereo ? GL_TRUE : GL_FALSE);
+        glfwWindowHint(GLFW_VISIBLE, info.flags.hidden ? GL_FALSE : GL_TRUE);
 //        if (info.flags.fullscreen)
 //        {
 //            if (info.windowWidth == 0 || info.windowHeight == 0)
@@ -121,6 +125,7 @@ public:
         }
 
         glfwMakeContextCurrent(window);
+        glfwSwapInterval((int)info.flags.vsync);
 
         glfwSetWindowSizeCallback(window, glfw_onResize);
         glfwSetKeyCallback(window, glfw_onKey);
@@ -158,12 +163,88 @@ public:
 
         startup();
 
+        double lastTime = glfwGetTime();
+        double accumulator = 0.0;
+        simulationAlpha = 1.0;
+        clampedFrames = 0;
+        droppedTime = 0.0;
+        idleFrame = false;
+        inputSeen = false;
+        nextFrameTime = lastTime;
+        lastPresentTime = 0.0;
+        sleepEstimate = 0.002;
+        memset(&pacing, 0, sizeof(pacing));
+        pacingCount = 0;
+
         do
         {
-            render(glfwGetTime());
+            if (info.flags.lowLatency)
+            {
+                // Wait for the frame cap before reading input rather than after
+                // presenting, so update() and render() see the freshest input
+                paceFrame();
+                stage zone(this, "glfwPollEvents");
+                glfwPollEvents();
+            }
 
-            glfwSwapBuffers(window);
-            glfwPollEvents();
+            double currentTime = glfwGetTime();
+
+            // Fixed-rate simulation: run as many steps as the frame took, then
+            // let render() blend the last two states by simulationAlpha
+            if (info.simulationStep > 0.0)
+            {
+                double frameTime = currentTime - lastTime;
+                double maxFrameTime = info.simulationStep * info.maxSubsteps;
+                if (frameTime > maxFrameTime)
+                {
+                    // Drop time after a stall instead of spiralling
+                    clampedFrames++;
+                    droppedTime += frameTime - maxFrameTime;
+                    frameTime = maxFrameTime;
+                }
+                accumulator += frameTime;
+
+                while (accumulator >= info.simulationStep)
+                {
+                    stage zone(this, "update");
+                    update(info.simulationStep);
+                    accumulator -= info.simulationStep;
+                }
+                simulationAlpha = accumulator / info.simulationStep;
+            }
+            lastTime = currentTime;
+
+            // Nothing but animation changed since the last frame
+            idleFrame = info.idleFrameRate > 0.0 && !inputSeen && idle();
+            inputSeen = false;
+
+            {
+                stage zone(this, "render");
+                render(currentTime);
+            }
+            {
+                stage zone(this, "glfwSwapBuffers");
+                glfwSwapBuffers(window);
+                // Keep the driver from queueing frames ahead of the GPU
+                if (info.flags.lowLatency)
+                    glFinish();
+            }
+            recordPacing();
+            if (!info.flags.lowLatency)
+            {
+                stage zone(this, "glfwPollEvents");
+                glfwPollEvents();
+            }
+            if (info.idleFrameRate > 0.0 && !inputSeen && idle())
+            {
+                stage zone(this, "idle");
+                waitForInput(currentTime + 1.0 / info.idleFrameRate);
+            }
+            if (!info.flags.lowLatency)
+            {
+                stage zone(this, "paceFrame");
+                paceFrame();
+            }
 
             running &= (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_RELEASE);
             running &= (glfwWindowShouldClose(window) != GL_TRUE);
@@ -193,6 +274,10 @@ public:
 #ifdef _DEBUG
         info.flags.debug = 1;
 #endif
+        info.simulationStep = 0.0;
+        info.maxSubsteps = 8;
+        info.idleFrameRate = 0.0;
+        info.frameRateCap = 0.0;
     }
 
     virtual void startup()
@@ -282,41 +367,184 @@ public:
                 unsigned int    stereo      : 1;
                 unsigned int    debug       : 1;
                 unsigned int    robust      : 1;
+                unsigned int    hidden      : 1;
+                unsigned int    lowLatency  : 1;
             };
             unsigned int        all;
         } flags;
+        double simulationStep;  // seconds per update(), 0 disables it
+        int maxSubsteps;        // most update() calls made for a single frame
+        double idleFrameRate;   // frames per second while idle(), 0 renders flat out
+        double frameRateCap;    // most frames per second, 0 for no cap
     };
 
+    // Time between presents over the last pacingWindow frames
+    struct PACINGSTATS
+    {
+        double lastMs;
+        double meanMs;
+        double jitterMs;        // standard deviation
+        double worstMs;
+        int    late;            // frames over the frame cap's period by more than 1 ms
+    };
+
+    const PACINGSTATS& pacingStats() const
+    {
+        return pacing;
+    }
+
 protected:
     APPINFO     info;
     static      sb7::application * app;
     GLFWwindow* window;
+    double      simulationAlpha; // how far render() is between the last two updates
+    int         clampedFrames;   // frames that took longer than maxSubsteps steps
+    double      droppedTime;     // simulated seconds those frames skipped
+    bool        idleFrame;       // render() is an idle frame, only animation needs redrawing
+    bool        inputSeen;       // an input callback ran since the last render()
+
+    static const int pacingWindow = 120;
+    PACINGSTATS pacing;
+    double      pacingIntervals[pacingWindow];
+    int         pacingCount;
+    double      lastPresentTime;
+    double      nextFrameTime;   // when the frame cap lets the next frame start
+    double      sleepEstimate;   // longest a 1 ms sleep is likely to take
 
     static void glfw_onResize(GLFWwindow* window, int w, int h)
     {
+        app->inputSeen = true;
         app->onResize(w, h);
     }
 
     static void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mods)
     {
+        app->inputSeen = true;
         app->onKey(key, action);
     }
 
     static void glfw_onMouseButton(GLFWwindow* window, int button, int action, int mods)
     {
+        app->inputSeen = true;
         app->onMouseButton(button, action);
     }
 
     static void glfw_onMouseMove(GLFWwindow* window, double x, double y)
     {
+        app->inputSeen = true;
         app->onMouseMove(static_cast<int>(x), static_cast<int>(y));
     }
 
     static void glfw_onMouseWheel(GLFWwindow* window, double xoffset, double yoffset)
     {
+        app->inputSeen = true;
         app->onMouseWheel(static_cast<int>(yoffset));
     }
 
+    // Called every info.simulationStep seconds of real time, before render()
+    virtual void update(double step)
+    {
+
+    }
+
+    // Called around each stage of run() (polling, update, render, swapping,
+    // waiting), override to time them. Stages don't overlap.
+    virtual void beginStage(const char * name)
+    {
+
+    }
+
+    virtual void endStage()
+    {
+
+    }
+
+    struct stage
+    {
+        stage(application * app, const char * name) : app(app) { app->beginStage(name); }
+        ~stage() { app->endStage(); }
+        application * app;
+    };
+
+    // True when the scene only changes by animating. With info.idleFrameRate
+    // set, the loop then renders at that rate with idleFrame set, and waits
+    // for input between frames instead of spinning.
+    virtual bool idle()
+    {
+        return false;
+    }
+
+    // Hold the frame to info.frameRateCap. Sleeping is only accurate to the
+    // scheduler's tick, so sleep while a whole (measured) sleep still fits and
+    // spin for the rest.
+    void paceFrame()
+    {
+        if (info.frameRateCap <= 0.0)
+            return;
+
+        double period = 1.0 / info.frameRateCap;
+        double now = glfwGetTime();
+        nextFrameTime += period;
+        if (nextFrameTime < now - period)
+            nextFrameTime = now; // too far behind to catch up, start again from here
+
+        while (nextFrameTime - now > sleepEstimate)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double slept = glfwGetTime() - now;
+            sleepEstimate = slept > sleepEstimate ? slept : sleepEstimate * 0.95 + slept * 0.05;
+            now += slept;
+        }
+        while (glfwGetTime() < nextFrameTime)
+            std::this_thread::yield();
+    }
+
+    void recordPacing()
+    {
+        double now = glfwGetTime();
+        if (lastPresentTime > 0.0)
+            pacingIntervals[pacingCount++ % pacingWindow] = (now - lastPresentTime) * 1000.0;
+        lastPresentTime = now;
+
+        int n = pacingCount;
+        if (n > pacingWindow)
+            n = pacingWindow;
+        if (n == 0)
+            return;
+        double sum = 0.0, sumSq = 0.0, worst = 0.0;
+        double lateMs = info.frameRateCap > 0.0 ? 1000.0 / info.frameRateCap + 1.0 : 0.0;
+        pacing.late = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double ms = pacingIntervals[i];
+            sum += ms;
+            sumSq += ms * ms;
+            if (ms > worst)
+                worst = ms;
+            if (lateMs > 0.0 && ms > lateMs)
+                pacing.late++;
+        }
+        pacing.lastMs = pacingIntervals[(pacingCount - 1) % pacingWindow];
+        pacing.meanMs = sum / n;
+        double variance = sumSq / n - pacing.meanMs * pacing.meanMs;
+        pacing.jitterMs = variance > 0.0 ? sqrt(variance) : 0.0;
+        pacing.worstMs = worst;
+    }
+
+    // GLFW 3.0 has no glfwWaitEventsTimeout, so poll with short sleeps until
+    // input arrives, the window wants to close or the time comes
+    void waitForInput(double until)
+    {
+        while (!inputSeen && glfwWindowShouldClose(window) != GL_TRUE)
+        {
+            double left = until - glfwGetTime();
+            if (left <= 0.0)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(left > 0.002 ? 1 : 0));
+            glfwPollEvents();
+        }
+    }
+
     void setVsync(bool enable)
     {
         info.flags.vsync = enable ? 1 : 0;
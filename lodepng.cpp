@@ -37,6 +37,12 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+/*SSE2 is always there on x64, on x86 when building with /arch:SSE2 or -msse2*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LODEPNG_SSE2
+#include <emmintrin.h>
+#endif /*SSE2*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -489,11 +495,14 @@ Huffman tree struct, containing multiple representations of the tree
 */
 typedef struct HuffmanTree
 {
-	unsigned* tree2d;
 	unsigned* tree1d;
 	unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
 	unsigned maxbitlen; /*maximum number of bits a single code can get*/
 	unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+	/*decoder lookup table, indexed by the next FIRSTBITS bits of the stream (lsb first).
+	Entries with a length > FIRSTBITS point to a second level table in table_value*/
+	unsigned char* table_len; /*length of the code, or of the longest code in the second level table*/
+	unsigned short* table_value; /*the symbol, or the start of the second level table*/
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -511,74 +520,130 @@ std::cout << std::endl;
 
 static void HuffmanTree_init(HuffmanTree* tree)
 {
-	tree->tree2d = 0;
 	tree->tree1d = 0;
 	tree->lengths = 0;
+	tree->table_len = 0;
+	tree->table_value = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
 {
-	lodepng_free(tree->tree2d);
 	lodepng_free(tree->tree1d);
 	lodepng_free(tree->lengths);
+	lodepng_free(tree->table_len);
+	lodepng_free(tree->table_value);
 }
 
-/*the tree representation used by the decoder. return value is error*/
-static unsigned HuffmanTree_make2DTree(HuffmanTree* tree)
+/*number of bits the first level of the decoder lookup table is indexed with*/
+#define FIRSTBITS 9u
+/*table_len value of an entry that no code maps to*/
+#define INVALIDLENGTH 16u
+/*symbol returned for bits that don't form a code of an incomplete tree*/
+#define INVALIDSYMBOL 65535u
+
+static unsigned reverseBits(unsigned bits, unsigned num)
 {
-	unsigned nodefilled = 0; /*up to which node it is filled*/
-	unsigned treepos = 0; /*position in the tree (1 of the numcodes columns)*/
-	unsigned n, i;
+	unsigned i, result = 0;
+	for (i = 0; i != num; ++i) result |= ((bits >> (num - i - 1)) & 1u) << i;
+	return result;
+}
 
-	tree->tree2d = (unsigned*)lodepng_malloc(tree->numcodes * 2 * sizeof(unsigned));
-	if (!tree->tree2d) return 83; /*alloc fail*/
+/*
+the tree representation used by the decoder. return value is error
+Deflate codes are read lsb first, so the tables are indexed with the bit reversed
+codes. A code of length l <= FIRSTBITS fills all 2^(FIRSTBITS - l) first level
+entries that start with it. Longer codes go into a second level table per
+FIRSTBITS prefix, sized for the longest code with that prefix, so a symbol is
+found with at most two lookups instead of a walk down the tree bit per bit.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+	static const unsigned headsize = 1u << FIRSTBITS;
+	static const unsigned mask = (1u << FIRSTBITS) - 1u;
+	size_t i, size, pointer, numpresent = 0;
+	unsigned maxlens[1u << FIRSTBITS];
 
-	/*
-	convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means
-	uninited, a value >= numcodes is an address to another bit, a value < numcodes
-	is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as
-	many columns as codes - 1.
-	A good huffman tree has N * 2 - 1 nodes, of which N - 1 are internal nodes.
-	Here, the internal nodes are stored (what their 0 and 1 option point to).
-	There is only memory for such good tree currently, if there are more nodes
-	(due to too long length codes), error 55 will happen
-	*/
-	for (n = 0; n < tree->numcodes * 2; ++n)
+	/*step 1: the longest code behind every first level entry*/
+	for (i = 0; i != headsize; ++i) maxlens[i] = 0;
+	for (i = 0; i != tree->numcodes; ++i)
 	{
-		tree->tree2d[n] = 32767; /*32767 here means the tree2d isn't filled there yet*/
+		unsigned l = tree->lengths[i];
+		unsigned index;
+		if (l <= FIRSTBITS) continue;
+		index = reverseBits(tree->tree1d[i] >> (l - FIRSTBITS), FIRSTBITS);
+		if (maxlens[index] < l) maxlens[index] = l;
 	}
 
-	for (n = 0; n < tree->numcodes; ++n) /*the codes*/
+	size = headsize;
+	for (i = 0; i != headsize; ++i)
 	{
-		for (i = 0; i != tree->lengths[n]; ++i) /*the bits for this code*/
+		if (maxlens[i] > FIRSTBITS) size += 1u << (maxlens[i] - FIRSTBITS);
+	}
+
+	tree->table_len = (unsigned char*)lodepng_malloc(size * sizeof(unsigned char));
+	tree->table_value = (unsigned short*)lodepng_malloc(size * sizeof(unsigned short));
+	if (!tree->table_len || !tree->table_value) return 83; /*alloc fail*/
+
+	for (i = 0; i != size; ++i) tree->table_len[i] = INVALIDLENGTH;
+
+	/*step 2: point the first level entries of long codes at their second level table*/
+	pointer = headsize;
+	for (i = 0; i != headsize; ++i)
+	{
+		unsigned l = maxlens[i];
+		if (l <= FIRSTBITS) continue;
+		tree->table_len[i] = (unsigned char)l;
+		tree->table_value[i] = (unsigned short)pointer;
+		pointer += 1u << (l - FIRSTBITS);
+	}
+
+	/*step 3: fill in the symbols*/
+	for (i = 0; i != tree->numcodes; ++i)
+	{
+		unsigned l = tree->lengths[i];
+		unsigned reverse, j;
+		if (l == 0) continue;
+		reverse = reverseBits(tree->tree1d[i], l);
+		++numpresent;
+
+		if (l <= FIRSTBITS)
 		{
-			unsigned char bit = (unsigned char)((tree->tree1d[n] >> (tree->lengths[n] - i - 1)) & 1);
-			/*oversubscribed, see comment in lodepng_error_text*/
-			if (treepos > 2147483647 || treepos + 2 > tree->numcodes) return 55;
-			if (tree->tree2d[2 * treepos + bit] == 32767) /*not yet filled in*/
+			unsigned num = 1u << (FIRSTBITS - l);
+			for (j = 0; j != num; ++j)
 			{
-				if (i + 1 == tree->lengths[n]) /*last bit*/
-				{
-					tree->tree2d[2 * treepos + bit] = n; /*put the current code in it*/
-					treepos = 0;
-				}
-				else
-				{
-					/*put address of the next step in here, first that address has to be found of course
-					(it's just nodefilled + 1)...*/
-					++nodefilled;
-					/*addresses encoded with numcodes added to it*/
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;
-					treepos = nodefilled;
-				}
+				unsigned index = reverse | (j << l);
+				/*oversubscribed, see comment in lodepng_error_text*/
+				if (tree->table_len[index] != INVALIDLENGTH) return 55;
+				tree->table_len[index] = (unsigned char)l;
+				tree->table_value[index] = (unsigned short)i;
+			}
+		}
+		else
+		{
+			unsigned index = reverse & mask;
+			unsigned maxlen = tree->table_len[index];
+			unsigned start = tree->table_value[index];
+			unsigned num = 1u << (maxlen - l);
+			if (maxlen < l) return 55;
+			for (j = 0; j != num; ++j)
+			{
+				unsigned index2 = start + ((reverse >> FIRSTBITS) | (j << (l - FIRSTBITS)));
+				if (tree->table_len[index2] != INVALIDLENGTH) return 55;
+				tree->table_len[index2] = (unsigned char)l;
+				tree->table_value[index2] = (unsigned short)i;
 			}
-			else treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
 		}
 	}
 
-	for (n = 0; n < tree->numcodes * 2; ++n)
+	/*a tree with less than two codes can't be complete (deflate allows a single
+	distance code), the unused bits decode to an invalid symbol. With two or more
+	codes the tree must be complete.*/
+	for (i = 0; i != size; ++i)
 	{
-		if (tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
+		if (tree->table_len[i] != INVALIDLENGTH) continue;
+		if (numpresent >= 2) return 55;
+		tree->table_len[i] = (unsigned char)(i < headsize ? 1 : FIRSTBITS + 1);
+		tree->table_value[i] = INVALIDSYMBOL;
 	}
 
 	return 0;
@@ -625,7 +690,7 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree)
 	uivector_cleanup(&blcount);
 	uivector_cleanup(&nextcode);
 
-	if (!error) return HuffmanTree_make2DTree(tree);
+	if (!error) return HuffmanTree_makeTable(tree);
 	else return error;
 }
 
@@ -911,21 +976,35 @@ inbitlength is the length of the complete buffer, in bits (so its byte length ti
 static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 	const HuffmanTree* codetree, size_t inbitlength)
 {
-	unsigned treepos = 0, ct;
-	for (;;)
+	/*the next 24 bits, lsb first. Bytes past the end read as 0, that is caught by the length check below.
+	24 bits are enough for the up to 7 bits already used in the first byte plus a 15 bit code*/
+	size_t p = (*bp) >> 3;
+	size_t inlength = (inbitlength + 7) >> 3;
+	unsigned bits, index, l, value;
+	if (p + 2 < inlength) bits = in[p] | ((unsigned)in[p + 1] << 8) | ((unsigned)in[p + 2] << 16);
+	else
 	{
-		if (*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
-		/*
-		decode the symbol from the tree. The "readBitFromStream" code is inlined in
-		the expression below because this is the biggest bottleneck while decoding
-		*/
-		ct = codetree->tree2d[(treepos << 1) + READBIT(*bp, in)];
-		++(*bp);
-		if (ct < codetree->numcodes) return ct; /*the symbol is decoded, return it*/
-		else treepos = ct - codetree->numcodes; /*symbol not yet decoded, instead move tree position*/
+		bits = 0;
+		if (p < inlength) bits |= in[p];
+		if (p + 1 < inlength) bits |= (unsigned)in[p + 1] << 8;
+	}
+	bits >>= (*bp) & 7u;
 
-		if (treepos >= codetree->numcodes) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+	index = bits & ((1u << FIRSTBITS) - 1u);
+	l = codetree->table_len[index];
+	value = codetree->table_value[index];
+	if (l > FIRSTBITS)
+	{
+		/*long code, look up the rest of its bits in the second level table*/
+		index = value + ((bits >> FIRSTBITS) & ((1u << (l - FIRSTBITS)) - 1u));
+		l = codetree->table_len[index];
+		value = codetree->table_value[index];
 	}
+
+	(*bp) += l;
+	if (*bp > inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
+	if (value == INVALIDSYMBOL) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+	return value;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -1091,9 +1170,49 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 	return error;
 }
 
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len);
+
+/*
+Optional receiver of the inflated data while inflating, so the whole output
+never has to exist at once. Whenever flushsize bytes are waiting, the sink
+consumes what it can, and everything consumed except the last 32K (which back
+references may still point into) is dropped from the front of the out buffer.
+*/
+typedef struct InflateSink
+{
+	/*use whole units (e.g. scanlines) of data[0..size), set *used to the number of bytes used*/
+	unsigned (*consume)(void* context, const unsigned char* data, size_t size, size_t* used);
+	void* context;
+	size_t flushsize;
+	size_t start; /*first byte in the out buffer the sink did not use yet*/
+	size_t end; /*bytes in the out buffer after the last flush*/
+	unsigned adler; /*adler32 of all used bytes*/
+} InflateSink;
+
+static unsigned inflateFlush(ucvector* out, size_t* pos, InflateSink* sink)
+{
+	size_t used = 0, drop;
+	unsigned error = sink->consume(sink->context, &out->data[sink->start], *pos - sink->start, &used);
+	if (error) return error;
+	sink->adler = update_adler32(sink->adler, &out->data[sink->start], (unsigned)used);
+	sink->start += used;
+
+	drop = *pos > 32768 ? *pos - 32768 : 0;
+	if (drop > sink->start) drop = sink->start;
+	if (drop)
+	{
+		memmove(out->data, out->data + drop, *pos - drop);
+		*pos -= drop;
+		sink->start -= drop;
+		out->size = *pos;
+	}
+	sink->end = *pos;
+	return 0;
+}
+
 /*inflate a block with dynamic of fixed Huffman tree*/
 static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-	size_t* pos, size_t inlength, unsigned btype)
+	size_t* pos, size_t inlength, unsigned btype, InflateSink* sink)
 {
 	unsigned error = 0;
 	HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
@@ -1108,6 +1227,12 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 
 	while (!error) /*decode all symbols until end reached, breaks at end code*/
 	{
+		if (sink && *pos - sink->start >= sink->flushsize)
+		{
+			error = inflateFlush(out, pos, sink);
+			if (error) break;
+		}
+
 		/*code_ll is literal, length or end code*/
 		unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
 		if (code_ll <= 255) /*literal symbol*/
@@ -1187,7 +1312,8 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 	return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength,
+	InflateSink* sink)
 {
 	size_t p;
 	unsigned LEN, NLEN, n, error = 0;
@@ -1212,12 +1338,14 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
 
 	(*bp) = p * 8;
 
+	if (sink && *pos - sink->start >= sink->flushsize) error = inflateFlush(out, pos, sink);
+
 	return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
+static unsigned inflateStream(ucvector* out,
 	const unsigned char* in, size_t insize,
-	const LodePNGDecompressSettings* settings)
+	InflateSink* sink)
 {
 	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
 	size_t bp = 0;
@@ -1225,8 +1353,6 @@ static unsigned lodepng_inflatev(ucvector* out,
 	size_t pos = 0; /*byte position in the out buffer*/
 	unsigned error = 0;
 
-	(void)settings;
-
 	while (!BFINAL)
 	{
 		unsigned BTYPE;
@@ -1236,15 +1362,26 @@ static unsigned lodepng_inflatev(ucvector* out,
 		BTYPE += 2u * readBitFromStream(&bp, in);
 
 		if (BTYPE == 3) return 20; /*error: invalid BTYPE*/
-		else if (BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-		else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+		else if (BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize, sink); /*no compression*/
+		else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
 		if (error) return error;
 	}
 
+	/*hand over the rest*/
+	if (sink) error = inflateFlush(out, &pos, sink);
+
 	return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+	const unsigned char* in, size_t insize,
+	const LodePNGDecompressSettings* settings)
+{
+	(void)settings;
+	return inflateStream(out, in, insize, 0);
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
 	const unsigned char* in, size_t insize,
 	const LodePNGDecompressSettings* settings)
@@ -1980,6 +2117,108 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 	return error;
 }
 
+/*
+Compresses in[start..end) as one dynamic block that can be encoded independently
+of the blocks before it. The hash is primed with the window that precedes start,
+so matches still reach back into the previous chunk (like pigz does with its
+dictionary tail). If the chunk is not the final one, an empty stored block is
+appended to bring the stream back to a byte boundary, so the outputs of all
+chunks can simply be concatenated.
+*/
+static unsigned deflateChunk(ucvector* out, const unsigned char* in, size_t start, size_t end,
+	const LodePNGCompressSettings* settings, unsigned final)
+{
+	unsigned error = 0;
+	size_t bp = 0; /*the bit pointer*/
+	Hash hash;
+
+	if (settings->windowsize == 0 || settings->windowsize > 32768) return 60;
+	if ((settings->windowsize & (settings->windowsize - 1)) != 0) return 90;
+
+	error = hash_init(&hash, settings->windowsize);
+	if (error) return error;
+
+	if (settings->use_lz77)
+	{
+		/*same hash chain updates as encodeLZ77 does for every byte it passes*/
+		size_t pos = start > settings->windowsize ? start - settings->windowsize : 0;
+		unsigned numzeros = 0;
+		for (; pos < start; ++pos)
+		{
+			unsigned hashval = getHash(in, end, pos);
+			if (hashval == 0)
+			{
+				if (numzeros == 0) numzeros = countZeros(in, end, pos);
+				else if (pos + numzeros > end || in[pos + numzeros - 1] != 0) --numzeros;
+			}
+			else
+			{
+				numzeros = 0;
+			}
+			updateHashChain(&hash, pos & (settings->windowsize - 1), hashval, numzeros);
+		}
+	}
+
+	error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+
+	if (!error && !final)
+	{
+		/*empty non-final stored block: BFINAL 0, BTYPE 00, pad to the byte, LEN 0, NLEN 0xffff*/
+		addBitsToStream(&bp, out, 0, 3);
+		if (!ucvector_push_back(out, 0) || !ucvector_push_back(out, 0)
+			|| !ucvector_push_back(out, 255) || !ucvector_push_back(out, 255)) error = 83; /*alloc fail*/
+	}
+
+	hash_cleanup(&hash);
+
+	return error;
+}
+
+/*deflate with dynamic blocks compressed on settings->numthreads threads*/
+static unsigned deflateParallel(ucvector* out, const unsigned char* in, size_t insize,
+	size_t blocksize, size_t numdeflateblocks, const LodePNGCompressSettings* settings)
+{
+	unsigned error = 0;
+	long i;
+	ucvector* parts = (ucvector*)lodepng_malloc(numdeflateblocks * sizeof(ucvector));
+	unsigned* errors = (unsigned*)lodepng_malloc(numdeflateblocks * sizeof(unsigned));
+	if (!parts || !errors)
+	{
+		lodepng_free(parts);
+		lodepng_free(errors);
+		return 83; /*alloc fail*/
+	}
+
+	for (i = 0; i != (long)numdeflateblocks; ++i) ucvector_init_buffer(&parts[i], 0, 0);
+
+	/*blocks are independent, each one owns its output and its hash*/
+#pragma omp parallel for num_threads(settings->numthreads) schedule(dynamic)
+	for (i = 0; i < (long)numdeflateblocks; ++i)
+	{
+		size_t start = (size_t)i * blocksize;
+		size_t end = start + blocksize;
+		if (end > insize) end = insize;
+		errors[i] = deflateChunk(&parts[i], in, start, end, settings, (size_t)i == numdeflateblocks - 1);
+	}
+
+	/*stitch the byte aligned parts together in order*/
+	for (i = 0; i != (long)numdeflateblocks; ++i)
+	{
+		size_t j;
+		if (!error) error = errors[i];
+		for (j = 0; !error && j != parts[i].size; ++j)
+		{
+			if (!ucvector_push_back(out, parts[i].data[j])) error = 83; /*alloc fail*/
+		}
+		lodepng_free(parts[i].data);
+	}
+
+	lodepng_free(parts);
+	lodepng_free(errors);
+
+	return error;
+}
+
 static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
 	const LodePNGCompressSettings* settings)
 {
@@ -2002,6 +2241,11 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 	numdeflateblocks = (insize + blocksize - 1) / blocksize;
 	if (numdeflateblocks == 0) numdeflateblocks = 1;
 
+	if (settings->btype == 2 && settings->numthreads > 1 && numdeflateblocks > 1)
+	{
+		return deflateParallel(out, in, insize, blocksize, numdeflateblocks, settings);
+	}
+
 	error = hash_init(&hash, settings->windowsize);
 	if (error) return error;
 
@@ -2083,16 +2327,64 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 	return update_adler32(1L, data, len);
 }
 
+#ifdef LODEPNG_COMPILE_ENCODER
+/*Return the adler32 of the concatenation of two pieces, from the adler32 of
+each piece and the length of the second one (same math as zlib's adler32_combine)*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+	unsigned rem = (unsigned)(len2 % 65521);
+	unsigned s1 = adler1 & 0xffff;
+	unsigned s2 = (rem * s1) % 65521;
+	s1 += (adler2 & 0xffff) + 65521 - 1;
+	s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+	if (s1 >= 65521) s1 -= 65521;
+	if (s1 >= 65521) s1 -= 65521;
+	if (s2 >= 65521 * 2) s2 -= 65521 * 2;
+	if (s2 >= 65521) s2 -= 65521;
+	return (s2 << 16) | s1;
+}
+
+/*adler32 of pieces of 1MB on numthreads threads*/
+static unsigned adler32_parallel(const unsigned char* data, size_t len, unsigned numthreads)
+{
+	const size_t piecesize = 1048576;
+	long i, numpieces = (long)((len + piecesize - 1) / piecesize);
+	unsigned result = 1L;
+	unsigned* sums;
+
+	if (numthreads <= 1 || numpieces <= 1) return adler32(data, (unsigned)len);
+	sums = (unsigned*)lodepng_malloc(numpieces * sizeof(unsigned));
+	if (!sums) return adler32(data, (unsigned)len);
+
+#pragma omp parallel for num_threads(numthreads)
+	for (i = 0; i < numpieces; ++i)
+	{
+		size_t start = (size_t)i * piecesize;
+		size_t size = len - start < piecesize ? len - start : piecesize;
+		sums[i] = adler32(data + start, (unsigned)size);
+	}
+
+	for (i = 0; i != numpieces; ++i)
+	{
+		size_t start = (size_t)i * piecesize;
+		size_t size = len - start < piecesize ? len - start : piecesize;
+		result = adler32_combine(result, sums[i], size);
+	}
+
+	lodepng_free(sums);
+	return result;
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-	size_t insize, const LodePNGDecompressSettings* settings)
+/*check the 2 byte zlib header, return value is error*/
+static unsigned zlibCheckHeader(const unsigned char* in, size_t insize)
 {
-	unsigned error = 0;
 	unsigned CM, CINFO, FDICT;
 
 	if (insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2121,6 +2413,15 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
 		return 26;
 	}
 
+	return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+	size_t insize, const LodePNGDecompressSettings* settings)
+{
+	unsigned error = zlibCheckHeader(in, insize);
+	if (error) return error;
+
 	error = inflate(out, outsize, in + 2, insize - 2, settings);
 	if (error) return error;
 
@@ -2147,6 +2448,36 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
 	}
 }
 
+#ifdef LODEPNG_COMPILE_PNG
+/*
+zlib decompression that hands the data to sink as it comes, holding at most about
+32K + sink->flushsize bytes of it. Always uses the built in inflate, custom_zlib
+and custom_inflate are ignored.
+*/
+static unsigned zlib_decompress_stream(const unsigned char* in, size_t insize,
+	const LodePNGDecompressSettings* settings, InflateSink* sink)
+{
+	ucvector window;
+	unsigned error = zlibCheckHeader(in, insize);
+	if (error) return error;
+
+	sink->start = 0;
+	sink->adler = 1;
+	ucvector_init(&window);
+	error = inflateStream(&window, in + 2, insize - 2, sink);
+	ucvector_cleanup(&window);
+	if (error) return error;
+
+	if (!settings->ignore_adler32)
+	{
+		if (insize < 6) return 53; /*error, size of zlib data too small*/
+		if (sink->adler != lodepng_read32bitInt(&in[insize - 4])) return 58; /*error, adler checksum not correct, data must be corrupted*/
+	}
+
+	return 0;
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -2180,7 +2511,7 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
 
 	if (!error)
 	{
-		unsigned ADLER32 = adler32(in, (unsigned)insize);
+		unsigned ADLER32 = adler32_parallel(in, insize, settings->numthreads);
 		for (i = 0; i != deflatesize; ++i) ucvector_push_back(&outv, deflatedata[i]);
 		lodepng_free(deflatedata);
 		lodepng_add32bitInt(&outv, ADLER32);
@@ -2249,9 +2580,11 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
 	settings->custom_zlib = 0;
 	settings->custom_deflate = 0;
 	settings->custom_context = 0;
+
+	settings->numthreads = 1;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = { 2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0 };
+const LodePNGCompressSettings lodepng_default_compress_settings = { 2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 1 };
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -3898,6 +4231,105 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
 	return state->error;
 }
 
+#ifdef LODEPNG_SSE2
+/*
+SSE2 versions of the filters that depend on the pixel to the left, for 3 and 4
+bytes per pixel (RGB8 and RGBA8). That dependency leaves no room to do more than
+one pixel at a time, but all bytes of a pixel are done at once, in 16 bit lanes
+for paeth. Loads and stores go through memcpy so 3 byte pixels never touch the
+byte after them (recon and scanline may be the same memory).
+*/
+static __m128i loadPixel(const unsigned char* p, size_t bytewidth)
+{
+	int v = 0;
+	memcpy(&v, p, bytewidth);
+	return _mm_cvtsi32_si128(v);
+}
+
+static void storePixel(unsigned char* p, __m128i v, size_t bytewidth)
+{
+	int result = _mm_cvtsi128_si32(v);
+	memcpy(p, &result, bytewidth);
+}
+
+/*returns 1 if the line was unfiltered here, 0 if the scalar code has to do it*/
+static unsigned unfilterScanlineSSE2(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+	size_t bytewidth, unsigned char filterType, size_t length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+	__m128i a, b, c, x;
+
+	if (bytewidth != 3 && bytewidth != 4) return 0;
+
+	switch (filterType)
+	{
+	case 1:
+		a = zero;
+		for (i = 0; i + bytewidth <= length; i += bytewidth)
+		{
+			a = _mm_add_epi8(loadPixel(&scanline[i], bytewidth), a);
+			storePixel(&recon[i], a, bytewidth);
+		}
+		return 1;
+	case 2:
+		if (!precon) return 0;
+		for (i = 0; i + 16 <= length; i += 16)
+		{
+			x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+			b = _mm_loadu_si128((const __m128i*)&precon[i]);
+			_mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, b));
+		}
+		for (; i != length; ++i) recon[i] = scanline[i] + precon[i];
+		return 1;
+	case 3:
+		if (!precon) return 0;
+		a = zero;
+		for (i = 0; i + bytewidth <= length; i += bytewidth)
+		{
+			/*avg_epu8 rounds up, take the lost low bit off again to get (a + b) >> 1*/
+			b = loadPixel(&precon[i], bytewidth);
+			x = loadPixel(&scanline[i], bytewidth);
+			c = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+			a = _mm_add_epi8(x, c);
+			storePixel(&recon[i], a, bytewidth);
+		}
+		return 1;
+	case 4:
+		if (!precon) return 0;
+		a = zero;
+		c = zero;
+		for (i = 0; i + bytewidth <= length; i += bytewidth)
+		{
+			__m128i pa, pb, pc, smallest, nearest;
+			b = _mm_unpacklo_epi8(loadPixel(&precon[i], bytewidth), zero);
+			x = _mm_unpacklo_epi8(loadPixel(&scanline[i], bytewidth), zero);
+
+			/*same distances as paethPredictor, abs is max(v, -v)*/
+			pa = _mm_sub_epi16(b, c);
+			pb = _mm_sub_epi16(a, c);
+			pc = _mm_add_epi16(pa, pb);
+			pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+			pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+			pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+			/*a if it is nearest, else b if that is nearer than c, else c*/
+			smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			nearest = _mm_cmpeq_epi16(smallest, pb);
+			nearest = _mm_or_si128(_mm_and_si128(nearest, b), _mm_andnot_si128(nearest, c));
+			pa = _mm_cmpeq_epi16(smallest, pa);
+			nearest = _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, nearest));
+
+			c = b;
+			a = _mm_and_si128(_mm_add_epi16(x, nearest), _mm_set1_epi16(255));
+			storePixel(&recon[i], _mm_packus_epi16(a, a), bytewidth);
+		}
+		return 1;
+	default: return 0;
+	}
+}
+#endif /*LODEPNG_SSE2*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
 	size_t bytewidth, unsigned char filterType, size_t length)
 {
@@ -3911,6 +4343,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
 	*/
 
 	size_t i;
+#ifdef LODEPNG_SSE2
+	if (unfilterScanlineSSE2(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif /*LODEPNG_SSE2*/
 	switch (filterType)
 	{
 	case 0:
@@ -4450,17 +4885,14 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+/*read the header and all chunks, appending the data of the IDAT chunks to idat*/
+static void readChunks(ucvector* idat, unsigned* w, unsigned* h,
 	LodePNGState* state,
 	const unsigned char* in, size_t insize)
 {
 	unsigned char IEND = 0;
 	const unsigned char* chunk;
 	size_t i;
-	ucvector idat; /*the data from idat chunks*/
-	ucvector scanlines;
-	size_t predict;
 	size_t numpixels;
 
 	/*for unknown chunk order*/
@@ -4469,9 +4901,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 	unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-	/*provide some proper output values if error will happen*/
-	*out = 0;
-
 	state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
 	if (state->error) return;
 
@@ -4483,7 +4912,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 	bytes with 16-bit RGBA, the rest is room for filter bytes.*/
 	if (numpixels > 268435455) CERROR_RETURN(state->error, 92);
 
-	ucvector_init(&idat);
 	chunk = &in[33]; /*first byte of the first chunk after the header*/
 
 	/*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4511,9 +4939,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 		/*IDAT chunk, containing compressed image data*/
 		if (lodepng_chunk_type_equals(chunk, "IDAT"))
 		{
-			size_t oldsize = idat.size;
-			if (!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-			for (i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+			size_t oldsize = idat->size;
+			if (!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+			for (i = 0; i != chunkLength; ++i) idat->data[oldsize + i] = data[i];
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
 			critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4606,36 +5034,71 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
 		if (!IEND) chunk = lodepng_chunk_next_const(chunk);
 	}
+}
+
+/*inflate the data of the IDAT chunks into scanlines (which must be inited): the filtered, padded and possibly interlaced rows*/
+static void inflateIdat(ucvector* scanlines, const ucvector* idat, unsigned w, unsigned h,
+	LodePNGState* state)
+{
+	size_t predict;
 
-	ucvector_init(&scanlines);
 	/*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
 	If the decompressed size does not match the prediction, the image must be corrupt.*/
 	if (state->info_png.interlace_method == 0)
 	{
-		/*The extra *h is added because this are the filter bytes every scanline starts with*/
-		predict = lodepng_get_raw_size_idat(*w, *h, &state->info_png.color) + *h;
+		/*The extra h is added because this are the filter bytes every scanline starts with*/
+		predict = lodepng_get_raw_size_idat(w, h, &state->info_png.color) + h;
 	}
 	else
 	{
 		/*Adam-7 interlaced: predicted size is the sum of the 7 sub-images sizes*/
 		const LodePNGColorMode* color = &state->info_png.color;
 		predict = 0;
-		predict += lodepng_get_raw_size_idat((*w + 7) >> 3, (*h + 7) >> 3, color) + ((*h + 7) >> 3);
-		if (*w > 4) predict += lodepng_get_raw_size_idat((*w + 3) >> 3, (*h + 7) >> 3, color) + ((*h + 7) >> 3);
-		predict += lodepng_get_raw_size_idat((*w + 3) >> 2, (*h + 3) >> 3, color) + ((*h + 3) >> 3);
-		if (*w > 2) predict += lodepng_get_raw_size_idat((*w + 1) >> 2, (*h + 3) >> 2, color) + ((*h + 3) >> 2);
-		predict += lodepng_get_raw_size_idat((*w + 1) >> 1, (*h + 1) >> 2, color) + ((*h + 1) >> 2);
-		if (*w > 1) predict += lodepng_get_raw_size_idat((*w + 0) >> 1, (*h + 1) >> 1, color) + ((*h + 1) >> 1);
-		predict += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, color) + ((*h + 0) >> 1);
-	}
-	if (!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
+		predict += lodepng_get_raw_size_idat((w + 7) >> 3, (h + 7) >> 3, color) + ((h + 7) >> 3);
+		if (w > 4) predict += lodepng_get_raw_size_idat((w + 3) >> 3, (h + 7) >> 3, color) + ((h + 7) >> 3);
+		predict += lodepng_get_raw_size_idat((w + 3) >> 2, (h + 3) >> 3, color) + ((h + 3) >> 3);
+		if (w > 2) predict += lodepng_get_raw_size_idat((w + 1) >> 2, (h + 3) >> 2, color) + ((h + 3) >> 2);
+		predict += lodepng_get_raw_size_idat((w + 1) >> 1, (h + 1) >> 2, color) + ((h + 1) >> 2);
+		if (w > 1) predict += lodepng_get_raw_size_idat((w + 0) >> 1, (h + 1) >> 1, color) + ((h + 1) >> 1);
+		predict += lodepng_get_raw_size_idat((w + 0), (h + 0) >> 1, color) + ((h + 0) >> 1);
+	}
+	if (!ucvector_reserve(scanlines, predict)) state->error = 83; /*alloc fail*/
 	if (!state->error)
 	{
-		state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-			idat.size, &state->decoder.zlibsettings);
-		if (!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
+		state->error = zlib_decompress(&scanlines->data, &scanlines->size, idat->data,
+			idat->size, &state->decoder.zlibsettings);
+		if (!state->error && scanlines->size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
 	}
+}
+
+/*read all chunks and inflate the IDAT data into scanlines*/
+static void decodeIdat(ucvector* scanlines, unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize)
+{
+	ucvector idat; /*the data from idat chunks*/
+
+	ucvector_init(scanlines);
+	ucvector_init(&idat);
+
+	readChunks(&idat, w, h, state, in, insize);
+	if (!state->error) inflateIdat(scanlines, &idat, *w, *h, state);
+
 	ucvector_cleanup(&idat);
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize)
+{
+	ucvector scanlines;
+	size_t i;
+
+	/*provide some proper output values if error will happen*/
+	*out = 0;
+
+	decodeIdat(&scanlines, w, h, state, in, insize);
 
 	if (!state->error)
 	{
@@ -4693,6 +5156,266 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
 	return state->error;
 }
 
+/*
+Unfilters the scanlines of a non interlaced image as the inflater produces them
+and writes each row, converted to info_raw, to out + stride * (y - bandstart).
+Only one or two rows of the PNG's own color type ever exist. With a callback, out
+is a band of bandrows rows that is handed over every time it fills up.
+*/
+typedef struct RowDecoder
+{
+	const LodePNGState* state;
+	unsigned w, h;
+	size_t bytewidth, linebytes;
+	unsigned y; /*the next row to come out of the inflater*/
+	unsigned char* rows; /*two unfiltered rows taking turns, 0 when unfiltering straight into out*/
+	unsigned char* out;
+	size_t stride;
+	LodePNGRowCallback callback;
+	void* user;
+	unsigned bandrows;
+	unsigned bandstart;
+} RowDecoder;
+
+static unsigned rowDecoderConsume(void* context, const unsigned char* data, size_t size, size_t* used)
+{
+	RowDecoder* rd = (RowDecoder*)context;
+	unsigned error = 0;
+
+	*used = 0;
+	while (!error && size - *used >= rd->linebytes + 1)
+	{
+		const unsigned char* line = &data[*used];
+		unsigned char* dest;
+
+		if (rd->y == rd->h) return 91; /*more data than the image has rows*/
+		dest = &rd->out[rd->stride * (rd->y - rd->bandstart)];
+
+		if (rd->rows)
+		{
+			unsigned char* recon = &rd->rows[rd->linebytes * (rd->y & 1)];
+			unsigned char* precon = rd->y ? &rd->rows[rd->linebytes * ((rd->y - 1) & 1)] : 0;
+			error = unfilterScanline(recon, line + 1, precon, rd->bytewidth, line[0], rd->linebytes);
+			if (!error) error = lodepng_convert(dest, recon, &rd->state->info_raw, &rd->state->info_png.color, rd->w, 1);
+		}
+		else
+		{
+			/*same color type, unfilter straight into the caller's memory*/
+			error = unfilterScanline(dest, line + 1, rd->y ? dest - rd->stride : 0, rd->bytewidth, line[0], rd->linebytes);
+		}
+
+		*used += rd->linebytes + 1;
+		++rd->y;
+
+		if (!error && rd->callback && (rd->y - rd->bandstart == rd->bandrows || rd->y == rd->h))
+		{
+			error = rd->callback(rd->user, rd->out, rd->bandstart, rd->y - rd->bandstart, rd->stride);
+			rd->bandstart = rd->y;
+		}
+	}
+	return error;
+}
+
+/*inflate and unfilter a non interlaced image from its IDAT data, see RowDecoder*/
+static unsigned decodeRowsStreamed(unsigned char* out, size_t stride,
+	LodePNGRowCallback callback, void* user, unsigned bandrows,
+	unsigned w, unsigned h, const ucvector* idat, const LodePNGState* state)
+{
+	unsigned error;
+	unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+	InflateSink sink;
+	RowDecoder rd;
+
+	if (bpp == 0) return 31; /*error: invalid colortype*/
+
+	rd.state = state;
+	rd.w = w;
+	rd.h = h;
+	rd.bytewidth = (bpp + 7) / 8;
+	rd.linebytes = ((size_t)w * bpp + 7) / 8;
+	rd.y = 0;
+	rd.rows = 0;
+	rd.out = out;
+	rd.stride = stride;
+	rd.callback = callback;
+	rd.user = user;
+	rd.bandrows = bandrows;
+	rd.bandstart = 0;
+
+	/*a band is overwritten after the callback, so the previous row has to be kept aside*/
+	if (callback || !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
+	{
+		rd.rows = (unsigned char*)lodepng_malloc(rd.linebytes * 2);
+		if (!rd.rows) return 83; /*alloc fail*/
+	}
+
+	sink.consume = rowDecoderConsume;
+	sink.context = &rd;
+	sink.flushsize = rd.linebytes + 1 > 65536 ? rd.linebytes + 1 : 65536;
+
+	error = zlib_decompress_stream(idat->data, idat->size, &state->decoder.zlibsettings, &sink);
+	if (!error && (rd.y != h || sink.start != sink.end)) error = 91; /*decompressed size doesn't match prediction*/
+
+	lodepng_free(rd.rows);
+	return error;
+}
+
+/*the conversions lodepng_decode supports*/
+static unsigned checkRawConversion(const LodePNGState* state)
+{
+	if (!lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)
+		&& !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+		&& !(state->info_raw.bitdepth == 8))
+	{
+		return 56; /*unsupported color mode conversion*/
+	}
+	return 0;
+}
+
+/*copy a whole image in the info_raw color type to rows of stride bytes*/
+static void copyRows(unsigned char* out, size_t stride, const unsigned char* image,
+	unsigned w, unsigned h, unsigned bpp)
+{
+	size_t rowbytes = ((size_t)w * bpp + 7) / 8;
+	unsigned y;
+	for (y = 0; y < h; ++y)
+	{
+		if (bpp >= 8) memcpy(&out[stride * y], &image[rowbytes * y], rowbytes);
+		else
+		{
+			/*rows of less than 8 bits per pixel are packed without padding, move them bit by bit*/
+			size_t x, ibp = (size_t)y * w * bpp, obp = stride * y * 8;
+			for (x = 0; x != (size_t)w * bpp; ++x)
+			{
+				setBitOfReversedStream(&obp, out, readBitFromReversedStream(&ibp, image));
+			}
+		}
+	}
+}
+
+/*Adam7 needs the whole image before any row is complete: deinterlace and convert all of it*/
+static unsigned decodeInterlaced(unsigned char** out, const ucvector* idat, unsigned w, unsigned h,
+	LodePNGState* state)
+{
+	ucvector scanlines;
+	size_t i, size = lodepng_get_raw_size(w, h, &state->info_png.color);
+	unsigned char* image = 0;
+
+	*out = 0;
+	ucvector_init(&scanlines);
+	inflateIdat(&scanlines, idat, w, h, state);
+
+	if (!state->error)
+	{
+		image = (unsigned char*)lodepng_malloc(size);
+		if (!image) state->error = 83; /*alloc fail*/
+	}
+	if (!state->error)
+	{
+		for (i = 0; i != size; ++i) image[i] = 0;
+		state->error = postProcessScanlines(image, scanlines.data, w, h, &state->info_png);
+	}
+	ucvector_cleanup(&scanlines);
+
+	if (!state->error && !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color))
+	{
+		*out = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(w, h, &state->info_raw));
+		if (!*out) state->error = 83; /*alloc fail*/
+		else state->error = lodepng_convert(*out, image, &state->info_raw, &state->info_png.color, w, h);
+		lodepng_free(image);
+	}
+	else *out = image;
+
+	return state->error;
+}
+
+unsigned lodepng_decode_into(unsigned char* out, size_t stride, size_t outsize, unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize)
+{
+	ucvector idat;
+	unsigned rawbpp = lodepng_get_bpp(&state->info_raw);
+
+	ucvector_init(&idat);
+	readChunks(&idat, w, h, state, in, insize);
+	if (!state->error) state->error = checkRawConversion(state);
+
+	if (!state->error && *h)
+	{
+		size_t rowbytes = ((size_t)*w * rawbpp + 7) / 8;
+		if (stride < rowbytes || stride * (*h - 1) + rowbytes > outsize)
+		{
+			state->error = 95; /*the caller's buffer can't hold the image*/
+		}
+	}
+
+	if (!state->error && state->info_png.interlace_method == 0)
+	{
+		state->error = decodeRowsStreamed(out, stride, 0, 0, 0, *w, *h, &idat, state);
+	}
+	else if (!state->error)
+	{
+		unsigned char* image;
+		if (!decodeInterlaced(&image, &idat, *w, *h, state)) copyRows(out, stride, image, *w, *h, rawbpp);
+		lodepng_free(image);
+	}
+
+	ucvector_cleanup(&idat);
+	return state->error;
+}
+
+unsigned lodepng_decode_rows(LodePNGRowCallback callback, void* user, unsigned bandrows,
+	unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize)
+{
+	ucvector idat;
+	unsigned rawbpp = lodepng_get_bpp(&state->info_raw);
+	size_t rowbytes = 0;
+
+	if (bandrows == 0) bandrows = 1;
+
+	ucvector_init(&idat);
+	readChunks(&idat, w, h, state, in, insize);
+	if (!state->error) state->error = checkRawConversion(state);
+	if (!state->error)
+	{
+		rowbytes = ((size_t)*w * rawbpp + 7) / 8;
+		if (bandrows > *h) bandrows = *h;
+	}
+
+	if (!state->error && state->info_png.interlace_method == 0)
+	{
+		unsigned char* band = (unsigned char*)lodepng_malloc(rowbytes * bandrows);
+		if (!band) state->error = 83; /*alloc fail*/
+		else state->error = decodeRowsStreamed(band, rowbytes, callback, user, bandrows, *w, *h, &idat, state);
+		lodepng_free(band);
+	}
+	else if (!state->error)
+	{
+		/*all rows exist at once anyway, hand them over in bands of the padded image*/
+		unsigned char* image;
+		unsigned char* padded = 0;
+		unsigned y;
+		if (!decodeInterlaced(&image, &idat, *w, *h, state))
+		{
+			padded = (unsigned char*)lodepng_malloc(rowbytes * *h);
+			if (!padded) state->error = 83; /*alloc fail*/
+			else copyRows(padded, rowbytes, image, *w, *h, rawbpp);
+		}
+		for (y = 0; y < *h && !state->error; y += bandrows)
+		{
+			unsigned numrows = *h - y < bandrows ? *h - y : bandrows;
+			state->error = callback(user, &padded[rowbytes * y], y, numrows, rowbytes);
+		}
+		lodepng_free(padded);
+		lodepng_free(image);
+	}
+
+	ucvector_cleanup(&idat);
+	return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
 	size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -5926,6 +6649,7 @@ const char* lodepng_error_text(unsigned code)
 	case 92: return "too many pixels, not supported";
 	case 93: return "zero width or height is invalid";
 	case 94: return "header chunk must have a size of 13 bytes";
+	case 95: return "output buffer is too small for the image with the given stride";
 	}
 	return "unknown error code";
 }
@@ -6087,6 +6811,21 @@ namespace lodepng
 		return decode(out, w, h, state, in.empty() ? 0 : &in[0], in.size());
 	}
 
+	unsigned decode_into(unsigned char* out, size_t stride, size_t outsize, unsigned& w, unsigned& h,
+		State& state,
+		const unsigned char* in, size_t insize)
+	{
+		return lodepng_decode_into(out, stride, outsize, &w, &h, &state, in, insize);
+	}
+
+	unsigned decode_rows(LodePNGRowCallback callback, void* user, unsigned bandrows,
+		unsigned& w, unsigned& h,
+		State& state,
+		const unsigned char* in, size_t insize)
+	{
+		return lodepng_decode_rows(callback, user, bandrows, &w, &h, &state, in, insize);
+	}
+
 #ifdef LODEPNG_COMPILE_DISK
 	unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const std::string& filename,
 		LodePNGColorType colortype, unsigned bitdepth)
@@ -303,6 +303,11 @@ struct LodePNGCompressSettings /*deflate = compress*/
 		const LodePNGCompressSettings*);
 
 	const void* custom_context; /*optional custom settings for custom functions*/
+
+	/*compress independent deflate blocks in parallel (OpenMP) on this many threads.
+	Each block still sees the window before it, the stream gets 5 bytes bigger per
+	block. Only used with btype 2. Default: 1 (single threaded)*/
+	unsigned numthreads;
 };
 
 extern const LodePNGCompressSettings lodepng_default_compress_settings;
@@ -651,6 +656,40 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
 	LodePNGState* state,
 	const unsigned char* in, size_t insize);
 
+/*
+Same as lodepng_decode, but the image is written into memory the caller owns, such
+as a mapped pixel buffer, instead of a buffer allocated here. Row y starts at
+out + y * stride. The image is always converted to state->info_raw, call
+lodepng_inspect first to get the size to reserve: outsize must be at least
+stride * (h - 1) + the size of one row. Non interlaced images are inflated and
+unfiltered row by row straight into out (like lodepng_decode_rows), so neither
+the inflated data nor an intermediate image is ever held whole.
+*/
+unsigned lodepng_decode_into(unsigned char* out, size_t stride, size_t outsize, unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize);
+
+/*
+Receives consecutive bands of rows from lodepng_decode_rows: numrows rows in the
+color type of info_raw, starting at image row y. Row i of the band is at
+rows + i * stride, the memory is reused for the next band after this returns.
+A nonzero return value stops decoding and becomes the error code.
+*/
+typedef unsigned(*LodePNGRowCallback)(void* user, const unsigned char* rows, unsigned y, unsigned numrows, size_t stride);
+
+/*
+Incremental decoding for images too big to hold whole. The IDAT data is inflated
+and unfiltered a band of bandrows rows at a time, and each band goes to callback.
+Besides the compressed data, a non interlaced image needs about 32K of inflate
+window, two rows and the band. Adam7 images can only be handed over once they are
+fully decoded, so for those the whole image is in memory anyway.
+Always uses the built in zlib: custom_zlib and custom_inflate are ignored.
+*/
+unsigned lodepng_decode_rows(LodePNGRowCallback callback, void* user, unsigned bandrows,
+	unsigned* w, unsigned* h,
+	LodePNGState* state,
+	const unsigned char* in, size_t insize);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the header chunk of the PNG, such as width, height and color type. The
@@ -834,6 +873,15 @@ namespace lodepng
 	unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 		State& state,
 		const std::vector<unsigned char>& in);
+	/* Same as lodepng_decode_into, writes rows of stride bytes into the caller's memory. */
+	unsigned decode_into(unsigned char* out, size_t stride, size_t outsize, unsigned& w, unsigned& h,
+		State& state,
+		const unsigned char* in, size_t insize);
+	/* Same as lodepng_decode_rows, hands the image to callback a band of rows at a time. */
+	unsigned decode_rows(LodePNGRowCallback callback, void* user, unsigned bandrows,
+		unsigned& w, unsigned& h,
+		State& state,
+		const unsigned char* in, size_t insize);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -1,10 +1,15 @@
 #version 410 core
 
 uniform sampler2D tex;
+//Texels at or below this alpha are dropped, 0.5 for cutout sprites
+uniform float alpha_cutoff;
 
 in vec2 tc;
+in vec4 color_tint;
 out vec4 color;
 
 void main(void) {
-	color = texture(tex, tc);
-}
\ No newline at end of file
+	color = texture(tex, tc) * color_tint;
+	if (color.a <= alpha_cutoff)
+		discard;
+}
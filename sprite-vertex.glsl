@@ -1,8 +1,9 @@
 #version 410 core
 
-uniform vec3 pos;
-uniform float scalar;
-uniform float reflecting;
+//One instance per sprite, see sprite_batch.h
+layout(location = 0) in vec4 pos_scale;
+layout(location = 1) in vec4 rect;
+layout(location = 2) in vec4 tint;
 
 layout(std140) uniform constants
 {
@@ -12,6 +13,7 @@ layout(std140) uniform constants
 };
 
 out vec2 tc;
+out vec4 color_tint;
 
 void main(void) {
 	vec2[6] quad = vec2[6](vec2(-1.0, -1.0),
@@ -33,14 +35,16 @@ void main(void) {
 						);
 
 	
-	vec4 P = mv_matrix * vec4(pos, 1.0);
-	P.xy = P.xy + (quad[gl_VertexID] * scalar);
-	tc = tcquad[gl_VertexID].xy;
+	vec4 P = mv_matrix * vec4(pos_scale.xyz, 1.0);
+	P.xy = P.xy + (quad[gl_VertexID] * pos_scale.w);
+	vec2 local = tcquad[gl_VertexID].xy;
 
-	if (reflecting < 0) {
-		tc.y = -tc.y;
-	}
+#ifdef REFLECTED
+	local.y = 1.0 - local.y;
+#endif
+
+	tc = mix(rect.xy, rect.zw, local);
+	color_tint = tint;
 
 	gl_Position = proj_matrix * P;
 }
-
@@ -0,0 +1,264 @@
+#include "agent_system.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vmath.h>
+
+#include "cpu_profiler.h"
+#include "thread_pool.h"
+
+static const int sort_interval = 16;
+//Chunks per thread, so a thread that finishes early can pick up another
+static const unsigned chunks_per_thread = 4;
+
+agent_system::agent_system()
+	: tile_cells(8),
+	  tiles_x(0),
+	  tiles_z(0),
+	  chunk_threads(0),
+	  since_sort(0)
+{
+	memset(&level, 0, sizeof(level));
+}
+
+void agent_system::init(const grid_collision::grid & grid, int cells_per_tile)
+{
+	level = grid;
+	tile_cells = cells_per_tile > 0 ? cells_per_tile : 1;
+	tiles_x = (level.width + tile_cells - 1) / tile_cells;
+	tiles_z = (level.height + tile_cells - 1) / tile_cells;
+	find_open_cells();
+	clear();
+}
+
+//Walls grown by one cell in every direction, 16 cells at a time
+void agent_system::find_open_cells()
+{
+	int w = level.width, h = level.height;
+	//A ring of wall around the level, and room for a full vector past the last cell
+	int stride = ((w + 2 + 15) & ~15) + 16;
+	std::vector<unsigned char> walls(stride * (h + 2), 1), across(stride * (h + 2), 1);
+	for (int r = 0; r < h; r++) {
+		for (int c = 0; c < w; c++)
+			walls[(r + 1) * stride + c + 1] = level.cells[r][c] == 1 ? 1 : 0;
+	}
+
+	//Along rows: wall on the left, here or on the right
+	for (int r = 0; r < h + 2; r++) {
+		const unsigned char * row = &walls[r * stride];
+		unsigned char * out = &across[r * stride];
+		int c = 1;
+#ifdef VMATH_SSE
+		for (; c + 16 <= stride - 1; c += 16) {
+			__m128i left = _mm_loadu_si128((const __m128i *)(row + c - 1));
+			__m128i here = _mm_loadu_si128((const __m128i *)(row + c));
+			__m128i right = _mm_loadu_si128((const __m128i *)(row + c + 1));
+			_mm_storeu_si128((__m128i *)(out + c), _mm_or_si128(_mm_or_si128(left, here), right));
+		}
+#endif
+		for (; c < stride - 1; c++)
+			out[c] = row[c - 1] | row[c] | row[c + 1];
+	}
+
+	//Then down columns, and open is the opposite
+	open_block.assign(w * h, 0);
+	for (int r = 0; r < h; r++) {
+		const unsigned char * above = &across[r * stride + 1];
+		const unsigned char * here = &across[(r + 1) * stride + 1];
+		const unsigned char * below = &across[(r + 2) * stride + 1];
+		unsigned char * out = &open_block[r * w];
+		int c = 0;
+#ifdef VMATH_SSE
+		const __m128i one = _mm_set1_epi8(1);
+		for (; c + 16 <= w; c += 16) {
+			__m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i *)(above + c)),
+				_mm_loadu_si128((const __m128i *)(here + c))), _mm_loadu_si128((const __m128i *)(below + c)));
+			_mm_storeu_si128((__m128i *)(out + c), _mm_xor_si128(any, one));
+		}
+#endif
+		for (; c < w; c++)
+			out[c] = (above[c] | here[c] | below[c]) ^ 1;
+	}
+}
+
+void agent_system::clear()
+{
+	pos_x.clear();
+	pos_z.clear();
+	vel_x.clear();
+	vel_z.clear();
+	radii.clear();
+	chunk_start.clear();
+	chunk_threads = 0;
+	since_sort = 0;
+}
+
+void agent_system::spawn(size_t count, float speed, float radius, unsigned seed)
+{
+	if (level.cells == NULL)
+		return;
+
+	std::vector<int> floor_cells;
+	for (int r = 0; r < level.height; r++) {
+		for (int c = 0; c < level.width; c++) {
+			if (!grid_collision::is_wall(level, r, c))
+				floor_cells.push_back(r * level.width + c);
+		}
+	}
+	if (floor_cells.empty())
+		return;
+
+	for (size_t i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		int cell = floor_cells[(seed >> 8) % floor_cells.size()];
+		seed = seed * 1103515245 + 12345;
+		float angle = (float)((seed >> 8) & 0xffff) / 65536.0f * 6.2831853f;
+		//Anywhere in the cell the circle fits
+		seed = seed * 1103515245 + 12345;
+		float u = (float)((seed >> 8) & 0xffff) / 65536.0f;
+		seed = seed * 1103515245 + 12345;
+		float v = (float)((seed >> 8) & 0xffff) / 65536.0f;
+		float room = level.cell_size - 2.0f * radius;
+
+		pos_x.push_back(level.origin_x + (cell % level.width) * level.cell_size + radius + u * room);
+		pos_z.push_back(level.origin_z + (cell / level.width) * level.cell_size + radius + v * room);
+		vel_x.push_back(cosf(angle) * speed);
+		vel_z.push_back(sinf(angle) * speed);
+		radii.push_back(radius);
+	}
+	since_sort = sort_interval;
+}
+
+//Counting sort of every array by tile
+void agent_system::sort_by_tile()
+{
+	size_t n = size();
+	int tiles = tiles_x * tiles_z;
+	tile_of.resize(n);
+	tile_start.assign(tiles + 1, 0);
+
+	float tile_size = level.cell_size * tile_cells;
+	for (size_t i = 0; i < n; i++) {
+		int tx = (int)floorf((pos_x[i] - level.origin_x) / tile_size);
+		int tz = (int)floorf((pos_z[i] - level.origin_z) / tile_size);
+		tx = tx < 0 ? 0 : (tx >= tiles_x ? tiles_x - 1 : tx);
+		tz = tz < 0 ? 0 : (tz >= tiles_z ? tiles_z - 1 : tz);
+		tile_of[i] = tz * tiles_x + tx;
+		tile_start[tile_of[i] + 1]++;
+	}
+	for (int t = 0; t < tiles; t++)
+		tile_start[t + 1] += tile_start[t];
+
+	//Each array goes through the same permutation
+	std::vector<float> * arrays[5] = { &pos_x, &pos_z, &vel_x, &vel_z, &radii };
+	tile_cursor.resize(tiles);
+	sorted.resize(n);
+	for (int a = 0; a < 5; a++) {
+		std::vector<float> & values = *arrays[a];
+		for (int t = 0; t < tiles; t++)
+			tile_cursor[t] = tile_start[t];
+		for (size_t i = 0; i < n; i++)
+			sorted[tile_cursor[tile_of[i]]++] = values[i];
+		values.swap(sorted);
+	}
+	since_sort = 0;
+}
+
+void agent_system::update_range(size_t begin, size_t end, float dt)
+{
+	const float inv_cell = 1.0f / level.cell_size;
+	size_t i = begin;
+
+#ifdef VMATH_SSE
+	//Four agents at a time: all of them in open cells and moving less than a
+	//cell minus their radius can't reach a wall, just move them
+	const __m128 step = _mm_set1_ps(dt);
+	const __m128 origin_x = _mm_set1_ps(level.origin_x), origin_z = _mm_set1_ps(level.origin_z);
+	const __m128 scale = _mm_set1_ps(inv_cell);
+	const __m128 cell = _mm_set1_ps(level.cell_size);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 width = _mm_set1_ps((float)level.width), height = _mm_set1_ps((float)level.height);
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(&pos_x[i]), z = _mm_loadu_ps(&pos_z[i]);
+		__m128 dx = _mm_mul_ps(_mm_loadu_ps(&vel_x[i]), step);
+		__m128 dz = _mm_mul_ps(_mm_loadu_ps(&vel_z[i]), step);
+		__m128 reach = _mm_sub_ps(cell, _mm_loadu_ps(&radii[i]));
+
+		__m128 fx = _mm_mul_ps(_mm_sub_ps(x, origin_x), scale);
+		__m128 fz = _mm_mul_ps(_mm_sub_ps(z, origin_z), scale);
+		__m128 ok = _mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmplt_ps(fx, width));
+		ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(fz, zero), _mm_cmplt_ps(fz, height)));
+		ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), _mm_mul_ps(reach, reach)));
+
+		int lanes = _mm_movemask_ps(ok);
+		if (lanes == 15) {
+			//Truncation is floor here, the lanes were checked to be inside the grid
+			int cells[4];
+			__m128i index = _mm_add_epi32(_mm_cvttps_epi32(fx),
+				_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(fz)), width)));
+			_mm_storeu_si128((__m128i *)cells, index);
+			if (open_block[cells[0]] & open_block[cells[1]] & open_block[cells[2]] & open_block[cells[3]]) {
+				_mm_storeu_ps(&pos_x[i], _mm_add_ps(x, dx));
+				_mm_storeu_ps(&pos_z[i], _mm_add_ps(z, dz));
+				continue;
+			}
+		}
+
+		//Someone is near a wall: the lanes go through the scalar path
+		for (size_t j = i; j < i + 4; j++) {
+			float nx, nz;
+			if (grid_collision::move(level, radii[j], pos_x[j], pos_z[j], vel_x[j] * dt, vel_z[j] * dt, &nx, &nz)) {
+				float into = vel_x[j] * nx + vel_z[j] * nz;
+				if (into < 0.0f) {
+					vel_x[j] -= 2.0f * into * nx;
+					vel_z[j] -= 2.0f * into * nz;
+				}
+			}
+		}
+	}
+#endif
+
+	for (; i < end; i++) {
+		float nx, nz;
+		if (grid_collision::move(level, radii[i], pos_x[i], pos_z[i], vel_x[i] * dt, vel_z[i] * dt, &nx, &nz)) {
+			//Bounce
+			float into = vel_x[i] * nx + vel_z[i] * nz;
+			if (into < 0.0f) {
+				vel_x[i] -= 2.0f * into * nx;
+				vel_z[i] -= 2.0f * into * nz;
+			}
+		}
+	}
+}
+
+void agent_system::update(float dt, thread_pool & pool, unsigned max_threads)
+{
+	PROFILE_ZONE("agents");
+	if (size() == 0)
+		return;
+
+	unsigned threads = pool.size() + 1;
+	if (max_threads > 0 && max_threads < threads)
+		threads = max_threads;
+
+	if (since_sort++ >= sort_interval || threads != chunk_threads) {
+		sort_by_tile();
+
+		//Cut the tiles into runs of about the same number of agents
+		size_t target = size() / (threads * chunks_per_thread) + 1;
+		chunk_start.clear();
+		chunk_start.push_back(0);
+		for (size_t t = 1; t < tile_start.size() - 1; t++) {
+			if (tile_start[t] - chunk_start.back() >= target)
+				chunk_start.push_back(tile_start[t]);
+		}
+		chunk_start.push_back(size());
+		chunk_threads = threads;
+	}
+
+	unsigned chunks = (unsigned)chunk_start.size() - 1;
+	pool.parallel_for(chunks, [this, dt](unsigned c) {
+		update_range(chunk_start[c], chunk_start[c + 1], dt);
+	}, threads);
+}
@@ -0,0 +1,71 @@
+#ifndef __AGENT_SYSTEM_H__
+#define __AGENT_SYSTEM_H__
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "grid_collision.h"
+
+class thread_pool;
+
+//Load-testing agents: circles that wander the level grid and bounce off its
+//walls. Positions, velocities and radii are kept in separate arrays sorted by
+//tile (a square of tile_cells x tile_cells level cells), and update() hands
+//runs of whole tiles to the thread pool, so every thread works on its own
+//part of the maze and its own part of the arrays.
+//
+//Most agents are in open floor most of the time. A table of cells with no wall
+//in their 3x3 block lets the inner loop move four agents at a time with SSE
+//and only run the swept collision for the ones that could reach a wall.
+class agent_system
+{
+public:
+	agent_system();
+
+	void init(const grid_collision::grid & level, int tile_cells = 8);
+
+	//Place count agents in random open cells with random headings. The same
+	//seed places them the same way.
+	void spawn(size_t count, float speed, float radius, unsigned seed);
+	void clear();
+
+	//Advance every agent by dt seconds on up to max_threads threads (0 for the
+	//whole pool plus the calling thread)
+	void update(float dt, thread_pool & pool, unsigned max_threads = 0);
+
+	size_t size() const { return pos_x.size(); }
+	const float * x() const { return pos_x.empty() ? NULL : &pos_x[0]; }
+	const float * z() const { return pos_z.empty() ? NULL : &pos_z[0]; }
+	const float * radius() const { return radii.empty() ? NULL : &radii[0]; }
+
+private:
+	agent_system(const agent_system &);
+	agent_system & operator=(const agent_system &);
+
+	void find_open_cells();
+	void sort_by_tile();
+	void update_range(size_t begin, size_t end, float dt);
+
+	grid_collision::grid level;
+	//1 for cells with no wall in their 3x3 block, row by row
+	std::vector<unsigned char> open_block;
+	int tile_cells;
+	int tiles_x, tiles_z;
+
+	std::vector<float> pos_x, pos_z, vel_x, vel_z, radii;
+
+	//Sorting scratch, kept so updates don't allocate
+	std::vector<unsigned> tile_of;
+	std::vector<size_t> tile_start;
+	std::vector<size_t> tile_cursor;
+	std::vector<float> sorted;
+	//Agent ranges handed to the threads, split at tile boundaries
+	std::vector<size_t> chunk_start;
+	unsigned chunk_threads;
+	//Updates since the last sort. Agents drift between tiles slowly, sorting
+	//every few updates keeps the locality without a serial pass every time.
+	int since_sort;
+};
+
+#endif /* __AGENT_SYSTEM_H__ */
@@ -0,0 +1,490 @@
+#include "benchmark.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "../lodepng.h"
+#include "agent_system.h"
+#include "cpu_profiler.h"
+#include "crowd.h"
+#include "grid_collision.h"
+#include "spatial_index.h"
+#include "thread_pool.h"
+
+benchmark::benchmark()
+	: frames(0),
+	  warmup(30),
+	  out_file("benchmark.json"),
+	  agents(100000),
+	  frame_count(0),
+	  draw_calls(0),
+	  vertices(0),
+	  pacing_mean_ms(0.0),
+	  pacing_jitter_ms(0.0),
+	  pacing_worst_ms(0.0),
+	  pacing_late(0),
+	  clamped_frames(0),
+	  dropped_s(0.0),
+	  collision_single_qps(0.0),
+	  collision_batched_qps(0.0),
+	  index_moves_per_s(0.0),
+	  index_queries_per_s(0.0),
+	  png_threads(0),
+	  png_round_trip(false)
+{
+	png_encode_mb_per_s[0] = png_encode_mb_per_s[1] = 0.0;
+	png_encoded_bytes[0] = png_encoded_bytes[1] = 0;
+
+}
+
+bool benchmark::from_environment()
+{
+	const char * value = getenv("MAZE_BENCHMARK");
+	if (value == NULL || atoi(value) <= 0)
+		return false;
+	frames = atoi(value);
+
+	if ((value = getenv("MAZE_BENCHMARK_WARMUP")) != NULL)
+		warmup = std::max(0, atoi(value));
+	if ((value = getenv("MAZE_BENCHMARK_PATH")) != NULL)
+		path_file = value;
+	if ((value = getenv("MAZE_BENCHMARK_OUT")) != NULL)
+		out_file = value;
+	if ((value = getenv("MAZE_BENCHMARK_AGENTS")) != NULL)
+		agents = std::max(0, atoi(value));
+	return true;
+}
+
+bool benchmark::load_path()
+{
+	std::ifstream file(path_file.c_str());
+	if (!file.is_open()) {
+		std::cout << "error: could not open camera path " << path_file << std::endl;
+		return false;
+	}
+
+	std::vector<vmath::vec3> waypoints;
+	float x, z;
+	while (file >> x >> z)
+		waypoints.push_back(vmath::vec3(x, 0.0f, z));
+	set_path(waypoints);
+	return has_path();
+}
+
+void benchmark::set_path(const std::vector<vmath::vec3> & waypoints)
+{
+	path = waypoints;
+	path_distance.resize(path.size());
+	float total = 0.0f;
+	for (size_t i = 0; i < path.size(); i++) {
+		if (i > 0)
+			total += vmath::distance(path[i - 1], path[i]);
+		path_distance[i] = total;
+	}
+}
+
+bool benchmark::find_path(int ** level, int width, int height,
+	int start_row, int start_col, int end_row, int end_col,
+	std::vector< std::pair<int, int> > & out_cells)
+{
+	static const int steps[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+	out_cells.clear();
+	std::vector<int> previous(width * height, -2);
+	std::deque<int> open;
+	int start = start_row * width + start_col;
+	int goal = end_row * width + end_col;
+	previous[start] = -1;
+	open.push_back(start);
+
+	//Breadth first over the floor cells (anything that isn't a wall)
+	while (!open.empty() && previous[goal] == -2) {
+		int cell = open.front();
+		open.pop_front();
+		int row = cell / width, col = cell % width;
+		for (int i = 0; i < 4; i++) {
+			int r = row + steps[i][0], c = col + steps[i][1];
+			if (r < 0 || r >= height || c < 0 || c >= width || level[r][c] == 1)
+				continue;
+			int next = r * width + c;
+			if (previous[next] != -2)
+				continue;
+			previous[next] = cell;
+			open.push_back(next);
+		}
+	}
+	if (previous[goal] == -2)
+		return false;
+
+	for (int cell = goal; cell != -1; cell = previous[cell])
+		out_cells.push_back(std::make_pair(cell / width, cell % width));
+	std::reverse(out_cells.begin(), out_cells.end());
+	return true;
+}
+
+//Position at distance d along the path
+static vmath::vec3 point_at(const std::vector<vmath::vec3> & path, const std::vector<float> & dist, float d)
+{
+	size_t i = std::upper_bound(dist.begin(), dist.end(), d) - dist.begin();
+	if (i == 0)
+		return path.front();
+	if (i >= path.size())
+		return path.back();
+	float seg = dist[i] - dist[i - 1];
+	float a = seg > 0.0f ? (d - dist[i - 1]) / seg : 0.0f;
+	return path[i - 1] + (path[i] - path[i - 1]) * a;
+}
+
+void benchmark::camera(int frame, vmath::vec3 & out_position, vmath::vec3 & out_direction) const
+{
+	//Ping-pong so warmup plus measured frames never run off the end
+	int span = std::max(1, warmup + frames - 1);
+	float t = (float)(frame % (2 * span)) / span;
+	if (t > 1.0f)
+		t = 2.0f - t;
+	float total = path_distance.back();
+
+	//Look a little ahead so corners are turned smoothly
+	const float look_ahead = 1.5f;
+	float d = t * total;
+	out_position = point_at(path, path_distance, d);
+	vmath::vec3 ahead = point_at(path, path_distance, std::min(d + look_ahead, total));
+	vmath::vec3 behind = point_at(path, path_distance, std::max(d - look_ahead, 0.0f));
+	vmath::vec3 dir = ahead - behind;
+	if (vmath::length(dir) < 1e-4f)
+		dir = path.back() - path.front();
+	out_direction = vmath::normalize(dir);
+}
+
+void benchmark::add_frame(double frame_ms, double cpu_ms, int frame_draw_calls, int frame_vertices)
+{
+	if (frame_count++ < warmup)
+		return;
+	frame_times.push_back(frame_ms);
+	cpu_times.push_back(cpu_ms);
+	draw_calls += frame_draw_calls;
+	vertices += frame_vertices;
+}
+
+void benchmark::add_gpu(double gpu_ms)
+{
+	if (frame_count > warmup)
+		gpu_times.push_back(gpu_ms);
+}
+
+void benchmark::add_pass(const char * name, double mean_ms)
+{
+	passes.push_back(std::make_pair(std::string(name), mean_ms));
+}
+
+void benchmark::set_pacing(double mean_ms, double jitter_ms, double worst_ms, int late, int clamped, double dropped)
+{
+	pacing_mean_ms = mean_ms;
+	pacing_jitter_ms = jitter_ms;
+	pacing_worst_ms = worst_ms;
+	pacing_late = late;
+	clamped_frames = clamped;
+	dropped_s = dropped;
+}
+
+void benchmark::measure_kernels()
+{
+	vmath_bench::run(kernels);
+}
+
+void benchmark::measure_collision(int ** level, int width, int height)
+{
+	const size_t agents = 4096;
+	const int steps = 64;
+	grid_collision::grid g = grid_collision::level_grid(level, width, height);
+
+	//Agents start in the middle of random open cells and wander with steps of
+	//up to a cell, so plenty of them run into walls
+	std::vector<float> start_x, start_z, dx(agents * steps), dz(agents * steps);
+	unsigned seed = 12345;
+	while (start_x.size() < agents) {
+		seed = seed * 1103515245 + 12345;
+		int row = (seed >> 8) % height;
+		seed = seed * 1103515245 + 12345;
+		int col = (seed >> 8) % width;
+		if (grid_collision::is_wall(g, row, col))
+			continue;
+		start_x.push_back(g.origin_x + (col + 0.5f) * g.cell_size);
+		start_z.push_back(g.origin_z + (row + 0.5f) * g.cell_size);
+	}
+	for (size_t i = 0; i < dx.size(); i++) {
+		dx[i] = vmath::random<float>() * 4.0f - 2.0f;
+		dz[i] = vmath::random<float>() * 4.0f - 2.0f;
+	}
+	const float radius = 0.3f;
+
+	//One agent taking every step in turn
+	float x = start_x[0], z = start_z[0];
+	unsigned long long start = cpu_profiler::now_ns();
+	for (size_t i = 0; i < dx.size(); i++)
+		grid_collision::move(g, radius, x, z, dx[i], dz[i]);
+	unsigned long long single_ns = cpu_profiler::now_ns() - start;
+
+	//All agents stepping together
+	std::vector<float> xs(start_x), zs(start_z);
+	start = cpu_profiler::now_ns();
+	for (int s = 0; s < steps; s++)
+		grid_collision::move_all(g, radius, &xs[0], &zs[0], &dx[s * agents], &dz[s * agents], agents);
+	unsigned long long batched_ns = cpu_profiler::now_ns() - start;
+
+	collision_single_qps = dx.size() * 1e9 / std::max(single_ns, 1ull);
+	collision_batched_qps = dx.size() * 1e9 / std::max(batched_ns, 1ull);
+}
+
+void benchmark::measure_spatial_index(int ** level, int width, int height)
+{
+	const size_t objects = 4096;
+	const int rounds = 64;
+	grid_collision::grid g = grid_collision::level_grid(level, width, height);
+	float size_x = width * g.cell_size, size_z = height * g.cell_size;
+
+	spatial_index index;
+	index.init(g, objects);
+	std::vector<spatial_index::handle> handles;
+	std::vector<float> xs(objects), zs(objects);
+	for (size_t i = 0; i < objects; i++) {
+		xs[i] = g.origin_x + vmath::random<float>() * size_x;
+		zs[i] = g.origin_z + vmath::random<float>() * size_z;
+		handles.push_back(index.insert(xs[i], zs[i], (unsigned)i));
+	}
+
+	//Small steps, most of them stay in their cell
+	unsigned long long start = cpu_profiler::now_ns();
+	for (int r = 0; r < rounds; r++) {
+		float step = (r & 1) ? -0.25f : 0.25f;
+		for (size_t i = 0; i < objects; i++)
+			index.move(handles[i], xs[i] + step, zs[i] + step);
+	}
+	unsigned long long move_ns = cpu_profiler::now_ns() - start;
+
+	//What is within a cell of each object
+	size_t found = 0;
+	start = cpu_profiler::now_ns();
+	for (int r = 0; r < rounds / 8; r++) {
+		for (size_t i = 0; i < objects; i++)
+			index.for_each_near(xs[i], zs[i], g.cell_size, [&found](spatial_index::handle) { found++; });
+	}
+	unsigned long long query_ns = cpu_profiler::now_ns() - start;
+
+	index_moves_per_s = objects * rounds * 1e9 / std::max(move_ns, 1ull);
+	index_queries_per_s = objects * (rounds / 8) * 1e9 / std::max(query_ns, 1ull);
+}
+
+void benchmark::measure_agents(int ** level, int width, int height, thread_pool & pool)
+{
+	const int updates = 30;
+	const float dt = 0.01f;
+
+	agent_rates.clear();
+	if (agents <= 0)
+		return;
+
+	agent_system system;
+	system.init(grid_collision::level_grid(level, width, height));
+	system.spawn(agents, 3.0f, 0.25f, 12345);
+
+	for (unsigned threads = 1; threads <= pool.size() + 1; threads++) {
+		//One untimed update sorts the agents for this thread count
+		system.update(dt, pool, threads);
+		unsigned long long start = cpu_profiler::now_ns();
+		for (int i = 0; i < updates; i++)
+			system.update(dt, pool, threads);
+		unsigned long long elapsed = std::max(cpu_profiler::now_ns() - start, 1ull);
+		agent_rates.push_back(std::make_pair(threads, (double)agents * updates * 1e9 / elapsed));
+	}
+}
+
+void benchmark::measure_crowd(int ** level, int width, int height, int goal_row, int goal_col, thread_pool & pool)
+{
+	const int steps = 30;
+	const float dt = 0.01f;
+
+	crowd_rates.clear();
+	if (agents <= 0)
+		return;
+
+	crowd walkers;
+	walkers.init(grid_collision::level_grid(level, width, height), goal_row, goal_col, agents, 0.25f, 12345);
+
+	for (unsigned threads = 1; threads <= pool.size() + 1; threads++) {
+		walkers.step(dt, pool, threads);
+		unsigned long long start = cpu_profiler::now_ns();
+		for (int i = 0; i < steps; i++)
+			walkers.step(dt, pool, threads);
+		unsigned long long elapsed = std::max(cpu_profiler::now_ns() - start, 1ull);
+		crowd_rates.push_back(std::make_pair(threads, (double)walkers.size() * steps * 1e9 / elapsed));
+	}
+}
+
+//Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> & sorted, double p)
+{
+	size_t i = (size_t)ceil(p * sorted.size());
+	return sorted[std::min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+void benchmark::measure_png_encode(const char * source)
+{
+	std::vector<unsigned char> tile;
+	unsigned tile_w, tile_h;
+	unsigned err = lodepng::decode(tile, tile_w, tile_h, source);
+	if (err != 0) {
+		std::cout << "error " << err << ": " << lodepng_error_text(err) << " in " << source << std::endl;
+		return;
+	}
+
+	//About what a frame capture encodes
+	const unsigned w = 1920, h = 1080;
+	std::vector<unsigned char> image((size_t)w * h * 4);
+	for (unsigned y = 0; y < h; y++) {
+		for (unsigned x = 0; x < w; x++)
+			memcpy(&image[((size_t)y * w + x) * 4], &tile[((size_t)(y % tile_h) * tile_w + x % tile_w) * 4], 4);
+	}
+
+	png_threads = std::max(2u, std::thread::hardware_concurrency());
+	png_round_trip = true;
+	for (int i = 0; i < 2; i++) {
+		lodepng::State state;
+		state.encoder.zlibsettings.numthreads = (i == 0) ? 1 : png_threads;
+		std::vector<unsigned char> png;
+		unsigned long long start = cpu_profiler::now_ns();
+		err = lodepng::encode(png, image, w, h, state);
+		unsigned long long ns = cpu_profiler::now_ns() - start;
+
+		std::vector<unsigned char> decoded;
+		unsigned dw = 0, dh = 0;
+		if (err != 0 || lodepng::decode(decoded, dw, dh, png) != 0 || dw != w || dh != h || decoded != image)
+			png_round_trip = false;
+		png_encode_mb_per_s[i] = image.size() * 1000.0 / std::max(ns, 1ull);
+		png_encoded_bytes[i] = png.size();
+	}
+	if (!png_round_trip)
+		std::cout << "error: PNG encode didn't decode back to the same image" << std::endl;
+}
+
+void benchmark::measure_png_decode(const std::vector<std::string> & sources)
+{
+	const int repeats = 20;
+	size_t total_bytes = 0;
+	double total_ns = 0.0;
+	for (size_t i = 0; i < sources.size(); i++) {
+		std::vector<unsigned char> png;
+		unsigned err = lodepng::load_file(png, sources[i]);
+		unsigned long long best = ~0ull;
+		std::vector<unsigned char> image;
+		for (int r = 0; r < repeats && err == 0; r++) {
+			unsigned w, h;
+			unsigned long long start = cpu_profiler::now_ns();
+			err = lodepng::decode(image, w, h, png);
+			best = std::min(best, cpu_profiler::now_ns() - start);
+		}
+		if (err != 0) {
+			std::cout << "error " << err << ": " << lodepng_error_text(err) << " in " << sources[i] << std::endl;
+			continue;
+		}
+
+		size_t slash = sources[i].find_last_of("\\/");
+		std::string name = (slash == std::string::npos) ? sources[i] : sources[i].substr(slash + 1);
+		png_decode_rates.push_back(std::make_pair(name, image.size() * 1000.0 / std::max(best, 1ull)));
+		total_bytes += image.size();
+		total_ns += best;
+	}
+	if (total_ns > 0.0)
+		png_decode_rates.push_back(std::make_pair(std::string("all"), total_bytes * 1000.0 / total_ns));
+}
+
+static void write_stats(FILE * file, const char * name, std::vector<double> values, bool last = false)
+{
+	fprintf(file, "\t\"%s\": {", name);
+	if (!values.empty()) {
+		std::sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (size_t i = 0; i < values.size(); i++)
+			sum += values[i];
+
+		fprintf(file, "\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f",
+			sum / values.size(), percentile(values, 0.50), percentile(values, 0.95), percentile(values, 0.99),
+			values.front(), values.back());
+	}
+	fprintf(file, "}%s\n", last ? "" : ",");
+}
+
+bool benchmark::write_report(const char * renderer, int width, int height) const
+{
+	FILE * file = fopen(out_file.c_str(), "w");
+	if (file == NULL) {
+		std::cout << "error: could not write " << out_file << std::endl;
+		return false;
+	}
+
+	size_t measured = frame_times.size();
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"renderer\": \"");
+	for (const char * c = renderer != NULL ? renderer : ""; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fputc('\\', file);
+		fputc(*c, file);
+	}
+	fprintf(file, "\",\n");
+	fprintf(file, "\t\"width\": %d,\n\t\"height\": %d,\n", width, height);
+	fprintf(file, "\t\"frames\": %d,\n\t\"warmup\": %d,\n", (int)measured, warmup);
+	fprintf(file, "\t\"path\": \"%s\",\n", path_file.empty() ? "generated" : "file");
+	write_stats(file, "frame_ms", frame_times);
+	write_stats(file, "cpu_ms", cpu_times);
+	write_stats(file, "gpu_ms", gpu_times);
+	fprintf(file, "\t\"pacing\": {\"mean_ms\": %.4f, \"jitter_ms\": %.4f, \"worst_ms\": %.4f, \"late\": %d, "
+		"\"sim_clamped_frames\": %d, \"sim_dropped_s\": %.4f},\n",
+		pacing_mean_ms, pacing_jitter_ms, pacing_worst_ms, pacing_late, clamped_frames, dropped_s);
+
+	fprintf(file, "\t\"gpu_passes_ms\": {");
+	for (size_t i = 0; i < passes.size(); i++)
+		fprintf(file, "%s\"%s\": %.4f", i > 0 ? ", " : "", passes[i].first.c_str(), passes[i].second);
+	fprintf(file, "},\n");
+
+	fprintf(file, "\t\"vmath_kernels_ns\": {");
+	for (size_t i = 0; i < kernels.size(); i++) {
+		fprintf(file, "%s\n\t\t\"%s\": {\"simd\": %.3f, \"scalar\": %.3f, \"exact\": %s}", i > 0 ? "," : "",
+			kernels[i].name.c_str(), kernels[i].simd_ns, kernels[i].scalar_ns, kernels[i].exact ? "true" : "false");
+	}
+	fprintf(file, "%s},\n", kernels.empty() ? "" : "\n\t");
+	fprintf(file, "\t\"collision_queries_per_s\": {\"single\": %.0f, \"batched\": %.0f},\n",
+		collision_single_qps, collision_batched_qps);
+	fprintf(file, "\t\"spatial_index_ops_per_s\": {\"move\": %.0f, \"near\": %.0f},\n",
+		index_moves_per_s, index_queries_per_s);
+	fprintf(file, "\t\"agents\": %d,\n\t\"agent_updates_per_s\": {", agents);
+	for (size_t i = 0; i < agent_rates.size(); i++)
+		fprintf(file, "%s\"%u\": %.0f", i > 0 ? ", " : "", agent_rates[i].first, agent_rates[i].second);
+	fprintf(file, "},\n");
+	fprintf(file, "\t\"crowd_steps_per_s\": {");
+	for (size_t i = 0; i < crowd_rates.size(); i++)
+		fprintf(file, "%s\"%u\": %.0f", i > 0 ? ", " : "", crowd_rates[i].first, crowd_rates[i].second);
+	fprintf(file, "},\n");
+	fprintf(file, "\t\"png_encode\": {\"threads\": %u, \"single_mb_per_s\": %.1f, \"parallel_mb_per_s\": %.1f, "
+		"\"single_bytes\": %u, \"parallel_bytes\": %u, \"round_trip\": %s},\n",
+		png_threads, png_encode_mb_per_s[0], png_encode_mb_per_s[1],
+		(unsigned)png_encoded_bytes[0], (unsigned)png_encoded_bytes[1], png_round_trip ? "true" : "false");
+	fprintf(file, "\t\"png_decode_mb_per_s\": {");
+	for (size_t i = 0; i < png_decode_rates.size(); i++)
+		fprintf(file, "%s\"%s\": %.1f", i > 0 ? ", " : "", png_decode_rates[i].first.c_str(), png_decode_rates[i].second);
+	fprintf(file, "},\n");
+
+	fprintf(file, "\t\"draw_calls_per_frame\": %.2f,\n", measured > 0 ? (double)draw_calls / measured : 0.0);
+	fprintf(file, "\t\"vertices_per_frame\": %.1f\n", measured > 0 ? (double)vertices / measured : 0.0);
+	fprintf(file, "}\n");
+	fclose(file);
+
+	std::cout << "benchmark report written to " << out_file << std::endl;
+	return true;
+}
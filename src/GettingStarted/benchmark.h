@@ -0,0 +1,118 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <vmath.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vmath_bench.h"
+
+class thread_pool;
+
+//Headless benchmark run: the camera follows a fixed path for a set number of
+//frames and frame, CPU and GPU times are written out as JSON. Settings come
+//from the environment since DECLARE_MAIN doesn't pass argv through:
+//  MAZE_BENCHMARK         frames to measure, the mode is off when unset
+//  MAZE_BENCHMARK_WARMUP  frames rendered before measuring (default 30)
+//  MAZE_BENCHMARK_PATH    text file of "x z" waypoints, else a path is
+//                         generated from the start to the trophy
+//  MAZE_BENCHMARK_OUT     report file (default benchmark.json)
+//  MAZE_REPLAY            input recording (see input_log.h) to play back one
+//                         step per frame instead of following the path
+//  MAZE_BENCHMARK_AGENTS  agents for the agent_system and crowd scaling runs
+//                         (default 100000)
+class benchmark
+{
+public:
+	benchmark();
+
+	//Read the settings, returns false when no benchmark was asked for
+	bool from_environment();
+	bool active() const { return frames > 0; }
+
+	//Waypoints in world space. load_path reads them from path_file.
+	bool load_path();
+	void set_path(const std::vector<vmath::vec3> & waypoints);
+	bool has_path() const { return path.size() >= 2; }
+
+	//Shortest walk through the open cells of a level, as (row, col) pairs
+	static bool find_path(int ** level, int width, int height,
+		int start_row, int start_col, int end_row, int end_col,
+		std::vector< std::pair<int, int> > & out_cells);
+
+	//Camera for a frame, spread evenly along the path
+	void camera(int frame, vmath::vec3 & out_position, vmath::vec3 & out_direction) const;
+
+	//Record one frame. gpu_ms is added separately since it arrives late.
+	void add_frame(double frame_ms, double cpu_ms, int draw_calls, int vertices);
+	void add_gpu(double gpu_ms);
+	void add_pass(const char * name, double mean_ms);
+	//Present intervals over the last frames (see sb7::application::PACINGSTATS)
+	//and how often the simulation fell behind, taken once at the end
+	void set_pacing(double mean_ms, double jitter_ms, double worst_ms, int late, int clamped_frames, double dropped_s);
+	//Time the vmath SIMD kernels against the plain loops, see vmath_bench.h
+	void measure_kernels();
+	//Swept grid collision queries per second, one agent and a batch of them
+	void measure_collision(int ** level, int width, int height);
+	//spatial_index moves and radius queries per second
+	void measure_spatial_index(int ** level, int width, int height);
+	//agent_system updates per second with 1 thread up to the whole pool
+	void measure_agents(int ** level, int width, int height, thread_pool & pool);
+	//crowd steps per second towards (goal_row, goal_col), same thread counts
+	void measure_crowd(int ** level, int width, int height, int goal_row, int goal_col, thread_pool & pool);
+	//Encode a 1080p frame tiled from the png at source on one thread and with
+	//lodepng's parallel deflate, and check both decode back to the same pixels
+	void measure_png_encode(const char * source);
+	//Decoded megabytes per second for each png, best of a few runs
+	void measure_png_decode(const std::vector<std::string> & sources);
+
+	//True once the warmup and measured frames have all been rendered
+	bool finished() const { return frame_count >= warmup + frames; }
+	int frame() const { return frame_count; }
+
+	bool write_report(const char * renderer, int width, int height) const;
+
+	int frames;
+	int warmup;
+	std::string path_file;
+	std::string out_file;
+	int agents;
+
+private:
+	std::vector<vmath::vec3> path;
+	std::vector<float> path_distance; //distance along the path at each waypoint
+
+	int frame_count;
+	std::vector<double> frame_times;
+	std::vector<double> cpu_times;
+	std::vector<double> gpu_times;
+	std::vector< std::pair<std::string, double> > passes;
+	std::vector<vmath_bench::result> kernels;
+	long long draw_calls;
+	long long vertices;
+	double pacing_mean_ms;
+	double pacing_jitter_ms;
+	double pacing_worst_ms;
+	int pacing_late;
+	int clamped_frames;
+	double dropped_s;
+	double collision_single_qps;
+	double collision_batched_qps;
+	double index_moves_per_s;
+	double index_queries_per_s;
+	//(threads, agent updates per second)
+	std::vector< std::pair<unsigned, double> > agent_rates;
+	//(threads, crowd agent steps per second)
+	std::vector< std::pair<unsigned, double> > crowd_rates;
+	//Single threaded first, then on png_threads
+	unsigned png_threads;
+	double png_encode_mb_per_s[2];
+	size_t png_encoded_bytes[2];
+	bool png_round_trip;
+	//(file name, MB/s)
+	std::vector< std::pair<std::string, double> > png_decode_rates;
+};
+
+#endif /* __BENCHMARK_H__ */
@@ -0,0 +1,220 @@
+#include "cpu_profiler.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <stdio.h>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace cpu_profiler
+{
+
+struct event
+{
+	const char * name;
+	unsigned long long start_ns;
+	unsigned long long end_ns;
+};
+
+//begin() without end() yet, private to the owning thread
+struct open_zone
+{
+	const char * name;
+	unsigned long long start_ns;
+};
+
+//Only the owning thread writes. Event i lives in events[i % ring_events]
+//and readers see events up to written once it is published.
+struct thread_buffer
+{
+	thread_buffer() : written(0), id(0) {}
+
+	event events[ring_events];
+	std::atomic<unsigned long long> written;
+	std::vector<open_zone> open_zones;
+	std::string name;
+	int id;
+};
+
+//One fixed buffer per thread, never freed so a trace can still be written
+//after a thread exits
+static std::mutex registry_lock;
+static std::vector<thread_buffer *> registry;
+static THREAD_LOCAL thread_buffer * local_buffer = NULL;
+static unsigned long long epoch_ns = now_ns();
+static std::atomic<bool> recording(false);
+static std::atomic<unsigned long long> capture_start_ns(0);
+static std::atomic<unsigned long long> capture_end_ns(0);
+
+static thread_buffer * get_buffer()
+{
+	if (local_buffer == NULL) {
+		thread_buffer * buffer = new thread_buffer;
+		std::unique_lock<std::mutex> guard(registry_lock);
+		buffer->id = (int)registry.size();
+		registry.push_back(buffer);
+		local_buffer = buffer;
+	}
+	return local_buffer;
+}
+
+unsigned long long now_ns()
+{
+#ifdef WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	//Split to keep the multiply from overflowing
+	unsigned long long seconds = counter.QuadPart / frequency.QuadPart;
+	unsigned long long rest = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000ULL + rest * 1000000000ULL / frequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void set_thread_name(const char * name)
+{
+	thread_buffer * buffer = get_buffer();
+	std::unique_lock<std::mutex> guard(registry_lock);
+	buffer->name = name;
+}
+
+void record(const char * name, unsigned long long start_ns, unsigned long long end_ns)
+{
+	if (!recording.load(std::memory_order_relaxed))
+		return;
+
+	thread_buffer * buffer = get_buffer();
+	unsigned long long n = buffer->written.load(std::memory_order_relaxed);
+	event & e = buffer->events[n % ring_events];
+	e.name = name;
+	e.start_ns = start_ns;
+	e.end_ns = end_ns;
+	buffer->written.store(n + 1, std::memory_order_release);
+}
+
+void start()
+{
+	capture_start_ns = now_ns();
+	capture_end_ns = ~0ULL;
+	recording = true;
+}
+
+void stop()
+{
+	if (!recording)
+		return;
+	recording = false;
+	capture_end_ns = now_ns();
+}
+
+bool capturing()
+{
+	return recording;
+}
+
+void begin(const char * name)
+{
+	if (!recording.load(std::memory_order_relaxed))
+		return;
+
+	thread_buffer * buffer = get_buffer();
+	open_zone zone = { name, now_ns() };
+	buffer->open_zones.push_back(zone);
+}
+
+//Zones begun before the capture have nothing to pop
+void end()
+{
+	thread_buffer * buffer = local_buffer;
+	if (buffer == NULL || buffer->open_zones.empty())
+		return;
+	open_zone zone = buffer->open_zones.back();
+	buffer->open_zones.pop_back();
+	record(zone.name, zone.start_ns, now_ns());
+}
+
+static void write_escaped(FILE * file, const char * s)
+{
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', file);
+		fputc(*s, file);
+	}
+}
+
+bool write_trace(const char * filename)
+{
+	FILE * file = fopen(filename, "w");
+	if (file == NULL) {
+		std::cout << "error: could not write trace " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<thread_buffer *> buffers;
+	{
+		std::unique_lock<std::mutex> guard(registry_lock);
+		buffers = registry;
+	}
+
+	unsigned long long window_start = capture_start_ns, window_end = capture_end_ns;
+	std::vector<event> events;
+	events.reserve(ring_events);
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t t = 0; t < buffers.size(); t++) {
+		thread_buffer * buffer = buffers[t];
+		{
+			std::unique_lock<std::mutex> guard(registry_lock);
+			if (!buffer->name.empty()) {
+				fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",\n", buffer->id);
+				write_escaped(file, buffer->name.c_str());
+				fprintf(file, "\"}}");
+				first = false;
+			}
+		}
+
+		//Copy the ring, then drop whatever the owner may have overwritten meanwhile
+		unsigned long long written = buffer->written.load(std::memory_order_acquire);
+		unsigned long long oldest = written > ring_events ? written - ring_events : 0;
+		events.clear();
+		for (unsigned long long i = oldest; i < written; i++)
+			events.push_back(buffer->events[i % ring_events]);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		unsigned long long now_written = buffer->written.load(std::memory_order_relaxed);
+		unsigned long long overwritten = now_written >= ring_events ? now_written - ring_events + 1 : 0;
+		size_t skip = overwritten > oldest ? (size_t)(overwritten - oldest) : 0;
+
+		for (size_t i = skip; i < events.size(); i++) {
+			const event & e = events[i];
+			if (e.start_ns < window_start || e.end_ns > window_end)
+				continue;
+			fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+			write_escaped(file, e.name);
+			fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->id, (e.start_ns - epoch_ns) / 1000.0, (e.end_ns - e.start_ns) / 1000.0);
+			first = false;
+		}
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	fclose(file);
+	return true;
+}
+
+}
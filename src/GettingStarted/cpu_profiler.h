@@ -0,0 +1,72 @@
+#ifndef __CPU_PROFILER_H__
+#define __CPU_PROFILER_H__
+
+//Scoped CPU zones written to per-thread buffers and exported as Chrome
+//trace_event JSON (load it in chrome://tracing or Perfetto). Zones are only
+//kept between start() and stop(), nothing is recorded until then. Recording
+//takes no locks: each thread writes into its own fixed ring, overwriting the
+//oldest events, and publishes the new count with a release store. Build with
+//MAZE_PROFILE=0 and every macro below compiles to nothing.
+#ifndef MAZE_PROFILE
+#define MAZE_PROFILE 1
+#endif
+
+namespace cpu_profiler
+{
+
+//Monotonic clock in nanoseconds
+unsigned long long now_ns();
+
+//Name shown for the calling thread's track in the trace
+void set_thread_name(const char * name);
+
+//name must outlive the profiler, string literals are expected. Outside a
+//capture begin() does nothing.
+void begin(const char * name);
+void end();
+
+//Record a finished zone directly
+void record(const char * name, unsigned long long start_ns, unsigned long long end_ns);
+
+//Capture window. Each thread keeps its newest ring_events zones of it.
+static const unsigned ring_events = 16384;
+void start();
+void stop();
+bool capturing();
+
+//Write the zones of the last capture window. Safe while other threads keep
+//recording, zones that get overwritten while writing are left out.
+bool write_trace(const char * filename);
+
+class zone
+{
+public:
+	zone(const char * name) : name(name), start(now_ns()) {}
+	~zone() { record(name, start, now_ns()); }
+
+private:
+	zone(const zone &);
+	zone & operator=(const zone &);
+
+	const char * name;
+	unsigned long long start;
+};
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if MAZE_PROFILE
+#define PROFILE_ZONE(name) cpu_profiler::zone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_BEGIN(name) cpu_profiler::begin(name)
+#define PROFILE_END() cpu_profiler::end()
+#define PROFILE_THREAD_NAME(name) cpu_profiler::set_thread_name(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+#endif /* __CPU_PROFILER_H__ */
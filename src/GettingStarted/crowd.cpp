@@ -0,0 +1,328 @@
+#include "crowd.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <deque>
+
+#include "cpu_profiler.h"
+#include "thread_pool.h"
+
+static const float walk_speed = 2.0f;
+//How quickly velocity turns towards the desired one, per second
+static const float steering_rate = 6.0f;
+//How strongly agents push apart, and the gap they try to keep
+static const float separation_strength = 4.0f;
+static const float separation_gap = 0.15f;
+//Neighbours looked at per agent, in a fixed order so ticks are repeatable
+static const int max_neighbours = 16;
+//Wandering on top of the flow, with a new heading every wander_ticks
+static const float wander_strength = 0.4f;
+static const unsigned wander_ticks = 64;
+//Agents per parallel_for chunk
+static const size_t chunk_agents = 2048;
+
+//Integer hash for per-agent randomness that only depends on its inputs
+static unsigned hash(unsigned a, unsigned b)
+{
+	unsigned h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+static float unit_float(unsigned h)
+{
+	return (float)(h >> 8) / 16777216.0f;
+}
+
+crowd::crowd()
+	: goal_cell(-1),
+	  published(NULL),
+	  arrived(0),
+	  running(false)
+{
+	memset(&level, 0, sizeof(level));
+}
+
+crowd::~crowd()
+{
+	end_step();
+}
+
+int crowd::cell_index(float x, float z) const
+{
+	int col = (int)floorf((x - level.origin_x) / level.cell_size);
+	int row = (int)floorf((z - level.origin_z) / level.cell_size);
+	col = col < 0 ? 0 : (col >= level.width ? level.width - 1 : col);
+	row = row < 0 ? 0 : (row >= level.height ? level.height - 1 : row);
+	return row * level.width + col;
+}
+
+//Breadth first distances from the goal, then each cell points at its
+//nearest neighbour. Diagonals only when both sides are open, so agents
+//never aim across a wall corner.
+void crowd::build_flow_field(int goal_row, int goal_col)
+{
+	int w = level.width, h = level.height;
+	std::vector<int> distance(w * h, -1);
+	flow_x.assign(w * h, 0.0f);
+	flow_z.assign(w * h, 0.0f);
+	if (grid_collision::is_wall(level, goal_row, goal_col))
+		return;
+
+	std::deque<int> open;
+	distance[goal_cell] = 0;
+	open.push_back(goal_cell);
+	static const int steps[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	while (!open.empty()) {
+		int cell = open.front();
+		open.pop_front();
+		int row = cell / w, col = cell % w;
+		for (int i = 0; i < 4; i++) {
+			int r = row + steps[i][0], c = col + steps[i][1];
+			if (grid_collision::is_wall(level, r, c) || distance[r * w + c] >= 0)
+				continue;
+			distance[r * w + c] = distance[cell] + 1;
+			open.push_back(r * w + c);
+		}
+	}
+
+	for (int row = 0; row < h; row++) {
+		for (int col = 0; col < w; col++) {
+			int cell = row * w + col;
+			if (distance[cell] <= 0)
+				continue;
+			int best = distance[cell];
+			float best_x = 0.0f, best_z = 0.0f;
+			for (int dr = -1; dr <= 1; dr++) {
+				for (int dc = -1; dc <= 1; dc++) {
+					int r = row + dr, c = col + dc;
+					if ((dr == 0 && dc == 0) || grid_collision::is_wall(level, r, c))
+						continue;
+					if (dr != 0 && dc != 0 && (grid_collision::is_wall(level, row, c) || grid_collision::is_wall(level, r, col)))
+						continue;
+					int d = distance[r * w + c];
+					if (d >= 0 && d < best) {
+						best = d;
+						best_x = (float)dc;
+						best_z = (float)dr;
+					}
+				}
+			}
+			float len = sqrtf(best_x * best_x + best_z * best_z);
+			if (len > 0.0f) {
+				flow_x[cell] = best_x / len;
+				flow_z[cell] = best_z / len;
+			}
+		}
+	}
+}
+
+void crowd::init(const grid_collision::grid & grid, int goal_row, int goal_col,
+	size_t count, float radius, unsigned seed)
+{
+	end_step();
+	level = grid;
+	goal_cell = goal_row * level.width + goal_col;
+	build_flow_field(goal_row, goal_col);
+
+	floor_cells.clear();
+	for (int r = 0; r < level.height; r++) {
+		for (int c = 0; c < level.width; c++) {
+			if (!grid_collision::is_wall(level, r, c) && r * level.width + c != goal_cell)
+				floor_cells.push_back(r * level.width + c);
+		}
+	}
+	if (floor_cells.empty())
+		count = 0;
+
+	radii.assign(count, radius);
+	for (int b = 0; b < 2; b++) {
+		buffers[b].tick = 0;
+		buffers[b].x.resize(count);
+		buffers[b].z.resize(count);
+		buffers[b].vx.resize(count);
+		buffers[b].vz.resize(count);
+	}
+	for (size_t i = 0; i < count; i++)
+		respawn(i, seed, buffers[0]);
+
+	cell_of.resize(count);
+	bucket.resize(count);
+	cell_start.resize(level.width * level.height + 1);
+	arrived = 0;
+	published.store(&buffers[0], std::memory_order_release);
+}
+
+//Somewhere in a random floor cell, standing still
+void crowd::respawn(size_t agent, unsigned tick, snapshot & out)
+{
+	unsigned h = hash((unsigned)agent, tick);
+	int cell = floor_cells[h % floor_cells.size()];
+	float room = level.cell_size - 2.0f * radii[agent];
+	out.x[agent] = level.origin_x + (cell % level.width) * level.cell_size + radii[agent] + unit_float(hash(h, 1)) * room;
+	out.z[agent] = level.origin_z + (cell / level.width) * level.cell_size + radii[agent] + unit_float(hash(h, 2)) * room;
+	out.vx[agent] = 0.0f;
+	out.vz[agent] = 0.0f;
+}
+
+void crowd::steer_range(const snapshot & in, snapshot & out, size_t begin, size_t end, float dt, unsigned & arrivals)
+{
+	const int w = level.width, h = level.height;
+	const float blend = steering_rate * dt < 1.0f ? steering_rate * dt : 1.0f;
+
+	for (size_t i = begin; i < end; i++) {
+		float x = in.x[i], z = in.z[i];
+		int cell = cell_of[i];
+		if (cell == goal_cell) {
+			respawn(i, in.tick + 1, out);
+			arrivals++;
+			continue;
+		}
+
+		//Follow the flow, wandering a little
+		float angle = unit_float(hash((unsigned)i, (in.tick + (unsigned)i) / wander_ticks)) * 6.2831853f;
+		float want_x = (flow_x[cell] + cosf(angle) * wander_strength) * walk_speed;
+		float want_z = (flow_z[cell] + sinf(angle) * wander_strength) * walk_speed;
+
+		//Push away from whoever is too close
+		int seen = 0;
+		int row = cell / w, col = cell % w;
+		for (int r = row - 1; r <= row + 1 && seen < max_neighbours; r++) {
+			if (r < 0 || r >= h)
+				continue;
+			for (int c = col - 1; c <= col + 1 && seen < max_neighbours; c++) {
+				if (c < 0 || c >= w)
+					continue;
+				int other_cell = r * w + c;
+				for (unsigned k = cell_start[other_cell]; k < cell_start[other_cell + 1] && seen < max_neighbours; k++) {
+					unsigned j = bucket[k];
+					if (j == i)
+						continue;
+					seen++;
+					float dx = x - in.x[j], dz = z - in.z[j];
+					float keep = radii[i] + radii[j] + separation_gap;
+					float dist_sq = dx * dx + dz * dz;
+					if (dist_sq >= keep * keep)
+						continue;
+					float dist = sqrtf(dist_sq);
+					if (dist > 1e-6f) {
+						float push = (keep - dist) / keep * separation_strength * walk_speed;
+						want_x += dx / dist * push;
+						want_z += dz / dist * push;
+					}
+					else {
+						//On top of each other: the lower index steps aside
+						want_x += (i < j ? 1.0f : -1.0f) * separation_strength;
+					}
+				}
+			}
+		}
+
+		float vx = in.vx[i] + (want_x - in.vx[i]) * blend;
+		float vz = in.vz[i] + (want_z - in.vz[i]) * blend;
+		float speed_sq = vx * vx + vz * vz;
+		float max_speed = walk_speed * 1.5f;
+		if (speed_sq > max_speed * max_speed) {
+			float scale = max_speed / sqrtf(speed_sq);
+			vx *= scale;
+			vz *= scale;
+		}
+
+		//Walls keep the part of the motion along them
+		float nx, nz;
+		if (grid_collision::move(level, radii[i], x, z, vx * dt, vz * dt, &nx, &nz)) {
+			float into = vx * nx + vz * nz;
+			if (into < 0.0f) {
+				vx -= into * nx;
+				vz -= into * nz;
+			}
+		}
+		out.x[i] = x;
+		out.z[i] = z;
+		out.vx[i] = vx;
+		out.vz[i] = vz;
+	}
+}
+
+void crowd::run_step(float dt, thread_pool & pool, unsigned threads)
+{
+	PROFILE_ZONE("crowd step");
+	const snapshot & in = *latest();
+	snapshot & out = (&in == &buffers[0]) ? buffers[1] : buffers[0];
+	const size_t n = size();
+	const unsigned cells = (unsigned)(level.width * level.height);
+	const unsigned chunks = (unsigned)((n + chunk_agents - 1) / chunk_agents);
+
+	if (n > 0) {
+		chunk_arrivals.assign(chunks, 0);
+
+		//1. Which cell everyone is in
+		pool.parallel_for(chunks, [&](unsigned c) {
+			size_t end = (c + 1) * chunk_agents < n ? (c + 1) * chunk_agents : n;
+			for (size_t i = c * chunk_agents; i < end; i++)
+				cell_of[i] = cell_index(in.x[i], in.z[i]);
+		}, threads);
+
+		//2. Counting sort by cell: one pass over the agents, one over the cells
+		//and one more over the agents to fill the buckets. Agents go in by
+		//index, so buckets list them in the same order whatever the threads.
+		cell_cursor.assign(cells, 0);
+		for (size_t i = 0; i < n; i++)
+			cell_cursor[cell_of[i]]++;
+		unsigned offset = 0;
+		for (unsigned cell = 0; cell < cells; cell++) {
+			cell_start[cell] = offset;
+			offset += cell_cursor[cell];
+			cell_cursor[cell] = cell_start[cell];
+		}
+		cell_start[cells] = offset;
+		for (size_t i = 0; i < n; i++)
+			bucket[cell_cursor[cell_of[i]]++] = (unsigned)i;
+
+		//3. Steer and move into the other snapshot
+		pool.parallel_for(chunks, [&](unsigned c) {
+			size_t end = (c + 1) * chunk_agents < n ? (c + 1) * chunk_agents : n;
+			steer_range(in, out, c * chunk_agents, end, dt, chunk_arrivals[c]);
+		}, threads);
+
+		for (unsigned c = 0; c < chunks; c++)
+			arrived += chunk_arrivals[c];
+	}
+
+	out.tick = in.tick + 1;
+	published.store(&out, std::memory_order_release);
+}
+
+void crowd::begin_step(float dt, thread_pool & pool, unsigned max_threads)
+{
+	end_step();
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		running = true;
+	}
+	//The task is one of the threads the passes run on
+	pool.submit([this, dt, &pool, max_threads]() {
+		run_step(dt, pool, max_threads);
+		std::unique_lock<std::mutex> guard(lock);
+		running = false;
+		finished.notify_all();
+	});
+}
+
+void crowd::end_step()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (running)
+		finished.wait(guard);
+}
+
+void crowd::step(float dt, thread_pool & pool, unsigned max_threads)
+{
+	end_step();
+	run_step(dt, pool, max_threads);
+}
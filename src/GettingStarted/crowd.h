@@ -0,0 +1,95 @@
+#ifndef __CROWD_H__
+#define __CROWD_H__
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "grid_collision.h"
+
+class thread_pool;
+
+//Agents that walk to the trophy along a flow field over the maze, keep
+//their distance from each other and slide along walls. A new one starts
+//from a random cell whenever one arrives, so the load stays constant.
+//
+//A tick runs in three passes, the first and last on the thread pool over
+//runs of agents:
+//  1. find the maze cell of each agent
+//  2. sort agent indices into per-cell buckets (the spatial hash), on one
+//     thread since it is a few cheap passes over the agents and the cells
+//  3. steer against the agents in the 3x3 cells around each one and move
+//Every pass reads the last published snapshot and the third writes the other
+//one, so ticks give the same result on any number of threads. The finished
+//snapshot is published with an atomic store, the render thread picks it up
+//with latest() and never takes a lock.
+class crowd
+{
+public:
+	struct snapshot
+	{
+		unsigned tick;
+		std::vector<float> x, z;
+		std::vector<float> vx, vz;
+	};
+
+	crowd();
+	~crowd();
+
+	//Flow field towards (goal_row, goal_col) and count agents in random open
+	//cells. The same seed gives the same crowd.
+	void init(const grid_collision::grid & level, int goal_row, int goal_col,
+		size_t count, float radius, unsigned seed);
+
+	//Run one tick of dt seconds on the pool in the background, on up to
+	//max_threads threads (0 for the whole pool). end_step() waits for it.
+	void begin_step(float dt, thread_pool & pool, unsigned max_threads = 0);
+	void end_step();
+	void step(float dt, thread_pool & pool, unsigned max_threads = 0);
+
+	//The newest finished tick. It stays untouched until the step after the
+	//next one begins, so read it between end_step() and the following begin_step().
+	const snapshot * latest() const { return published.load(std::memory_order_acquire); }
+
+	size_t size() const { return radii.size(); }
+	//Agents that reached the trophy so far
+	size_t arrivals() const { return arrived; }
+
+private:
+	crowd(const crowd &);
+	crowd & operator=(const crowd &);
+
+	void build_flow_field(int goal_row, int goal_col);
+	void run_step(float dt, thread_pool & pool, unsigned threads);
+	int cell_index(float x, float z) const;
+	void steer_range(const snapshot & in, snapshot & out, size_t begin, size_t end, float dt, unsigned & arrivals);
+	void respawn(size_t agent, unsigned tick, snapshot & out);
+
+	grid_collision::grid level;
+	int goal_cell;
+	//Unit direction to walk in each cell, 0 where the trophy can't be reached
+	std::vector<float> flow_x, flow_z;
+	std::vector<int> floor_cells;
+
+	snapshot buffers[2];
+	std::atomic<const snapshot *> published;
+	std::vector<float> radii;
+
+	//Spatial hash: agents of cell c are bucket[cell_start[c]] to bucket[cell_start[c + 1] - 1]
+	std::vector<int> cell_of;
+	std::vector<unsigned> cell_cursor; //next free slot of each cell's bucket while sorting
+	std::vector<unsigned> cell_start;
+	std::vector<unsigned> bucket;
+	std::vector<unsigned> chunk_arrivals;
+	size_t arrived;
+
+	//The background tick
+	std::mutex lock;
+	std::condition_variable finished;
+	bool running;
+};
+
+#endif /* __CROWD_H__ */
@@ -0,0 +1,179 @@
+#include "frame_capture.h"
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "../lodepng.h"
+#include "cpu_profiler.h"
+#include "thread_pool.h"
+
+frame_capture::frame_capture()
+	: pool(NULL),
+	  next_slot(0),
+	  next_frame(0),
+	  encoding(0),
+	  written(0),
+	  stalled(0),
+	  throttled(0),
+	  skipped(0)
+{
+
+}
+
+frame_capture::~frame_capture()
+{
+
+}
+
+void frame_capture::init(thread_pool * workers, const std::string & dir, int ring_size)
+{
+	pool = workers;
+	directory = dir;
+
+#ifdef WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+
+	ring.resize(ring_size);
+	for (size_t i = 0; i < ring.size(); i++) {
+		readback & r = ring[i];
+		glGenBuffers(1, &r.pbo);
+		r.size = 0;
+		r.fence = 0;
+		r.width = r.height = 0;
+		r.frame = -1;
+	}
+}
+
+void frame_capture::shutdown()
+{
+	//Oldest first so the files come out in order
+	for (size_t i = 0; i < ring.size(); i++) {
+		readback & r = ring[(next_slot + i) % ring.size()];
+		if (r.fence != 0)
+			finish(r);
+	}
+	for (size_t i = 0; i < ring.size(); i++)
+		glDeleteBuffers(1, &ring[i].pbo);
+	ring.clear();
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (encoding > 0)
+		encode_done.wait(guard);
+}
+
+void frame_capture::capture(GLuint framebuffer, GLenum attachment, int width, int height)
+{
+	PROFILE_ZONE("capture readback");
+	readback & r = ring[next_slot];
+
+	//The slot's last readback hasn't been picked up yet, it has to finish first
+	if (r.fence != 0) {
+		if (glClientWaitSync(r.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			stalled++;
+		finish(r);
+	}
+
+	size_t size = (size_t)width * height * 3;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	if (size != r.size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		r.size = size;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(attachment);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	r.width = width;
+	r.height = height;
+	r.frame = next_frame++;
+	next_slot = (next_slot + 1) % (int)ring.size();
+}
+
+void frame_capture::update()
+{
+	for (size_t i = 0; i < ring.size(); i++) {
+		readback & r = ring[(next_slot + i) % ring.size()];
+		if (r.fence == 0)
+			continue;
+		GLenum state = glClientWaitSync(r.fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			break; //later readbacks can't be done either
+		finish(r);
+	}
+}
+
+void frame_capture::finish(readback & r)
+{
+	glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	glDeleteSync(r.fence);
+	r.fence = 0;
+
+	if (encoding >= max_encodes) {
+		PROFILE_ZONE("capture throttle");
+		throttled++;
+		std::unique_lock<std::mutex> guard(lock);
+		while (encoding >= max_encodes)
+			encode_done.wait(guard);
+	}
+
+	encode_job * job = new encode_job;
+	char name[32];
+	sprintf(name, "frame_%05d.png", r.frame);
+	job->filename = directory + name;
+	job->width = r.width;
+	job->height = r.height;
+	job->pixels.resize(r.size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	const void * data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, r.size, GL_MAP_READ_BIT);
+	if (data != NULL)
+		memcpy(job->pixels.data(), data, r.size);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (data == NULL) {
+		delete job;
+		skipped++;
+		return;
+	}
+
+	encoding++;
+	pool->submit([this, job]() { encode(job); });
+}
+
+void frame_capture::encode(encode_job * job)
+{
+	PROFILE_ZONE("capture encode");
+
+	//GL rows start at the bottom
+	size_t row = (size_t)job->width * 3;
+	std::vector<unsigned char> flipped(job->pixels.size());
+	for (int y = 0; y < job->height; y++)
+		memcpy(&flipped[y * row], &job->pixels[(job->height - 1 - y) * row], row);
+
+	unsigned error = lodepng_encode24_file(job->filename.c_str(), flipped.data(), job->width, job->height);
+	if (error)
+		std::cout << "error " << error << ": " << lodepng_error_text(error) << std::endl;
+	else
+		written++;
+	delete job;
+
+	std::unique_lock<std::mutex> guard(lock);
+	encoding--;
+	encode_done.notify_all();
+}
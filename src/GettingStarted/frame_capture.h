@@ -0,0 +1,89 @@
+#ifndef __FRAME_CAPTURE_H__
+#define __FRAME_CAPTURE_H__
+
+#include <sb7.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class thread_pool;
+
+//Records frames to numbered PNGs without stalling the GL thread.
+//glReadPixels goes into a ring of pixel pack buffers and is fenced. A buffer
+//is only mapped once its fence has signaled, normally two or three frames
+//later, and the pixels are handed to the thread pool for the PNG encode.
+//Frames are read as RGB: the scene blends into destination alpha, which
+//would make parts of the PNGs transparent.
+class frame_capture
+{
+public:
+	frame_capture();
+	~frame_capture();
+
+	//Files go to directory + "frame_00000.png" and so on
+	void init(thread_pool * workers, const std::string & directory, int ring_size = 3);
+	//Finish every readback and encode that is still in flight
+	void shutdown();
+
+	//Queue a readback of one color attachment (GL_BACK for the default framebuffer)
+	void capture(GLuint framebuffer, GLenum attachment, int width, int height);
+
+	//Hand finished readbacks to the workers. GL thread only, once per frame.
+	void update();
+
+	int frames_queued() const { return next_frame; }
+	int frames_written() const { return written; }
+	//Readbacks that had to wait on the GPU, readbacks that waited for the
+	//encoders to catch up, and frames lost because a buffer couldn't be mapped
+	int stalls() const { return stalled; }
+	int throttles() const { return throttled; }
+	int dropped() const { return skipped; }
+
+private:
+	frame_capture(const frame_capture &);
+	frame_capture & operator=(const frame_capture &);
+
+	struct readback
+	{
+		GLuint pbo;
+		size_t size;
+		GLsync fence;
+		int width;
+		int height;
+		int frame;
+	};
+
+	struct encode_job
+	{
+		std::string filename;
+		std::vector<unsigned char> pixels;
+		int width;
+		int height;
+	};
+
+	//Map a finished readback and submit its encode
+	void finish(readback & r);
+	void encode(encode_job * job);
+
+	thread_pool * pool;
+	std::string directory;
+	std::vector<readback> ring;
+	int next_slot;
+	int next_frame;
+
+	//Encodes queued at once, beyond that the GL thread waits for one to finish
+	//so no frame of a sequence is lost
+	static const int max_encodes = 16;
+	std::atomic<int> encoding;
+	std::atomic<int> written;
+	std::mutex lock;
+	std::condition_variable encode_done;
+	int stalled;
+	int throttled;
+	int skipped;
+};
+
+#endif /* __FRAME_CAPTURE_H__ */
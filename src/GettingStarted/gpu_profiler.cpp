@@ -0,0 +1,260 @@
+#include "gpu_profiler.h"
+
+#include <assert.h>
+#include <string.h>
+#include <iostream>
+
+//Weight of a new sample in the moving average
+static const double smoothing = 0.1;
+
+gpu_profiler::gpu_profiler()
+	: visible(true),
+	  frame(0),
+	  slot(0),
+	  in_pass(false),
+	  initialized(false),
+	  hud_rows(0),
+	  dropped(0),
+	  last_total_ms(0.0),
+	  collected(0),
+	  csv(NULL),
+	  csv_columns(0)
+{
+	for (int i = 0; i < ring_size; i++) {
+		ring[i].frame = 0;
+		ring[i].pending = false;
+	}
+}
+
+gpu_profiler::~gpu_profiler()
+{
+	if (csv != NULL)
+		fclose(csv);
+}
+
+void gpu_profiler::init(int columns, int rows)
+{
+	overlay.init(columns, rows);
+	hud_rows = rows;
+	initialized = true;
+}
+
+void gpu_profiler::shutdown()
+{
+	if (!initialized)
+		return;
+	for (int i = 0; i < ring_size; i++) {
+		if (!ring[i].queries.empty())
+			glDeleteQueries((GLsizei)ring[i].queries.size(), ring[i].queries.data());
+		ring[i].queries.clear();
+		ring[i].passes.clear();
+		ring[i].pending = false;
+	}
+	overlay.teardown();
+	initialized = false;
+
+	if (csv != NULL) {
+		fclose(csv);
+		csv = NULL;
+	}
+}
+
+bool gpu_profiler::open_csv(const char * filename)
+{
+	if (csv != NULL)
+		fclose(csv);
+	csv = fopen(filename, "w");
+	csv_columns = 0;
+	if (csv == NULL) {
+		std::cout << "error: could not open " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int gpu_profiler::pass_index(const char * name)
+{
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (passes[i].name == name || strcmp(passes[i].name, name) == 0)
+			return (int)i;
+	}
+	pass_timing pass = { name, 0.0, 0.0, 0, false };
+	passes.push_back(pass);
+	return (int)passes.size() - 1;
+}
+
+void gpu_profiler::begin_frame()
+{
+	//Only reuse a slot once its results are in. If the GPU is that far behind,
+	//drop the old results instead of waiting for them.
+	frame_queries & current = ring[slot];
+	if (current.pending) {
+		collect(current);
+		if (current.pending) {
+			dropped++;
+			current.pending = false;
+		}
+	}
+	current.passes.clear();
+	current.frame = frame;
+}
+
+void gpu_profiler::begin(const char * name)
+{
+	assert(!in_pass);
+	frame_queries & current = ring[slot];
+	size_t n = current.passes.size();
+	if (n == current.queries.size()) {
+		GLuint query;
+		glGenQueries(1, &query);
+		current.queries.push_back(query);
+	}
+	current.passes.push_back(pass_index(name));
+	glBeginQuery(GL_TIME_ELAPSED, current.queries[n]);
+	in_pass = true;
+}
+
+void gpu_profiler::end()
+{
+	assert(in_pass);
+	glEndQuery(GL_TIME_ELAPSED);
+	in_pass = false;
+}
+
+void gpu_profiler::end_frame()
+{
+	ring[slot].pending = !ring[slot].passes.empty();
+	slot = (slot + 1) % ring_size;
+	frame++;
+
+	//Pick up whatever older frames have finished, oldest first
+	for (int i = 0; i < ring_size; i++) {
+		frame_queries & older = ring[(slot + i) % ring_size];
+		if (older.pending)
+			collect(older);
+	}
+}
+
+void gpu_profiler::collect(frame_queries & done)
+{
+	//Queries finish in order, so the last one tells us about the whole frame
+	GLint available = 0;
+	glGetQueryObjectiv(done.queries[done.passes.size() - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	std::vector<double> frame_ms(passes.size(), 0.0);
+	std::vector<bool> issued(passes.size(), false);
+	for (size_t i = 0; i < done.passes.size(); i++) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(done.queries[i], GL_QUERY_RESULT, &elapsed);
+		frame_ms[done.passes[i]] += elapsed / 1000000.0;
+		issued[done.passes[i]] = true;
+	}
+
+	last_total_ms = 0.0;
+	for (size_t i = 0; i < passes.size(); i++) {
+		pass_timing & pass = passes[i];
+		if (!issued[i])
+			continue;
+		if (pass.has_result)
+			pass.smoothed_ms += (frame_ms[i] - pass.smoothed_ms) * smoothing;
+		else
+			pass.smoothed_ms = frame_ms[i];
+		pass.has_result = true;
+		pass.sum_ms += frame_ms[i];
+		pass.samples++;
+		last_total_ms += frame_ms[i];
+	}
+	collected++;
+
+	if (csv != NULL) {
+		//Header is rewritten if a new pass shows up
+		if (csv_columns != (int)passes.size()) {
+			fprintf(csv, "frame");
+			for (size_t i = 0; i < passes.size(); i++)
+				fprintf(csv, ",%s", passes[i].name);
+			fprintf(csv, "\n");
+			csv_columns = (int)passes.size();
+		}
+		fprintf(csv, "%llu", done.frame);
+		//Passes the frame didn't draw are left empty
+		for (size_t i = 0; i < frame_ms.size(); i++) {
+			if (issued[i])
+				fprintf(csv, ",%.4f", frame_ms[i]);
+			else
+				fprintf(csv, ",");
+		}
+		fprintf(csv, "\n");
+	}
+
+	done.pending = false;
+}
+
+double gpu_profiler::pass_ms(const char * name) const
+{
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (strcmp(passes[i].name, name) == 0)
+			return passes[i].smoothed_ms;
+	}
+	return 0.0;
+}
+
+double gpu_profiler::pass_mean_ms(size_t i) const
+{
+	return passes[i].samples > 0 ? passes[i].sum_ms / passes[i].samples : 0.0;
+}
+
+double gpu_profiler::total_ms() const
+{
+	double total = 0.0;
+	for (size_t i = 0; i < passes.size(); i++)
+		total += passes[i].smoothed_ms;
+	return total;
+}
+
+void gpu_profiler::hud_line(const char * text)
+{
+	extra_lines.push_back(text);
+}
+
+void gpu_profiler::draw_hud()
+{
+	if (!visible || !initialized) {
+		extra_lines.clear();
+		return;
+	}
+
+	char line[64];
+	overlay.clear();
+	overlay.draw_text("GPU            ms", 0, 0);
+	for (size_t i = 0; i < passes.size(); i++) {
+		sprintf(line, "%-14.14s %6.3f", passes[i].name, passes[i].smoothed_ms);
+		overlay.draw_text(line, 0, (int)i + 1);
+	}
+	sprintf(line, "%-14s %6.3f", "total", total_ms());
+	overlay.draw_text(line, 0, (int)passes.size() + 1);
+	int row = (int)passes.size() + 2;
+	if (dropped > 0) {
+		sprintf(line, "dropped %d", dropped);
+		overlay.draw_text(line, 0, row++);
+	}
+	//Whatever doesn't fit is dropped
+	for (size_t i = 0; i < extra_lines.size() && row < hud_rows; i++)
+		overlay.draw_text(extra_lines[i].c_str(), 0, row++);
+	extra_lines.clear();
+
+	//The overlay draws with whatever state it finds
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cull = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	overlay.draw();
+	glDisable(GL_BLEND);
+	if (depth)
+		glEnable(GL_DEPTH_TEST);
+	if (cull)
+		glEnable(GL_CULL_FACE);
+}
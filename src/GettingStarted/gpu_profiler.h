@@ -0,0 +1,101 @@
+#ifndef __GPU_PROFILER_H__
+#define __GPU_PROFILER_H__
+
+#include <sb7.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "hud_text.h"
+
+//Per-pass GPU timings from GL_TIME_ELAPSED queries. Each frame writes into
+//one slot of a ring of query sets and results are read back a few frames
+//later, only once the driver says they are available, so timing never
+//stalls the pipeline. Times are smoothed and drawn with hud_text. A pass
+//missing from a frame (idle frames skip most) gets no sample for it.
+class gpu_profiler
+{
+public:
+	gpu_profiler();
+	~gpu_profiler();
+
+	//columns and rows size the text overlay
+	void init(int columns, int rows);
+	void shutdown();
+
+	//Append one row per frame (frame number, then ms per pass) to filename
+	bool open_csv(const char * filename);
+
+	//Wrap the passes of one frame. Passes can't nest, GL_TIME_ELAPSED
+	//queries can't overlap.
+	void begin_frame();
+	void begin(const char * name);
+	void end();
+	void end_frame();
+
+	//Smoothed milliseconds for a pass, 0 until it has results
+	double pass_ms(const char * name) const;
+	double total_ms() const;
+
+	//Passes seen so far and their mean over every collected frame
+	size_t pass_count() const { return passes.size(); }
+	const char * pass_name(size_t i) const { return passes[i].name; }
+	double pass_mean_ms(size_t i) const;
+
+	//Total of the most recently collected frame, which trails the current
+	//one by up to ring_size frames. collected_frames counts them.
+	double last_frame_ms() const { return last_total_ms; }
+	unsigned long long collected_frames() const { return collected; }
+
+	//Add a line under the timings for the next draw_hud() only
+	void hud_line(const char * text);
+	//Draw the timings into the current framebuffer
+	void draw_hud();
+
+	bool visible;
+
+private:
+	gpu_profiler(const gpu_profiler &);
+	gpu_profiler & operator=(const gpu_profiler &);
+
+	static const int ring_size = 4;
+
+	struct frame_queries
+	{
+		std::vector<GLuint> queries;
+		std::vector<int> passes; //pass index of each query in use
+		unsigned long long frame;
+		bool pending;
+	};
+
+	struct pass_timing
+	{
+		const char * name;
+		double smoothed_ms;
+		double sum_ms;
+		unsigned long long samples;
+		bool has_result;
+	};
+
+	int pass_index(const char * name);
+	void collect(frame_queries & slot);
+
+	frame_queries ring[ring_size];
+	std::vector<pass_timing> passes;
+	unsigned long long frame;
+	int slot;
+	bool in_pass;
+	bool initialized;
+	int hud_rows;
+	int dropped;
+	double last_total_ms;
+	unsigned long long collected;
+
+	hud_text overlay;
+	std::vector<std::string> extra_lines;
+	FILE * csv;
+	int csv_columns;
+};
+
+#endif /* __GPU_PROFILER_H__ */
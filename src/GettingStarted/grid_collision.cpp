@@ -0,0 +1,317 @@
+#include "grid_collision.h"
+
+#include <math.h>
+
+namespace grid_collision
+{
+
+//Slides per move: enough for a corner (two walls) with one to spare
+static const int max_slides = 3;
+//Gap left between a circle and the wall it stopped at
+static const float skin = 1e-4f;
+
+grid level_grid(int ** level, int width, int height)
+{
+	grid g;
+	g.cells = level;
+	g.width = width;
+	g.height = height;
+	g.origin_x = (float)(-width - 1);
+	g.origin_z = (float)(-height - 1);
+	g.cell_size = 2.0f;
+	return g;
+}
+
+struct contact
+{
+	float t; //fraction of the motion before touching
+	float nx, nz; //wall normal, pointing at the circle
+};
+
+//Push a circle out of a wall cell it overlaps. Returns true if it did.
+static bool push_out(const grid & g, int row, int col, float radius, float & x, float & z)
+{
+	float min_x = g.origin_x + col * g.cell_size, max_x = min_x + g.cell_size;
+	float min_z = g.origin_z + row * g.cell_size, max_z = min_z + g.cell_size;
+
+	float qx = x < min_x ? min_x : (x > max_x ? max_x : x);
+	float qz = z < min_z ? min_z : (z > max_z ? max_z : z);
+	float ox = x - qx, oz = z - qz;
+	float dist_sq = ox * ox + oz * oz;
+	if (dist_sq >= radius * radius)
+		return false;
+
+	if (dist_sq > 0.0f) {
+		float dist = sqrtf(dist_sq);
+		float push = radius - dist + skin;
+		x += ox / dist * push;
+		z += oz / dist * push;
+	}
+	else {
+		//Centre inside the cell: leave through the nearest side
+		float left = x - min_x, right = max_x - x, back = z - min_z, front = max_z - z;
+		float nearest = left;
+		if (right < nearest) nearest = right;
+		if (back < nearest) nearest = back;
+		if (front < nearest) nearest = front;
+		if (nearest == left) x = min_x - radius - skin;
+		else if (nearest == right) x = max_x + radius + skin;
+		else if (nearest == back) z = min_z - radius - skin;
+		else z = max_z + radius + skin;
+	}
+	return true;
+}
+
+static bool depenetrate(const grid & g, float radius, float & x, float & z)
+{
+	bool pushed = false;
+	//Pushing out of one cell can push into a neighbour, a few passes settle it
+	for (int pass = 0; pass < max_slides; pass++) {
+		int row = (int)floorf((z - g.origin_z) / g.cell_size);
+		int col = (int)floorf((x - g.origin_x) / g.cell_size);
+		bool moved = false;
+		for (int r = row - 1; r <= row + 1; r++) {
+			for (int c = col - 1; c <= col + 1; c++) {
+				if (is_wall(g, r, c))
+					moved |= push_out(g, r, c, radius, x, z);
+			}
+		}
+		if (!moved)
+			break;
+		pushed = true;
+	}
+	return pushed;
+}
+
+//Earliest time in [0, best.t) the circle touches the wall cell, i.e. the ray
+//from the centre against the cell grown by the radius, with rounded corners
+static void sweep_cell(const grid & g, int row, int col, float radius,
+	float x, float z, float dx, float dz, contact & best)
+{
+	float min_x = g.origin_x + col * g.cell_size, max_x = min_x + g.cell_size;
+	float min_z = g.origin_z + row * g.cell_size, max_z = min_z + g.cell_size;
+
+	//Already touching: only motion into the wall is blocked
+	float qx = x < min_x ? min_x : (x > max_x ? max_x : x);
+	float qz = z < min_z ? min_z : (z > max_z ? max_z : z);
+	float ox = x - qx, oz = z - qz;
+	float dist_sq = ox * ox + oz * oz;
+	if (dist_sq < radius * radius) {
+		if (dist_sq > 0.0f && ox * dx + oz * dz < 0.0f) {
+			float dist = sqrtf(dist_sq);
+			best.t = 0.0f;
+			best.nx = ox / dist;
+			best.nz = oz / dist;
+		}
+		return;
+	}
+
+	//Slabs of the grown box
+	float enter = -INFINITY, leave = INFINITY;
+	float nx = 0.0f, nz = 0.0f;
+	if (dx != 0.0f) {
+		float t0 = (min_x - radius - x) / dx, t1 = (max_x + radius - x) / dx;
+		float n = -1.0f;
+		if (t0 > t1) { float s = t0; t0 = t1; t1 = s; n = 1.0f; }
+		if (t0 > enter) { enter = t0; nx = n; nz = 0.0f; }
+		if (t1 < leave) leave = t1;
+	}
+	else if (x < min_x - radius || x > max_x + radius) {
+		return;
+	}
+	if (dz != 0.0f) {
+		float t0 = (min_z - radius - z) / dz, t1 = (max_z + radius - z) / dz;
+		float n = -1.0f;
+		if (t0 > t1) { float s = t0; t0 = t1; t1 = s; n = 1.0f; }
+		if (t0 > enter) { enter = t0; nx = 0.0f; nz = n; }
+		if (t1 < leave) leave = t1;
+	}
+	else if (z < min_z - radius || z > max_z + radius) {
+		return;
+	}
+	if (enter > leave || leave < 0.0f || enter >= best.t)
+		return;
+
+	//Entering along a side, or through a corner square where the circle
+	//only touches once it reaches the rounded corner
+	//(enter is negative when the centre is already inside the grown box)
+	float hx = enter > 0.0f ? x + dx * enter : x, hz = enter > 0.0f ? z + dz * enter : z;
+	bool beside_x = hx >= min_x && hx <= max_x;
+	bool beside_z = hz >= min_z && hz <= max_z;
+	if (beside_x || beside_z) {
+		if (enter <= 0.0f && dx * nx + dz * nz >= 0.0f)
+			return;
+		best.t = enter > 0.0f ? enter : 0.0f;
+		best.nx = nx;
+		best.nz = nz;
+		return;
+	}
+
+	float cx = hx < min_x ? min_x : max_x;
+	float cz = hz < min_z ? min_z : max_z;
+	float px = x - cx, pz = z - cz;
+	float a = dx * dx + dz * dz;
+	float b = px * dx + pz * dz;
+	float c = px * px + pz * pz - radius * radius;
+	float disc = b * b - a * c;
+	if (b >= 0.0f || disc < 0.0f)
+		return;
+	float t = (-b - sqrtf(disc)) / a;
+	if (t < 0.0f)
+		t = 0.0f;
+	if (t >= best.t)
+		return;
+
+	float ex = px + dx * t, ez = pz + dz * t;
+	float len = sqrtf(ex * ex + ez * ez);
+	if (len == 0.0f)
+		return;
+	best.t = t;
+	best.nx = ex / len;
+	best.nz = ez / len;
+}
+
+//Walk the cells the centre passes through. A circle smaller than a cell only
+//reaches the 3x3 block around its centre's cell, and once a cell is entered
+//after the best contact so far nothing further along can beat it.
+static bool sweep(const grid & g, float radius, float x, float z, float dx, float dz, contact & out)
+{
+	out.t = 1.0f;
+	out.nx = 0.0f;
+	out.nz = 0.0f;
+
+	float fx = (x - g.origin_x) / g.cell_size, fz = (z - g.origin_z) / g.cell_size;
+	int col = (int)floorf(fx), row = (int)floorf(fz);
+	int step_col = dx > 0.0f ? 1 : -1, step_row = dz > 0.0f ? 1 : -1;
+	float next_x = dx != 0.0f ? ((step_col > 0 ? col + 1 - fx : fx - col) * g.cell_size) / fabsf(dx) : INFINITY;
+	float next_z = dz != 0.0f ? ((step_row > 0 ? row + 1 - fz : fz - row) * g.cell_size) / fabsf(dz) : INFINITY;
+	float delta_x = dx != 0.0f ? g.cell_size / fabsf(dx) : INFINITY;
+	float delta_z = dz != 0.0f ? g.cell_size / fabsf(dz) : INFINITY;
+
+	float entered = 0.0f;
+	bool hit = false;
+	while (entered < out.t) {
+		for (int r = row - 1; r <= row + 1; r++) {
+			for (int c = col - 1; c <= col + 1; c++) {
+				if (!is_wall(g, r, c))
+					continue;
+				float before = out.t;
+				sweep_cell(g, r, c, radius, x, z, dx, dz, out);
+				hit |= out.t < before;
+			}
+		}
+
+		//Off the grid everything is wall, which the cells at the edge already stopped
+		if (row < -1 || col < -1 || row > g.height || col > g.width)
+			break;
+
+		if (next_x < next_z) {
+			entered = next_x;
+			next_x += delta_x;
+			col += step_col;
+		}
+		else {
+			entered = next_z;
+			next_z += delta_z;
+			row += step_row;
+		}
+	}
+	return hit;
+}
+
+bool move(const grid & g, float radius, float & x, float & z, float dx, float dz,
+	float * out_nx, float * out_nz)
+{
+	float start_x = x, start_z = z;
+	bool touched = depenetrate(g, radius, x, z);
+	float nx = x - start_x, nz = z - start_z;
+
+	for (int slide = 0; slide <= max_slides; slide++) {
+		if (dx == 0.0f && dz == 0.0f)
+			break;
+
+		contact c;
+		if (!sweep(g, radius, x, z, dx, dz, c)) {
+			x += dx;
+			z += dz;
+			break;
+		}
+		touched = true;
+		nx = c.nx;
+		nz = c.nz;
+
+		//Stop at the wall, a hair off it
+		x += dx * c.t + c.nx * skin;
+		z += dz * c.t + c.nz * skin;
+
+		//Keep what is left of the motion along the wall
+		float rest_x = dx * (1.0f - c.t), rest_z = dz * (1.0f - c.t);
+		float into = rest_x * c.nx + rest_z * c.nz;
+		dx = rest_x - into * c.nx;
+		dz = rest_z - into * c.nz;
+	}
+
+	if (touched && nx * nx + nz * nz > 0.0f) {
+		//A push out of a wall has no contact normal, use its direction
+		float len = sqrtf(nx * nx + nz * nz);
+		nx /= len;
+		nz /= len;
+	}
+	if (out_nx != NULL)
+		*out_nx = touched ? nx : 0.0f;
+	if (out_nz != NULL)
+		*out_nz = touched ? nz : 0.0f;
+	return touched;
+}
+
+//Circles are done in blocks: first the cells each one's swept box covers
+//for the whole block, a plain loop over arrays the compiler can vectorize,
+//then a look at those few cells. A box that covers no wall can't overlap or
+//reach one, so move() would just add the motion and the circle skips it.
+static const int block = 64;
+//Widest box in cells checked directly, anything bigger goes through move()
+static const int max_box_cells = 3;
+
+void move_all(const grid & g, float radius, float * x, float * z, const float * dx, const float * dz, size_t count)
+{
+	int min_col[block], max_col[block], min_row[block], max_row[block];
+	float inv_cell = 1.0f / g.cell_size;
+
+	for (size_t base = 0; base < count; base += block) {
+		int n = count - base < (size_t)block ? (int)(count - base) : block;
+		float * bx = x + base, * bz = z + base;
+		const float * bdx = dx + base, * bdz = dz + base;
+
+		for (int i = 0; i < n; i++) {
+			float lo_x = (bdx[i] < 0.0f ? bx[i] + bdx[i] : bx[i]) - radius;
+			float hi_x = (bdx[i] < 0.0f ? bx[i] : bx[i] + bdx[i]) + radius;
+			float lo_z = (bdz[i] < 0.0f ? bz[i] + bdz[i] : bz[i]) - radius;
+			float hi_z = (bdz[i] < 0.0f ? bz[i] : bz[i] + bdz[i]) + radius;
+			min_col[i] = (int)floorf((lo_x - g.origin_x) * inv_cell);
+			max_col[i] = (int)floorf((hi_x - g.origin_x) * inv_cell);
+			min_row[i] = (int)floorf((lo_z - g.origin_z) * inv_cell);
+			max_row[i] = (int)floorf((hi_z - g.origin_z) * inv_cell);
+		}
+
+		for (int i = 0; i < n; i++) {
+			bool clear = max_col[i] - min_col[i] < max_box_cells && max_row[i] - min_row[i] < max_box_cells;
+			for (int r = min_row[i]; clear && r <= max_row[i]; r++) {
+				for (int c = min_col[i]; c <= max_col[i]; c++) {
+					if (is_wall(g, r, c)) {
+						clear = false;
+						break;
+					}
+				}
+			}
+			if (clear) {
+				bx[i] += bdx[i];
+				bz[i] += bdz[i];
+			}
+			else {
+				move(g, radius, bx[i], bz[i], bdx[i], bdz[i]);
+			}
+		}
+	}
+}
+
+}
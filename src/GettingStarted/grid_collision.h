@@ -0,0 +1,47 @@
+#ifndef __GRID_COLLISION_H__
+#define __GRID_COLLISION_H__
+
+#include <stddef.h>
+
+//Circles moving through the level grid on the xz plane. A move is swept: the
+//grid is walked with a DDA along the motion, the earliest wall the circle
+//would touch stops it just short of contact, and what is left of the motion
+//slides along that wall. Nothing allocates and the result only depends on
+//the inputs, so replays and fixed-step simulations are deterministic.
+namespace grid_collision
+{
+
+//The level as the collision sees it: cells[row][col] == 1 is a wall, rows run
+//along z and columns along x. Anything outside the grid counts as wall.
+struct grid
+{
+	int ** cells;
+	int width;
+	int height;
+	//World position of the outer corner of cell (0, 0) and the cell edge length
+	float origin_x;
+	float origin_z;
+	float cell_size;
+};
+
+//The grid maze_render_app's level uses: cell c covers 2c - dim - 1 to 2c - dim + 1
+grid level_grid(int ** level, int width, int height);
+
+inline bool is_wall(const grid & g, int row, int col)
+{
+	return row < 0 || col < 0 || row >= g.height || col >= g.width || g.cells[row][col] == 1;
+}
+
+//Move a circle at (x, z) by (dx, dz). radius must be less than cell_size.
+//A circle that starts inside a wall is pushed out first. Returns true if it
+//touched a wall, out_nx and out_nz get the normal of the last one.
+bool move(const grid & g, float radius, float & x, float & z, float dx, float dz,
+	float * out_nx = NULL, float * out_nz = NULL);
+
+//The same for count circles in structure-of-arrays form, with the same results
+//as calling move() on each. Circles with no wall near their path skip the sweep.
+void move_all(const grid & g, float radius, float * x, float * z, const float * dx, const float * dz, size_t count);
+
+}
+
+#endif /* __GRID_COLLISION_H__ */
@@ -0,0 +1,18 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+
+//64-bit FNV-1a. Pass a previous result as seed to hash several buffers as one.
+inline unsigned long long hash_bytes(const void * data, size_t size, unsigned long long seed = 14695981039346656037ULL)
+{
+	const unsigned char * p = (const unsigned char *)data;
+	unsigned long long hash = seed;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+#endif /* __HASH_H__ */
@@ -0,0 +1,257 @@
+#include "hud_text.h"
+
+#include <shader.h>
+
+#include <string.h>
+#include <iostream>
+
+//ASCII 32-126, one byte per row with the leftmost pixel in the top bit.
+//Rasterized from DejaVu Sans Mono Bold (Bitstream Vera license).
+static const unsigned char font_8x16[95][16] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //space
+	{ 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //!
+	{ 0x00, 0x00, 0x00, 0x64, 0x64, 0x64, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //"
+	{ 0x00, 0x00, 0x00, 0x00, 0x12, 0x16, 0x7f, 0x24, 0x2c, 0xfe, 0x68, 0x48, 0x00, 0x00, 0x00, 0x00 }, //#
+	{ 0x00, 0x00, 0x00, 0x00, 0x3c, 0x70, 0x70, 0x3c, 0x0e, 0x06, 0x56, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //$
+	{ 0x00, 0x00, 0x00, 0x60, 0xd0, 0xd0, 0x62, 0x18, 0x4e, 0x0b, 0x0b, 0x0e, 0x00, 0x00, 0x00, 0x00 }, //%
+	{ 0x00, 0x00, 0x00, 0x38, 0x64, 0x30, 0x30, 0x7b, 0xcb, 0xce, 0x66, 0x3e, 0x00, 0x00, 0x00, 0x00 }, //&
+	{ 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //'
+	{ 0x00, 0x0c, 0x08, 0x18, 0x18, 0x10, 0x30, 0x30, 0x10, 0x18, 0x18, 0x08, 0x0c, 0x00, 0x00, 0x00 }, //(
+	{ 0x00, 0x30, 0x10, 0x18, 0x18, 0x18, 0x08, 0x08, 0x18, 0x18, 0x18, 0x10, 0x30, 0x00, 0x00, 0x00 }, //)
+	{ 0x00, 0x00, 0x00, 0x10, 0x52, 0x3c, 0x3c, 0x52, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //*
+	{ 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0xfe, 0xfe, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //+
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x10, 0x30, 0x00, 0x00 }, //,
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x3c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //-
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //.
+	{ 0x00, 0x00, 0x00, 0x06, 0x04, 0x04, 0x0c, 0x08, 0x18, 0x10, 0x30, 0x20, 0x60, 0x40, 0x00, 0x00 }, ///
+	{ 0x00, 0x00, 0x00, 0x3c, 0x64, 0x66, 0x76, 0x76, 0x66, 0x66, 0x64, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //0
+	{ 0x00, 0x00, 0x00, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //1
+	{ 0x00, 0x00, 0x00, 0x38, 0x4c, 0x06, 0x06, 0x0c, 0x18, 0x30, 0x60, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //2
+	{ 0x00, 0x00, 0x00, 0x3c, 0x46, 0x06, 0x3c, 0x06, 0x06, 0x06, 0x46, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //3
+	{ 0x00, 0x00, 0x00, 0x0c, 0x1c, 0x3c, 0x6c, 0x4c, 0x7e, 0x0c, 0x0c, 0x0c, 0x00, 0x00, 0x00, 0x00 }, //4
+	{ 0x00, 0x00, 0x00, 0x7c, 0x60, 0x60, 0x7c, 0x4e, 0x06, 0x06, 0x4c, 0x38, 0x00, 0x00, 0x00, 0x00 }, //5
+	{ 0x00, 0x00, 0x00, 0x1c, 0x20, 0x60, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //6
+	{ 0x00, 0x00, 0x00, 0x7e, 0x06, 0x0c, 0x0c, 0x1c, 0x18, 0x18, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 }, //7
+	{ 0x00, 0x00, 0x00, 0x3c, 0x66, 0x66, 0x3c, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //8
+	{ 0x00, 0x00, 0x00, 0x3c, 0x64, 0x66, 0x66, 0x66, 0x3e, 0x06, 0x0c, 0x38, 0x00, 0x00, 0x00, 0x00 }, //9
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //:
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x18, 0x18, 0x18, 0x30, 0x00, 0x00 }, //;
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0e, 0x78, 0x60, 0x78, 0x0e, 0x02, 0x00, 0x00, 0x00, 0x00 }, //<
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0x7e, 0x00, 0x7e, 0x7e, 0x00, 0x00, 0x00, 0x00, 0x00 }, //=
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x70, 0x1e, 0x06, 0x1e, 0x70, 0x40, 0x00, 0x00, 0x00, 0x00 }, //>
+	{ 0x00, 0x00, 0x00, 0x3c, 0x06, 0x06, 0x0c, 0x18, 0x10, 0x00, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00 }, //?
+	{ 0x00, 0x00, 0x00, 0x3c, 0x62, 0x4e, 0xd2, 0x92, 0xb2, 0x92, 0xd2, 0x4e, 0x62, 0x1e, 0x00, 0x00 }, //@
+	{ 0x00, 0x00, 0x00, 0x18, 0x38, 0x3c, 0x2c, 0x64, 0x7e, 0x66, 0x46, 0xc2, 0x00, 0x00, 0x00, 0x00 }, //A
+	{ 0x00, 0x00, 0x00, 0x7c, 0x66, 0x66, 0x66, 0x7c, 0x66, 0x66, 0x66, 0x7c, 0x00, 0x00, 0x00, 0x00 }, //B
+	{ 0x00, 0x00, 0x00, 0x1c, 0x32, 0x60, 0x60, 0x60, 0x60, 0x60, 0x32, 0x1c, 0x00, 0x00, 0x00, 0x00 }, //C
+	{ 0x00, 0x00, 0x00, 0x78, 0x6e, 0x66, 0x66, 0x66, 0x66, 0x66, 0x6e, 0x78, 0x00, 0x00, 0x00, 0x00 }, //D
+	{ 0x00, 0x00, 0x00, 0x7e, 0x60, 0x60, 0x60, 0x7e, 0x60, 0x60, 0x60, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //E
+	{ 0x00, 0x00, 0x00, 0x7e, 0x60, 0x60, 0x60, 0x7e, 0x60, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00 }, //F
+	{ 0x00, 0x00, 0x00, 0x1c, 0x32, 0x60, 0x60, 0x6e, 0x62, 0x62, 0x36, 0x1e, 0x00, 0x00, 0x00, 0x00 }, //G
+	{ 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x7e, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //H
+	{ 0x00, 0x00, 0x00, 0x7e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //I
+	{ 0x00, 0x00, 0x00, 0x3c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0c, 0x38, 0x00, 0x00, 0x00, 0x00 }, //J
+	{ 0x00, 0x00, 0x00, 0x66, 0x6c, 0x7c, 0x78, 0x78, 0x6c, 0x6c, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //K
+	{ 0x00, 0x00, 0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //L
+	{ 0x00, 0x00, 0x00, 0x66, 0x66, 0x6e, 0x7e, 0x5a, 0x5a, 0x42, 0x42, 0x42, 0x00, 0x00, 0x00, 0x00 }, //M
+	{ 0x00, 0x00, 0x00, 0x66, 0x66, 0x76, 0x76, 0x5e, 0x4e, 0x4e, 0x4e, 0x46, 0x00, 0x00, 0x00, 0x00 }, //N
+	{ 0x00, 0x00, 0x00, 0x3c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //O
+	{ 0x00, 0x00, 0x00, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x7c, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00 }, //P
+	{ 0x00, 0x00, 0x00, 0x3c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x04, 0x04, 0x00, 0x00 }, //Q
+	{ 0x00, 0x00, 0x00, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x7c, 0x6c, 0x66, 0x67, 0x00, 0x00, 0x00, 0x00 }, //R
+	{ 0x00, 0x00, 0x00, 0x3c, 0x60, 0x60, 0x70, 0x3c, 0x0e, 0x06, 0x46, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //S
+	{ 0x00, 0x00, 0x00, 0x7e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //T
+	{ 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //U
+	{ 0x00, 0x00, 0x00, 0xc6, 0x66, 0x66, 0x66, 0x64, 0x2c, 0x3c, 0x3c, 0x38, 0x00, 0x00, 0x00, 0x00 }, //V
+	{ 0x00, 0x00, 0x00, 0xc3, 0xc3, 0xdb, 0xda, 0x5a, 0x7e, 0x6e, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //W
+	{ 0x00, 0x00, 0x00, 0x46, 0x66, 0x3c, 0x38, 0x18, 0x3c, 0x3c, 0x66, 0xc6, 0x00, 0x00, 0x00, 0x00 }, //X
+	{ 0x00, 0x00, 0x00, 0xc7, 0x66, 0x6c, 0x3c, 0x38, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //Y
+	{ 0x00, 0x00, 0x00, 0x7e, 0x06, 0x0e, 0x1c, 0x18, 0x38, 0x70, 0x60, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //Z
+	{ 0x00, 0x1c, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1c, 0x00, 0x00, 0x00 }, //[
+	{ 0x00, 0x00, 0x00, 0x40, 0x60, 0x20, 0x30, 0x10, 0x18, 0x08, 0x0c, 0x04, 0x04, 0x06, 0x00, 0x00 }, //backslash
+	{ 0x00, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x38, 0x00, 0x00, 0x00 }, //]
+	{ 0x00, 0x00, 0x00, 0x18, 0x3c, 0x64, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00 }, //_
+	{ 0x00, 0x00, 0x20, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //`
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x46, 0x06, 0x7e, 0x66, 0x66, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //a
+	{ 0x00, 0x60, 0x60, 0x60, 0x60, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x7c, 0x00, 0x00, 0x00, 0x00 }, //b
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x1c, 0x32, 0x60, 0x60, 0x60, 0x32, 0x1c, 0x00, 0x00, 0x00, 0x00 }, //c
+	{ 0x00, 0x06, 0x06, 0x06, 0x06, 0x3e, 0x6e, 0x66, 0x46, 0x66, 0x6e, 0x3e, 0x00, 0x00, 0x00, 0x00 }, //d
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x66, 0x66, 0x7e, 0x60, 0x62, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //e
+	{ 0x00, 0x0e, 0x18, 0x18, 0x18, 0x7e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00 }, //f
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3e, 0x06, 0x06, 0x3c, 0x00 }, //g
+	{ 0x00, 0x60, 0x60, 0x60, 0x60, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //h
+	{ 0x00, 0x18, 0x18, 0x00, 0x00, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //i
+	{ 0x00, 0x08, 0x08, 0x00, 0x00, 0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x18, 0x78, 0x00 }, //j
+	{ 0x00, 0x60, 0x60, 0x60, 0x60, 0x66, 0x6c, 0x78, 0x78, 0x6c, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //k
+	{ 0x00, 0x70, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x10, 0x18, 0x1e, 0x00, 0x00, 0x00, 0x00 }, //l
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0x5a, 0x5a, 0x5a, 0x5a, 0x5a, 0x5a, 0x00, 0x00, 0x00, 0x00 }, //m
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00 }, //n
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //o
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x66, 0x66, 0x66, 0x66, 0x66, 0x7c, 0x60, 0x60, 0x60, 0x00 }, //p
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x6e, 0x66, 0x46, 0x66, 0x6e, 0x3e, 0x06, 0x06, 0x06, 0x00 }, //q
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3e, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00 }, //r
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x60, 0x60, 0x3c, 0x06, 0x46, 0x3c, 0x00, 0x00, 0x00, 0x00 }, //s
+	{ 0x00, 0x00, 0x00, 0x10, 0x10, 0x7e, 0x10, 0x10, 0x10, 0x10, 0x18, 0x1e, 0x00, 0x00, 0x00, 0x00 }, //t
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3e, 0x00, 0x00, 0x00, 0x00 }, //u
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x2c, 0x3c, 0x3c, 0x18, 0x00, 0x00, 0x00, 0x00 }, //v
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0xc3, 0xc3, 0xda, 0x5a, 0x7e, 0x6e, 0x66, 0x00, 0x00, 0x00, 0x00 }, //w
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x3c, 0x38, 0x18, 0x3c, 0x6c, 0x66, 0x00, 0x00, 0x00, 0x00 }, //x
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x3c, 0x3c, 0x1c, 0x18, 0x18, 0x30, 0x70, 0x00 }, //y
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0x0e, 0x0c, 0x18, 0x30, 0x70, 0x7e, 0x00, 0x00, 0x00, 0x00 }, //z
+	{ 0x00, 0x0e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x70, 0x18, 0x18, 0x18, 0x18, 0x0e, 0x00, 0x00, 0x00 }, //{
+	{ 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00 }, //|
+	{ 0x00, 0x70, 0x18, 0x18, 0x18, 0x18, 0x18, 0x0e, 0x18, 0x18, 0x18, 0x18, 0x70, 0x00, 0x00, 0x00 }, //}
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //~
+};
+
+static const char * vertex_source =
+	"#version 430 core\n"
+	"void main(void)\n"
+	"{\n"
+	"	//One triangle covering the viewport\n"
+	"	vec2 pos = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));\n"
+	"	gl_Position = vec4(pos, 0.0, 1.0);\n"
+	"}\n";
+
+//Cells are hud_text::cell_width by cell_height
+static const char * fragment_source =
+	"#version 430 core\n"
+	"layout (origin_upper_left) in vec4 gl_FragCoord;\n"
+	"layout (location = 0) out vec4 color;\n"
+	"layout (binding = 0) uniform usampler2D text_buffer;\n"
+	"layout (binding = 1) uniform sampler2D font_texture;\n"
+	"void main(void)\n"
+	"{\n"
+	"	ivec2 pixel = ivec2(gl_FragCoord.xy);\n"
+	"	ivec2 cell = pixel / ivec2(8, 16);\n"
+	"	if (any(greaterThanEqual(cell, textureSize(text_buffer, 0))))\n"
+	"		discard;\n"
+	"	int c = int(texelFetch(text_buffer, cell, 0).x);\n"
+	"	if (c < 32 || c > 126 || texelFetch(font_texture, ivec2((c - 32) * 8 + pixel.x % 8, pixel.y % 16), 0).x == 0.0)\n"
+	"		discard;\n"
+	"	color = vec4(1.0);\n"
+	"}\n";
+
+hud_text::hud_text()
+	: columns(0),
+	  rows(0),
+	  dirty(false),
+	  program(0),
+	  vao(0),
+	  text_tex(0),
+	  font_tex(0)
+{
+
+}
+
+hud_text::~hud_text()
+{
+
+}
+
+void hud_text::init(int num_columns, int num_rows)
+{
+	columns = num_columns;
+	rows = num_rows;
+	cells.assign((size_t)columns * rows, 0);
+	dirty = true;
+
+	GLuint vert_shader = sb7::shader::from_string(vertex_source, GL_VERTEX_SHADER);
+	GLuint frag_shader = sb7::shader::from_string(fragment_source, GL_FRAGMENT_SHADER);
+	program = glCreateProgram();
+	glAttachShader(program, vert_shader);
+	glAttachShader(program, frag_shader);
+	glLinkProgram(program);
+	glDeleteShader(vert_shader);
+	glDeleteShader(frag_shader);
+
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE) {
+		std::cout << "error: could not link the HUD text program" << std::endl;
+		glDeleteProgram(program);
+		program = 0;
+		return;
+	}
+
+	//Attributeless, the vertex shader makes its own positions
+	glGenVertexArrays(1, &vao);
+
+	const int glyphs = sizeof(font_8x16) / sizeof(font_8x16[0]);
+	std::vector<unsigned char> texels((size_t)glyphs * cell_width * cell_height);
+	for (int g = 0; g < glyphs; g++) {
+		for (int y = 0; y < cell_height; y++) {
+			for (int x = 0; x < cell_width; x++)
+				texels[(size_t)y * glyphs * cell_width + g * cell_width + x] = (font_8x16[g][y] & (0x80 >> x)) ? 255 : 0;
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glGenTextures(1, &font_tex);
+	glBindTexture(GL_TEXTURE_2D, font_tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, glyphs * cell_width, cell_height);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, glyphs * cell_width, cell_height, GL_RED, GL_UNSIGNED_BYTE, &texels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	//Integer textures are only complete with nearest filtering
+	glGenTextures(1, &text_tex);
+	glBindTexture(GL_TEXTURE_2D, text_tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, columns, rows);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void hud_text::teardown()
+{
+	if (program == 0)
+		return;
+	glDeleteTextures(1, &text_tex);
+	glDeleteTextures(1, &font_tex);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteProgram(program);
+	program = vao = text_tex = font_tex = 0;
+}
+
+void hud_text::clear()
+{
+	memset(&cells[0], 0, cells.size());
+	dirty = true;
+}
+
+void hud_text::draw_text(const char * text, int column, int row)
+{
+	if (row < 0 || row >= rows || column < 0)
+		return;
+	unsigned char * dst = &cells[(size_t)row * columns];
+	for (int c = column; c < columns && *text; c++)
+		dst[c] = (unsigned char)*text++;
+	dirty = true;
+}
+
+void hud_text::draw()
+{
+	if (program == 0)
+		return;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, text_tex);
+	if (dirty) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, columns, rows, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &cells[0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		dirty = false;
+	}
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, font_tex);
+
+	glUseProgram(program);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glActiveTexture(GL_TEXTURE0);
+}
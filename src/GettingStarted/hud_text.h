@@ -0,0 +1,44 @@
+#ifndef __HUD_TEXT_H__
+#define __HUD_TEXT_H__
+
+#include <sb7.h>
+
+#include <vector>
+
+//A grid of text drawn over the frame, the way sb7::text_overlay does it but
+//with an 8x16 font built in, so the HUD doesn't depend on a media file.
+//Cells count from the top left corner. Characters outside 32-126 are blank.
+class hud_text
+{
+public:
+	hud_text();
+	~hud_text();
+
+	void init(int columns, int rows);
+	void teardown();
+
+	void clear();
+	//Text running past the last column is cut off
+	void draw_text(const char * text, int column, int row);
+	//Draw into the current framebuffer with its blend and depth state
+	void draw();
+
+	static const int cell_width = 8;
+	static const int cell_height = 16;
+
+private:
+	hud_text(const hud_text &);
+	hud_text & operator=(const hud_text &);
+
+	int columns;
+	int rows;
+	std::vector<unsigned char> cells;
+	bool dirty;
+
+	GLuint program;
+	GLuint vao;
+	GLuint text_tex;
+	GLuint font_tex;
+};
+
+#endif /* __HUD_TEXT_H__ */
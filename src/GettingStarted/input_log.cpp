@@ -0,0 +1,246 @@
+#include "input_log.h"
+
+#include <string.h>
+
+#include <iostream>
+
+static const char magic[4] = { 'M', 'Z', 'I', 'N' };
+static const unsigned char version = 1;
+
+static unsigned zigzag(int value)
+{
+	return ((unsigned)value << 1) ^ (unsigned)(value >> 31);
+}
+
+static int unzigzag(unsigned value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+//Little endian whatever the host is
+static void put_u32(FILE * f, unsigned value)
+{
+	for (int i = 0; i < 4; i++)
+		fputc((value >> (i * 8)) & 0xFF, f);
+}
+
+static void put_f64(FILE * f, double value)
+{
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u32(f, (unsigned)bits);
+	put_u32(f, (unsigned)(bits >> 32));
+}
+
+//Reads from a loaded file, ok turns false on running off the end
+struct reader
+{
+	const std::vector<unsigned char> & data;
+	size_t at;
+	bool ok;
+
+	unsigned byte()
+	{
+		if (at >= data.size()) {
+			ok = false;
+			return 0;
+		}
+		return data[at++];
+	}
+
+	unsigned u32()
+	{
+		unsigned value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= byte() << (i * 8);
+		return value;
+	}
+
+	double f64()
+	{
+		unsigned long long bits = u32();
+		bits |= (unsigned long long)u32() << 32;
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	unsigned varint()
+	{
+		unsigned value = 0;
+		for (int shift = 0; shift < 35 && ok; shift += 7) {
+			unsigned b = byte();
+			value |= (b & 0x7F) << shift;
+			if ((b & 0x80) == 0)
+				return value;
+		}
+		ok = false;
+		return 0;
+	}
+};
+
+input_log::input_log()
+	: file(NULL),
+	  last_tick(0),
+	  last_x(0),
+	  last_y(0),
+	  cursor(0)
+{
+	memset(&header, 0, sizeof(header));
+}
+
+input_log::~input_log()
+{
+	if (file != NULL)
+		stop_recording(last_tick);
+}
+
+bool input_log::start_recording(const char * filename, const session & s)
+{
+	if (file != NULL)
+		stop_recording(last_tick);
+	file = fopen(filename, "wb");
+	if (file == NULL) {
+		std::cout << "error: could not open " << filename << std::endl;
+		return false;
+	}
+
+	header = s;
+	last_tick = 0;
+	last_x = last_y = 0;
+	fwrite(magic, 1, sizeof(magic), file);
+	fputc(version, file);
+	put_u32(file, s.seed);
+	put_f64(file, s.step);
+	put_u32(file, s.agents);
+	put_u32(file, s.crowd);
+	return true;
+}
+
+void input_log::put_varint(unsigned value)
+{
+	while (value >= 0x80) {
+		fputc((int)(value & 0x7F) | 0x80, file);
+		value >>= 7;
+	}
+	fputc((int)value, file);
+}
+
+void input_log::put_event(unsigned tick, event_type type)
+{
+	put_varint(tick >= last_tick ? tick - last_tick : 0);
+	fputc(type, file);
+	if (tick > last_tick)
+		last_tick = tick;
+}
+
+void input_log::key(unsigned tick, int key, int action)
+{
+	if (file == NULL)
+		return;
+	put_event(tick, EVENT_KEY);
+	put_varint(zigzag(key));
+	fputc(action & 0xFF, file);
+}
+
+void input_log::mouse_move(unsigned tick, int x, int y)
+{
+	if (file == NULL)
+		return;
+	put_event(tick, EVENT_MOUSE_MOVE);
+	put_varint(zigzag(x - last_x));
+	put_varint(zigzag(y - last_y));
+	last_x = x;
+	last_y = y;
+}
+
+void input_log::stop_recording(unsigned tick)
+{
+	if (file == NULL)
+		return;
+	put_event(tick, EVENT_END);
+	fclose(file);
+	file = NULL;
+}
+
+bool input_log::load(const char * filename)
+{
+	events.clear();
+	cursor = 0;
+
+	FILE * f = fopen(filename, "rb");
+	if (f == NULL) {
+		std::cout << "error: could not open " << filename << std::endl;
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char chunk[4096];
+	size_t got;
+	while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		data.insert(data.end(), chunk, chunk + got);
+	fclose(f);
+
+	reader in = { data, 0, true };
+	char file_magic[4];
+	for (int i = 0; i < 4; i++)
+		file_magic[i] = (char)in.byte();
+	if (!in.ok || memcmp(file_magic, magic, sizeof(magic)) != 0 || in.byte() != version) {
+		std::cout << "error: " << filename << " is not an input recording" << std::endl;
+		return false;
+	}
+	header.seed = in.u32();
+	header.step = in.f64();
+	header.agents = in.u32();
+	header.crowd = in.u32();
+
+	unsigned tick = 0;
+	int x = 0, y = 0;
+	for (;;) {
+		event e;
+		tick += in.varint();
+		e.tick = tick;
+		e.type = (event_type)in.byte();
+		e.a = e.b = 0;
+		if (!in.ok)
+			break;
+		if (e.type == EVENT_KEY) {
+			e.a = unzigzag(in.varint());
+			e.b = (int)in.byte();
+		}
+		else if (e.type == EVENT_MOUSE_MOVE) {
+			x += unzigzag(in.varint());
+			y += unzigzag(in.varint());
+			e.a = x;
+			e.b = y;
+		}
+		else if (e.type != EVENT_END) {
+			in.ok = false;
+		}
+		if (!in.ok)
+			break;
+		events.push_back(e);
+		if (e.type == EVENT_END)
+			break;
+	}
+
+	if (events.empty() || events.back().type != EVENT_END) {
+		std::cout << "error: " << filename << " is truncated" << std::endl;
+		events.clear();
+		return false;
+	}
+	return true;
+}
+
+bool input_log::next(unsigned tick, event & out)
+{
+	//The end record isn't handed out, replay_done() reports it
+	if (cursor + 1 >= events.size() || events[cursor].tick > tick)
+		return false;
+	out = events[cursor++];
+	return true;
+}
+
+bool input_log::replay_done(unsigned tick) const
+{
+	return !events.empty() && cursor + 1 >= events.size() && tick >= events.back().tick;
+}
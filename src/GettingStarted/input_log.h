@@ -0,0 +1,80 @@
+#ifndef __INPUT_LOG_H__
+#define __INPUT_LOG_H__
+
+#include <stdio.h>
+
+#include <vector>
+
+//Records the input of a run so it can be played back exactly. Events are
+//stamped with the simulation tick they take effect on (the number of
+//update() calls before them) rather than wall time, so a replay feeds every
+//update() the same input on any machine and at any frame rate. The header
+//holds what else the simulation depends on: the seed, the step and the
+//agent counts.
+//
+//The file is little endian: "MZIN", a version byte, the session, then one
+//record per event: a varint tick delta, a type byte and the payload
+//(varint key and an action byte, or zigzag varint mouse deltas). An end
+//record carries the last tick.
+class input_log
+{
+public:
+	struct session
+	{
+		unsigned seed;
+		double step;
+		unsigned agents;
+		unsigned crowd;
+	};
+
+	enum event_type
+	{
+		EVENT_KEY = 1,
+		EVENT_MOUSE_MOVE = 2,
+		EVENT_END = 0xFF
+	};
+
+	struct event
+	{
+		unsigned tick;
+		event_type type;
+		int a, b; //key and action, or mouse x and y
+	};
+
+	input_log();
+	~input_log();
+
+	bool start_recording(const char * filename, const session & s);
+	void key(unsigned tick, int key, int action);
+	void mouse_move(unsigned tick, int x, int y);
+	//Write the end record and close the file
+	void stop_recording(unsigned tick);
+
+	//Read a recording for replay
+	bool load(const char * filename);
+	//The next event due at tick, false when there are no more for it
+	bool next(unsigned tick, event & out);
+	//Every event has been played and tick is past the end of the recording
+	bool replay_done(unsigned tick) const;
+
+	bool recording() const { return file != NULL; }
+	bool replaying() const { return !events.empty(); }
+	const session & settings() const { return header; }
+
+private:
+	input_log(const input_log &);
+	input_log & operator=(const input_log &);
+
+	void put_varint(unsigned value);
+	void put_event(unsigned tick, event_type type);
+
+	session header;
+	FILE * file;
+	unsigned last_tick;
+	int last_x, last_y;
+
+	std::vector<event> events;
+	size_t cursor;
+};
+
+#endif /* __INPUT_LOG_H__ */
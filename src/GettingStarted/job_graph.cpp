@@ -0,0 +1,152 @@
+#include "job_graph.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "cpu_profiler.h"
+#include "thread_pool.h"
+
+job_graph::job_graph()
+	: pool(NULL),
+	  total_ms(0.0),
+	  completed(0)
+{
+
+}
+
+job_graph::~job_graph()
+{
+	for (size_t i = 0; i < jobs.size(); i++)
+		delete jobs[i];
+}
+
+job_graph::job_id job_graph::add_job(const char * name, const std::function<void()> & fn, bool main_thread)
+{
+	job * j = new job();
+	j->name = name;
+	j->fn = fn;
+	j->main_thread = main_thread;
+	j->remaining = 0;
+	j->start_ms = 0.0;
+	j->end_ms = 0.0;
+	j->thread = -1;
+	jobs.push_back(j);
+	return (job_id)jobs.size() - 1;
+}
+
+job_graph::job_id job_graph::add(const char * name, const std::function<void()> & fn)
+{
+	return add_job(name, fn, false);
+}
+
+job_graph::job_id job_graph::add_main(const char * name, const std::function<void()> & fn)
+{
+	return add_job(name, fn, true);
+}
+
+void job_graph::depends(job_id id, job_id on)
+{
+	jobs[on]->dependents.push_back(id);
+	jobs[id]->remaining++;
+}
+
+double job_graph::now_ms() const
+{
+	return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+void job_graph::schedule(job_id id)
+{
+	if (jobs[id]->main_thread) {
+		std::unique_lock<std::mutex> guard(lock);
+		main_queue.push_back(id);
+		main_ready.notify_one();
+	}
+	else {
+		pool->submit([this, id]() { execute(id, pool->current_worker()); });
+	}
+}
+
+void job_graph::execute(job_id id, int thread)
+{
+	job * j = jobs[id];
+	j->thread = thread;
+	j->start_ms = now_ms();
+	{
+		PROFILE_ZONE(j->name);
+		j->fn();
+	}
+	j->end_ms = now_ms();
+
+	for (size_t i = 0; i < j->dependents.size(); i++) {
+		if (--jobs[j->dependents[i]]->remaining == 0)
+			schedule(j->dependents[i]);
+	}
+
+	//Wake the main thread so it notices when everything is done. Notify
+	//under the lock, run() may return and destroy the graph right after.
+	std::unique_lock<std::mutex> guard(lock);
+	completed++;
+	main_ready.notify_one();
+}
+
+void job_graph::run(thread_pool & workers)
+{
+	pool = &workers;
+	completed = 0;
+	start = clock::now();
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (jobs[i]->remaining == 0)
+			schedule((job_id)i);
+	}
+
+	//The calling thread drains the completion queue until the graph is done
+	for (;;) {
+		job_id id;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (main_queue.empty() && completed < (int)jobs.size())
+				main_ready.wait(guard);
+			if (main_queue.empty())
+				break;
+			id = main_queue.front();
+			main_queue.pop_front();
+		}
+		execute(id, -1);
+	}
+
+	total_ms = now_ms();
+}
+
+void job_graph::report(std::ostream & out) const
+{
+	static const int bar_width = 50;
+
+	std::vector<const job *> sorted;
+	double busy_ms = 0.0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		sorted.push_back(jobs[i]);
+		busy_ms += jobs[i]->end_ms - jobs[i]->start_ms;
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const job * a, const job * b) { return a->start_ms < b->start_ms; });
+
+	double scale = (total_ms > 0.0) ? bar_width / total_ms : 0.0;
+
+	out << "Startup timeline (" << std::fixed << std::setprecision(2) << total_ms << " ms, "
+		<< busy_ms << " ms of work)" << std::endl;
+	for (size_t i = 0; i < sorted.size(); i++) {
+		const job * j = sorted[i];
+		int first = (int)(j->start_ms * scale);
+		int last = std::max(first + 1, (int)(j->end_ms * scale));
+
+		std::string bar(bar_width, ' ');
+		for (int c = first; c < last && c < bar_width; c++)
+			bar[c] = '#';
+
+		out << std::left << std::setw(24) << j->name << " "
+			<< std::setw(9) << (j->thread < 0 ? std::string("main") : "worker " + std::to_string((long long)j->thread))
+			<< std::right << std::setw(9) << j->start_ms << std::setw(9) << (j->end_ms - j->start_ms)
+			<< " |" << bar << "|" << std::endl;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef __JOB_GRAPH_H__
+#define __JOB_GRAPH_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+class thread_pool;
+
+//A one-shot graph of jobs with dependencies. Worker jobs run on the thread
+//pool as soon as their dependencies finish. Main thread jobs (anything that
+//touches GL) are handed to the thread that called run() through a completion
+//queue. Every job is timed so the run can be printed as a timeline.
+class job_graph
+{
+public:
+	typedef int job_id;
+
+	job_graph();
+	~job_graph();
+
+	job_id add(const char * name, const std::function<void()> & fn);
+	job_id add_main(const char * name, const std::function<void()> & fn);
+	//job will not start before on has finished
+	void depends(job_id job, job_id on);
+
+	//Runs every job, blocking the calling thread until all are done
+	void run(thread_pool & pool);
+
+	//Start and duration of every job, in milliseconds from the start of run()
+	void report(std::ostream & out) const;
+
+private:
+	job_graph(const job_graph &);
+	job_graph & operator=(const job_graph &);
+
+	typedef std::chrono::steady_clock clock;
+
+	struct job
+	{
+		const char * name;
+		std::function<void()> fn;
+		bool main_thread;
+		std::vector<job_id> dependents;
+		std::atomic<int> remaining;
+
+		double start_ms;
+		double end_ms;
+		int thread; //-1 for the main thread
+	};
+
+	job_id add_job(const char * name, const std::function<void()> & fn, bool main_thread);
+	void schedule(job_id id);
+	void execute(job_id id, int thread);
+	double now_ms() const;
+
+	std::vector<job *> jobs;
+	thread_pool * pool;
+	clock::time_point start;
+	double total_ms;
+
+	std::mutex lock;
+	std::condition_variable main_ready;
+	std::deque<job_id> main_queue;
+	int completed;
+};
+
+#endif /* __JOB_GRAPH_H__ */
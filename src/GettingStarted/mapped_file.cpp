@@ -0,0 +1,109 @@
+#include "mapped_file.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+	: ptr(NULL),
+	  length(0),
+#ifdef WIN32
+	  file_handle(INVALID_HANDLE_VALUE),
+	  mapping_handle(NULL)
+#else
+	  fd(-1)
+#endif
+{
+
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+#ifdef WIN32
+bool mapped_file::open(const char * filename)
+{
+	close();
+
+	file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle == NULL) {
+		close();
+		return false;
+	}
+
+	ptr = (const unsigned char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (ptr == NULL) {
+		close();
+		return false;
+	}
+	length = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (ptr != NULL)
+		UnmapViewOfFile(ptr);
+	if (mapping_handle != NULL)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+	ptr = NULL;
+	length = 0;
+	mapping_handle = NULL;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+#else
+bool mapped_file::open(const char * filename)
+{
+	close();
+
+	fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+
+	void * p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		close();
+		return false;
+	}
+	ptr = (const unsigned char *)p;
+	length = (size_t)st.st_size;
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (ptr != NULL)
+		munmap((void *)ptr, length);
+	if (fd >= 0)
+		::close(fd);
+	ptr = NULL;
+	length = 0;
+	fd = -1;
+}
+#endif
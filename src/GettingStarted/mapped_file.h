@@ -0,0 +1,34 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <stddef.h>
+
+//Read-only memory mapping of a whole file
+class mapped_file
+{
+public:
+	mapped_file();
+	~mapped_file();
+
+	bool open(const char * filename);
+	void close();
+
+	bool is_open() const { return ptr != NULL; }
+	const unsigned char * data() const { return ptr; }
+	size_t size() const { return length; }
+
+private:
+	mapped_file(const mapped_file &);
+	mapped_file & operator=(const mapped_file &);
+
+	const unsigned char * ptr;
+	size_t length;
+#ifdef WIN32
+	void * file_handle;
+	void * mapping_handle;
+#else
+	int fd;
+#endif
+};
+
+#endif /* __MAPPED_FILE_H__ */
@@ -2,17 +2,51 @@
 #include <vmath.h>
 #include <shader.h>
 #include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 #include <cmath>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <random>
 #include <string>
 
 #include "../lodepng.h"
+#include "agent_system.h"
+#include "benchmark.h"
+#include "cpu_profiler.h"
+#include "crowd.h"
+#include "frame_capture.h"
+#include "gpu_profiler.h"
+#include "grid_collision.h"
+#include "input_log.h"
+#include "job_graph.h"
+#include "program_cache.h"
+#include "shader_variant.h"
+#include "spatial_index.h"
+#include "sprite_batch.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
 
 #define PI 3.14159265
 
+//Bounded sprintf. VS2013 has no snprintf and its _vsnprintf leaves a
+//truncated string unterminated.
+static void format_line(char * line, size_t size, const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+#if defined(_MSC_VER) && _MSC_VER < 1900
+	_vsnprintf(line, size, format, args);
+#else
+	vsnprintf(line, size, format, args);
+#endif
+	va_end(args);
+	line[size - 1] = '\0';
+}
+
 class maze_render_app : public sb7::application
 {
 
@@ -27,38 +61,140 @@ protected:
 		memcpy(info.title, title, sizeof(title));
 		info.windowWidth = 1920;
 		info.windowHeight = 1080;
+		info.simulationStep = 0.01; //movement speeds below are per 10ms step
+
+		//Wandering agents for load testing
+		const char * agents_env = getenv("MAZE_AGENTS");
+		if (agents_env != NULL)
+			agent_count = atoi(agents_env) > 0 ? atoi(agents_env) : 0;
+		//Crowd walking to the trophy
+		const char * crowd_env = getenv("MAZE_CROWD");
+		if (crowd_env != NULL)
+			crowd_count = atoi(crowd_env) > 0 ? atoi(crowd_env) : 0;
+
+		//Standing still only the water moves, redraw it at this rate
+		info.idleFrameRate = 30.0;
+		const char * idle_env = getenv("MAZE_IDLE_FPS");
+		if (idle_env != NULL)
+			info.idleFrameRate = atof(idle_env) > 0.0 ? atof(idle_env) : 0.0;
+
+		//Frame pacing: vsync (on unless MAZE_VSYNC=0), a frame cap in frames
+		//per second, and waiting before input instead of after presenting
+		const char * vsync_env = getenv("MAZE_VSYNC");
+		info.flags.vsync = (vsync_env == NULL || atoi(vsync_env) != 0) ? 1 : 0;
+		const char * cap_env = getenv("MAZE_FPS_CAP");
+		if (cap_env != NULL)
+			info.frameRateCap = atof(cap_env) > 0.0 ? atof(cap_env) : 0.0;
+		const char * latency_env = getenv("MAZE_LOW_LATENCY");
+		info.flags.lowLatency = (latency_env != NULL && atoi(latency_env) != 0) ? 1 : 0;
+
+		//MAZE_SEED seeds everything random in the simulation
+		const char * seed_env = getenv("MAZE_SEED");
+		if (seed_env != NULL)
+			sim_seed = (unsigned)strtoul(seed_env, NULL, 10);
+
+		gpu_timings_csv = getenv("MAZE_GPU_CSV");
+
+		const char * verbose_env = getenv("MAZE_VERBOSE");
+		verbose = verbose_env != NULL && atoi(verbose_env) != 0;
+
+		//Benchmark runs drive the camera themselves and draw offscreen
+		if (bench.from_environment()) {
+			info.flags.hidden = 1;
+			info.flags.vsync = 0;
+			info.flags.lowLatency = 0;
+			info.simulationStep = 0.0;
+			info.idleFrameRate = 0.0;
+			info.frameRateCap = 0.0;
+			stream_textures = false;
+		}
+
+		//MAZE_RECORD writes the input of this run to a file, MAZE_REPLAY plays
+		//one back with the seed, step and agent counts it was recorded with
+		const char * replay_file = getenv("MAZE_REPLAY");
+		const char * record_file = getenv("MAZE_RECORD");
+		if (replay_file != NULL && input.load(replay_file)) {
+			const input_log::session & recorded = input.settings();
+			sim_seed = recorded.seed;
+			agent_count = recorded.agents;
+			crowd_count = recorded.crowd;
+			if (info.simulationStep > 0.0)
+				info.simulationStep = recorded.step;
+		}
+		else if (record_file != NULL) {
+			if (info.simulationStep > 0.0) {
+				input_log::session s = { sim_seed, info.simulationStep, (unsigned)agent_count, (unsigned)crowd_count };
+				input.start_recording(record_file, s);
+			}
+			else {
+				std::cout << "error: benchmark runs can't be recorded, replay a recording instead" << std::endl;
+			}
+		}
 	}
 
 	//Functions
 	void startup();
+	void shutdown();
+	void update(double step);
 	void render(double currentTime);
 	void onKey(int key, int action);
+	//What a key does, live or replayed
+	void apply_key(int key, int action);
 	void onMouseMove(int x, int y);
 	void onMouseButton(int button, int action);
+	void onResize(int w, int h);
+	//CPU zones for the stages of sb7's run loop
+	void beginStage(const char * name);
+	void endStage();
 	vmath::vec3 getArcballVector(int x, int y);
 	//void change_settings(GLint n, GLint s, GLint p, GLint c);
 	void load_image(std::string filename, GLuint * buf);
+	//Stream the texture in the background, or load it right away
+	void load_texture(std::string filename, GLuint * buf);
 
 	//Load an object file into a single mesh
 	bool load_object(std::string filename,	std::vector<vmath::vec4> & out_vertices,
 											std::vector < vmath::vec2 > & out_uvs,
 											std::vector < vmath::vec3 > & out_normals);
 
-	void generate_grass(int** level, int width, int height, std::vector< vmath::vec3 > & out_grass);
+	void generate_grass(int** level, int width, int height, unsigned seed, std::vector< vmath::vec3 > & out_grass);
 	//Load .mdf (maze data file) into a 2D array of walls and floors (1 == wall, 0 == floor)
 	int ** load_level(std::string filename, int & width, int & height, int &startr, int &startc, int &endr, int &endc);
 	//Convert an array index into a vertex in the maze
 	float convert_to_vert(int coord, int dim);
 	int convert_to_coord(float pos, int dim);
 
-	void wall_collision(float & xPos, float & zPos, vmath::vec3 direction, int height, int width, int** level);
-	bool load_shader(GLuint & prog, char* vert, char*frag);
+	//glDrawArrays, counted for the benchmark report
+	void draw_arrays(GLenum mode, GLint first, GLsizei count);
+	//sprites.draw() with the same counting
+	void draw_sprites(GLuint program);
+	//The animated floor, drawn into the bound framebuffer
+	void draw_water(const vmath::mat4 & view_matrix, const vmath::mat4 & perspective_matrix, double currentTime);
+	//Grass and sprites, which go over the water
+	void draw_see_through(const vmath::mat4 & view_matrix, const vmath::mat4 & perspective_matrix, const vmath::vec3 & light_pos);
+	//Blit color and depth of a window sized frame
+	void copy_frame(GLuint from, GLuint to);
+	//Reallocate the window sized renderbuffers, the cached scene is lost
+	void resize_window_buffers(int width, int height);
+	//Capture, HUD and timing after the passes
+	void finish_frame();
+	bool idle();
+	//Point the camera along the benchmark path and record the last frame
+	void benchmark_frame();
+
+	bool load_shader(GLuint & prog, const char* vert, const char* frag);
+	//Build the normal and REFLECTED variants of a shader pair
+	bool load_variants(GLuint & prog, GLuint & reflected_prog, const char* vert, const char* frag);
 
 	//Programs
 	GLuint			walls_program;
 	GLuint			grass_program;
 	GLuint			floor_program;
 	GLuint			sprite_program;
+	//Variants built with REFLECTED for the mirrored pass
+	GLuint			walls_reflected_program;
+	GLuint			grass_reflected_program;
+	GLuint			sprite_reflected_program;
 	
 	//Uniforms
 	struct uniforms_block
@@ -86,17 +222,44 @@ private:
 	float cYpos = 0.0f;
 	float cZpos;
 
+	//State before the last update(), render() blends towards the current one
+	float prevXpos, prevZpos;
+	vmath::vec3 prev_direction;
+
 	//Trophy position
 	float endXpos, endZpos;
 
 	//Where the light sits in the y-axis
 	float lightY = 1.0f;
 
-	//Necessary to throttle movement
-	double timeElapsed = 0.0;
-
 	int _width, _height, _startr, _startc, _endr, _endc;
 	int ** _level;
+	//_level as the collision sees it, and the camera's collision circle
+	grid_collision::grid level_grid;
+	float player_radius = 0.3f;
+
+	//MAZE_AGENTS sets how many wander the maze, they move every update()
+	size_t agent_count = 0;
+	agent_system agents;
+	//MAZE_CROWD sets how many walk to the trophy. Each update() starts their
+	//next step on the workers, render() reads walkers.latest().
+	size_t crowd_count = 0;
+	crowd walkers;
+
+	//Input recording and replay, see input_log.h. Events are stamped with
+	//sim_tick, the number of update() calls so far.
+	input_log input;
+	unsigned sim_tick = 0;
+	unsigned sim_seed = 1;
+	//MAZE_VERBOSE prints startup timings, benchmark runs always do
+	bool verbose = false;
+	//Cursor position as the simulation last saw it
+	int mouse_x = 0, mouse_y = 0;
+
+	//Things that react when the camera comes near, for now just the trophy
+	spatial_index triggers;
+	float trophy_reach = 1.0f;
+	bool trophy_found = false;
 	
 	//Vertex array objects
 	GLuint vao2;
@@ -140,6 +303,53 @@ private:
 
 	//Scale of the trophy sprite
 	float trophy_scale = 0.5f;
+	//The crowd is drawn as small tinted trophies standing on the floor
+	float crowd_scale = 0.2f;
+	vmath::vec4 crowd_tint = vmath::vec4(0.4f, 0.6f, 1.0f, 1.0f);
+
+	//Every sprite of the frame, drawn again for the reflection
+	sprite_batch sprites;
+
+	//Cache textures block-compressed (DXT/BC5) rather than as RGBA8
+	bool use_compressed_textures = true;
+
+	//Worker threads for startup jobs and texture streaming
+	thread_pool workers;
+
+	//Decode textures on worker threads and upload them as they finish
+	bool stream_textures = true;
+	texture_streamer streamer;
+
+	//Per-pass GPU timings and frame pacing, F3 toggles the overlay and F7 vsync
+	gpu_profiler gpu;
+	//MAZE_GPU_CSV names a file to log every frame's pass timings to as CSV
+	const char * gpu_timings_csv = NULL;
+
+	//F4 starts recording CPU zones, pressing it again writes them here as
+	//Chrome trace JSON
+	const char * cpu_trace_file = "maze_trace.json";
+
+	//Headless benchmark, see benchmark.h for the settings
+	benchmark bench;
+	//Where the final image goes: 0, or an offscreen target when benchmarking
+	GLuint output_buf = 0;
+	GLuint output_color, output_depth;
+	//The last full frame up to the walls when the next one looked idle, see
+	//idle(). Only made when info.idleFrameRate is set (MAZE_IDLE_FPS, 0 turns
+	//it off).
+	GLuint scene_cache_buf = 0;
+	GLuint scene_cache_color, scene_cache_depth;
+	bool scene_cached = false;
+	int frame_draw_calls = 0, frame_vertices = 0;
+	double frame_start = 0.0;
+	unsigned long long cpu_start_ns = 0;
+	double frame_cpu_ms = 0.0;
+	unsigned long long bench_gpu_frames = 0;
+
+	//PNG sequence recording. F5 records the final image, F6 the reflection.
+	enum capture_mode { CAPTURE_OFF, CAPTURE_FRAME, CAPTURE_REFLECTION };
+	capture_mode capture_source = CAPTURE_OFF;
+	frame_capture recorder;
 };
 
 void load_vertex(GLuint &buf, GLsizeiptr size, const void * points) {
@@ -154,108 +364,204 @@ void load_vertex(GLuint &buf, GLsizeiptr size, const void * points) {
 
 void maze_render_app::startup()
 {
+	PROFILE_THREAD_NAME("main");
+	PROFILE_ZONE("startup");
+
 	dirPress = new bool[6];//w, d, s, a, right, left
 	for (int i = 0; i < 6; i++)
 		dirPress[i] = false;
 
 	direction = vmath::vec3(0.0f, 0.0f, -1.0f);
 
+	//Loading runs as a job graph: file parsing and decoding go to the worker
+	//pool, anything that touches GL runs on this thread once its inputs are ready
+	workers.start();
+	job_graph startup_jobs;
+
 #pragma region Load shaders
 	walls_program = glCreateProgram(); //Bump-mapped walls
 	grass_program = glCreateProgram(); //Grass sprites
 	floor_program = glCreateProgram(); //Water floor
 	sprite_program = glCreateProgram(); //Trophy
-
-	assert(load_shader(walls_program, "walls-vertex.glsl", "walls-fragment.glsl"));
-	assert(load_shader(floor_program, "floor-vertex.glsl", "floor-fragment.glsl"));
-	assert(load_shader(grass_program, "grass-vertex.glsl", "grass-fragment.glsl"));
-	assert(load_shader(sprite_program, "sprite-vertex.glsl", "sprite-fragment.glsl"));
+	walls_reflected_program = glCreateProgram();
+	grass_reflected_program = glCreateProgram();
+	sprite_reflected_program = glCreateProgram();
+
+	startup_jobs.add_main("walls shaders", [this]() {
+		bool res = load_variants(walls_program, walls_reflected_program, "walls-vertex.glsl", "walls-fragment.glsl");
+		assert(res);
+	});
+	startup_jobs.add_main("floor shader", [this]() {
+		bool res = load_shader(floor_program, "floor-vertex.glsl", "floor-fragment.glsl");
+		assert(res);
+	});
+	startup_jobs.add_main("grass shaders", [this]() {
+		bool res = load_variants(grass_program, grass_reflected_program, "grass-vertex.glsl", "grass-fragment.glsl");
+		assert(res);
+	});
+	startup_jobs.add_main("sprite shaders", [this]() {
+		bool res = load_variants(sprite_program, sprite_reflected_program, "sprite-vertex.glsl", "sprite-fragment.glsl");
+		assert(res);
+	});
 #pragma endregion
 
 #pragma region Create Framebuffer Object
-	glGenFramebuffers(1, &frame_buf);
-	glBindFramebuffer(GL_FRAMEBUFFER, frame_buf);
+	startup_jobs.add_main("framebuffer", [this]() {
+		glGenFramebuffers(1, &frame_buf);
+		glBindFramebuffer(GL_FRAMEBUFFER, frame_buf);
+
+		glGenTextures(1, &frame_tex);
+		glBindTexture(GL_TEXTURE_2D, frame_tex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, viewport_w, viewport_h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame_tex, 0);
+
+		glGenRenderbuffers(1, &render_buf);
+		glBindRenderbuffer(GL_RENDERBUFFER, render_buf);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, viewport_w, viewport_h);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, render_buf);
+
+		assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE); //make sure FBO is created
+
+		//A hidden window's back buffer may not be rendered at all, benchmark into our own
+		if (bench.active()) {
+			glGenFramebuffers(1, &output_buf);
+			glBindFramebuffer(GL_FRAMEBUFFER, output_buf);
+
+			glGenRenderbuffers(1, &output_color);
+			glBindRenderbuffer(GL_RENDERBUFFER, output_color);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, info.windowWidth, info.windowHeight);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, output_color);
+
+			glGenRenderbuffers(1, &output_depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, output_depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, info.windowWidth, info.windowHeight);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, output_depth);
+
+			assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+		}
 
-	glGenTextures(1, &frame_tex);
-	glBindTexture(GL_TEXTURE_2D, frame_tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, viewport_w, viewport_h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
+		//Same formats as the window's, so depth can be blitted to and from it
+		if (info.idleFrameRate > 0.0) {
+			glGenFramebuffers(1, &scene_cache_buf);
+			glBindFramebuffer(GL_FRAMEBUFFER, scene_cache_buf);
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame_tex, 0);
+			glGenRenderbuffers(1, &scene_cache_color);
+			glBindRenderbuffer(GL_RENDERBUFFER, scene_cache_color);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, info.windowWidth, info.windowHeight);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scene_cache_color);
 
-	glGenRenderbuffers(1, &render_buf);
-	glBindRenderbuffer(GL_RENDERBUFFER, render_buf);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, viewport_w, viewport_h);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, render_buf);
+			glGenRenderbuffers(1, &scene_cache_depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, scene_cache_depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, info.windowWidth, info.windowHeight);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, scene_cache_depth);
 
-	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE); //make sure FBO is created
+			assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+		}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	});
 #pragma endregion
 
 #pragma region Load Textures
-	//Load textures
-	load_image("bin\\media\\textures\\wall.png", &wall_tex_buffer);
-	load_image("bin\\media\\textures\\normal.png", &wall_normal_buffer);
-	load_image("bin\\media\\textures\\floor_normal.png", &floor_normal_buffer);
-	load_image("bin\\media\\textures\\grass_tex.png", &grass_tex);
-	load_image("bin\\media\\textures\\trophy.png", &trophy_tex);
+	//Load textures, placeholders are bound until the streamed ones arrive
+	startup_jobs.add_main("textures", [this]() {
+		if (stream_textures)
+			streamer.init(&workers, use_compressed_textures);
+		load_texture("bin\\media\\textures\\wall.png", &wall_tex_buffer);
+		load_texture("bin\\media\\textures\\normal.png", &wall_normal_buffer);
+		load_texture("bin\\media\\textures\\floor_normal.png", &floor_normal_buffer);
+		load_texture("bin\\media\\textures\\grass_tex.png", &grass_tex);
+		load_texture("bin\\media\\textures\\trophy.png", &trophy_tex);
+	});
 #pragma endregion
 
 #pragma region Load Object data
 	//Object data loaded from files
-	bool res = load_object("bin\\media\\objects\\wall_data.obj", vertices, uvs, normals);
-	assert(res);
-	res = load_object("bin\\media\\objects\\floor_data.obj", fvertices, fuvs, fnormals);
-	assert(res);
+	job_graph::job_id wall_mesh = startup_jobs.add("wall mesh", [this]() {
+		bool res = load_object("bin\\media\\objects\\wall_data.obj", vertices, uvs, normals);
+		assert(res);
+	});
+	job_graph::job_id floor_mesh = startup_jobs.add("floor mesh", [this]() {
+		bool res = load_object("bin\\media\\objects\\floor_data.obj", fvertices, fuvs, fnormals);
+		assert(res);
+	});
 #pragma endregion
 
 #pragma region Load and initialize level data
-	_level = load_level("bin\\media\\objects\\walls.mdf", _width, _height, _startr, _startc, _endr, _endc);
+	job_graph::job_id level = startup_jobs.add("level", [this]() {
+		_level = load_level("bin\\media\\objects\\walls.mdf", _width, _height, _startr, _startc, _endr, _endc);
+		level_grid = grid_collision::level_grid(_level, _width, _height);
+		agents.init(level_grid);
+		agents.spawn(agent_count, 3.0f, 0.25f, sim_seed);
+		walkers.init(level_grid, _endr, _endc, crowd_count, 0.25f, sim_seed);
 
-	//Set the starting position
-	cXpos = convert_to_vert(_startc, _width) - 1.0f;
-	cZpos = convert_to_vert(_startr, _height) - 1.0f;
+		//Set the starting position
+		cXpos = convert_to_vert(_startc, _width) - 1.0f;
+		cZpos = convert_to_vert(_startr, _height) - 1.0f;
 
-	//Set the end position (the trophy)
-	endXpos = convert_to_vert(_endc, _width) - 1.0f;
-	endZpos = convert_to_vert(_endr, _height) - 1.0f;
+		//Set the end position (the trophy)
+		endXpos = convert_to_vert(_endc, _width) - 1.0f;
+		endZpos = convert_to_vert(_endr, _height) - 1.0f;
+
+		triggers.init(level_grid);
+		triggers.insert(endXpos, endZpos, 0);
+	});
 
 	//Generate the points for grass sprites
-	generate_grass(_level, _width, _height, grass_points);
+	job_graph::job_id grass = startup_jobs.add("grass", [this]() {
+		generate_grass(_level, _width, _height, sim_seed, grass_points);
+	});
+	startup_jobs.depends(grass, level);
 #pragma endregion
 	
 #pragma region Wall buffers
-
-	//Cubes vao
-	glGenVertexArrays(1, &vao2);
-	glBindVertexArray(vao2);
-
-	load_vertex(buffer, vertices.size() * sizeof(vmath::vec4), &vertices[0]);
-	load_vertex(normal_buffer, normals.size() * sizeof(vmath::vec3), &normals[0]);
-	load_vertex(tc_buffer, uvs.size() * sizeof(vmath::vec2), &uvs[0]);
-	
+	job_graph::job_id wall_buffers = startup_jobs.add_main("wall buffers", [this]() {
+		//Cubes vao
+		glGenVertexArrays(1, &vao2);
+		glBindVertexArray(vao2);
+
+		load_vertex(buffer, vertices.size() * sizeof(vmath::vec4), &vertices[0]);
+		load_vertex(normal_buffer, normals.size() * sizeof(vmath::vec3), &normals[0]);
+		load_vertex(tc_buffer, uvs.size() * sizeof(vmath::vec2), &uvs[0]);
+	});
+	startup_jobs.depends(wall_buffers, wall_mesh);
 #pragma endregion
 
 #pragma region Floor Buffers
-	//Floor vao
-	glGenVertexArrays(1, &floor_vao);
-	glBindVertexArray(floor_vao);
-
-	load_vertex(fbuffer, fvertices.size() * sizeof(vmath::vec4), &fvertices[0]);
-	load_vertex(fnormal_buffer, fnormals.size() * sizeof(vmath::vec3), &fnormals[0]);
-	load_vertex(ftc_buffer, fuvs.size() * sizeof(vmath::vec2), &fuvs[0]);
+	job_graph::job_id floor_buffers = startup_jobs.add_main("floor buffers", [this]() {
+		//Floor vao
+		glGenVertexArrays(1, &floor_vao);
+		glBindVertexArray(floor_vao);
+
+		load_vertex(fbuffer, fvertices.size() * sizeof(vmath::vec4), &fvertices[0]);
+		load_vertex(fnormal_buffer, fnormals.size() * sizeof(vmath::vec3), &fnormals[0]);
+		load_vertex(ftc_buffer, fuvs.size() * sizeof(vmath::vec2), &fuvs[0]);
+	});
+	startup_jobs.depends(floor_buffers, floor_mesh);
 #pragma endregion
 
 #pragma region Grass buffers
-	glGenVertexArrays(1, &grass_vao);
-	glBindVertexArray(grass_vao);
+	job_graph::job_id grass_buffers = startup_jobs.add_main("grass buffers", [this]() {
+		glGenVertexArrays(1, &grass_vao);
+		glBindVertexArray(grass_vao);
 
-	load_vertex(grass_buffer, grass_points.size() * sizeof(vmath::vec3), &grass_points[0]);
+		load_vertex(grass_buffer, grass_points.size() * sizeof(vmath::vec3), &grass_points[0]);
+	});
+	startup_jobs.depends(grass_buffers, grass);
 #pragma endregion
 
+	startup_jobs.run(workers);
+
+	prevXpos = cXpos;
+	prevZpos = cZpos;
+	prev_direction = direction;
+	if (verbose || bench.active())
+		startup_jobs.report(std::cout);
+
 	// Buffer for uniform block
 	glGenBuffers(1, &uniforms_buffer);
 	glBindBuffer(GL_UNIFORM_BUFFER, uniforms_buffer);
@@ -265,65 +571,175 @@ void maze_render_app::startup()
 	glFrontFace(GL_CW);
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
-}
 
+	gpu.init(32, 16);
+	if (gpu_timings_csv != NULL)
+		gpu.open_csv(gpu_timings_csv);
 
-void maze_render_app::render(double currentTime)
-{
-	static const GLfloat zeros[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	static const GLfloat gray[] = { 0.1f, 0.1f, 0.1f, 0.0f };
-	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
-	static const GLfloat skyBlue[] = { 0.529f, 0.808f, 0.922f };
-	static const GLfloat ones[] = { 1.0f };
-	const float f = (float)currentTime;
-	
-	vmath::vec3 view_position = vmath::vec3(cXpos, 0.0f, cZpos);
-	if (f - timeElapsed > 0.01) {
-#pragma region Camera positioning with key detection
-		timeElapsed = f;
-		if (dirPress[4]) {
-			lookingAngle += 2.0f;
+	sprites.init();
+	recorder.init(&workers, "capture\\");
+
+	if (bench.active()) {
+		if (!bench.path_file.empty()) {
+			bench.load_path();
+		}
+		else {
+			//Walk from the start to the trophy through the collision grid
+			std::vector< std::pair<int, int> > cells;
+			if (benchmark::find_path(_level, _width, _height,
+				convert_to_coord(cZpos, _height), convert_to_coord(cXpos, _width),
+				convert_to_coord(endZpos, _height), convert_to_coord(endXpos, _width), cells)) {
+				std::vector<vmath::vec3> waypoints;
+				for (size_t i = 0; i < cells.size(); i++)
+					waypoints.push_back(vmath::vec3((float)(cells[i].second * 2 - _width), 0.0f, (float)(cells[i].first * 2 - _height)));
+				bench.set_path(waypoints);
+			}
 		}
-		if (dirPress[5]) {
-			lookingAngle -= 2.0f;
+		if (!bench.has_path() && !input.replaying()) {
+			std::cout << "error: no camera path for the benchmark" << std::endl;
+			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+		setVsync(false);
+		gpu.visible = false;
+		bench.measure_kernels();
+		bench.measure_collision(_level, _width, _height);
+		bench.measure_spatial_index(_level, _width, _height);
+		bench.measure_agents(_level, _width, _height, workers);
+		bench.measure_crowd(_level, _width, _height, _endr, _endc, workers);
+		bench.measure_png_encode("bin\\media\\textures\\wall.png");
+		//The textures loaded at startup
+		const char * textures[] = { "wall.png", "normal.png", "floor_normal.png", "grass_tex.png", "trophy.png" };
+		std::vector<std::string> texture_files;
+		for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); i++)
+			texture_files.push_back(std::string("bin\\media\\textures\\") + textures[i]);
+		bench.measure_png_decode(texture_files);
+	}
+}
 
-		rotationMatrix = vmath::rotate(lookingAngle, vmath::vec3(0.0f, 1.0f, 0.0f));
-		vmath::vec4 dir = vmath::vec4(direction[0], direction[1], direction[2], 1.0f) * rotationMatrix;
-		direction = vmath::vec3(dir[0], dir[1], dir[2]);
-		lookingAngle = 0.0f;
-		vmath::vec3 strafe = vmath::cross(direction, vmath::vec3(0.0f, 1.0f, 0.0f));
+void maze_render_app::shutdown()
+{
+	gpu.shutdown();
+	sprites.shutdown();
+	recorder.shutdown();
+	if (stream_textures)
+		streamer.shutdown();
+	walkers.end_step();
+	workers.stop();
+	input.stop_recording(sim_tick);
+
+	if (clampedFrames > 0)
+		std::cout << "simulation fell behind " << clampedFrames << " times and skipped " << droppedTime << " s" << std::endl;
+	if (verbose || bench.active()) {
+		//The same figures the F3 overlay shows, for runs nobody watched
+		const PACINGSTATS & paced = pacingStats();
+		char line[128];
+		format_line(line, sizeof(line), "frame pacing over the last %d frames: mean %.2f ms, jitter %.2f ms, worst %.2f ms, %d late",
+			pacingCount < pacingWindow ? pacingCount : pacingWindow, paced.meanMs, paced.jitterMs, paced.worstMs, paced.late);
+		std::cout << line << std::endl;
+	}
+}
 
-		float movespeed = 0.1f;
-		if (dirPress[0]) {
-			view_position += (direction * movespeed);
-		}
-		if (dirPress[1]) {
-			view_position += (strafe * movespeed);
-		}
-		if (dirPress[2]) {
-			view_position -= (direction * movespeed);
+void maze_render_app::update(double step)
+{
+	//Recorded input lands on the same tick it did when it was recorded
+	if (input.replaying()) {
+		input_log::event e;
+		while (input.next(sim_tick, e)) {
+			if (e.type == input_log::EVENT_KEY) {
+				apply_key(e.a, e.b);
+			}
+			else if (e.type == input_log::EVENT_MOUSE_MOVE) {
+				mouse_x = e.a;
+				mouse_y = e.b;
+			}
 		}
-		if (dirPress[3]) {
-			view_position -= (strafe * movespeed);
+		if (!bench.active() && input.replay_done(sim_tick)) {
+			std::cout << "replay finished after " << sim_tick << " steps" << std::endl;
+			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+	}
+
+	prevXpos = cXpos;
+	prevZpos = cZpos;
+	prev_direction = direction;
+
+#pragma region Camera positioning with key detection
+	if (dirPress[4]) {
+		lookingAngle += 2.0f;
+	}
+	if (dirPress[5]) {
+		lookingAngle -= 2.0f;
+	}
+
+	rotationMatrix = vmath::rotate(lookingAngle, vmath::vec3(0.0f, 1.0f, 0.0f));
+	vmath::vec4 dir = vmath::vec4(direction[0], direction[1], direction[2], 1.0f) * rotationMatrix;
+	direction = vmath::vec3(dir[0], dir[1], dir[2]);
+	lookingAngle = 0.0f;
+	vmath::vec3 strafe = vmath::cross(direction, vmath::vec3(0.0f, 1.0f, 0.0f));
+
+	vmath::vec3 new_position = vmath::vec3(cXpos, 0.0f, cZpos);
+	float movespeed = 0.1f;
+	if (dirPress[0]) {
+		new_position += (direction * movespeed);
+	}
+	if (dirPress[1]) {
+		new_position += (strafe * movespeed);
+	}
+	if (dirPress[2]) {
+		new_position -= (direction * movespeed);
+	}
+	if (dirPress[3]) {
+		new_position -= (strafe * movespeed);
+	}
 
-		cXpos = view_position[0];
-		cZpos = view_position[2];
 #pragma endregion
 
 #pragma region Collision detection
-		wall_collision(cXpos, cZpos, direction, _height, _width, _level);
-		view_position[0] = cXpos;
-		view_position[2] = cZpos;
+	{
+		PROFILE_ZONE("collision");
+		grid_collision::move(level_grid, player_radius, cXpos, cZpos, new_position[0] - cXpos, new_position[2] - cZpos);
+	}
 #pragma endregion
+
+	if (!trophy_found) {
+		triggers.for_each_near(cXpos, cZpos, trophy_reach, [this](spatial_index::handle) { trophy_found = true; });
+		if (trophy_found)
+			std::cout << "You found the trophy!" << std::endl;
 	}
 
+	agents.update((float)step, workers);
+
+	//The crowd steps in the background until the next update()
+	if (walkers.size() > 0)
+		walkers.begin_step((float)step, workers);
+
+	sim_tick++;
+}
+
+void maze_render_app::render(double currentTime)
+{
+	static const GLfloat zeros[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	static const GLfloat gray[] = { 0.1f, 0.1f, 0.1f, 0.0f };
+	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+	static const GLfloat skyBlue[] = { 0.529f, 0.808f, 0.922f };
+	static const GLfloat ones[] = { 1.0f };
+
+	if (stream_textures)
+		streamer.update();
+
+	if (bench.active())
+		benchmark_frame();
+	
+	//Blend the last two simulation steps so motion is smooth at any frame rate
+	float alpha = (float)simulationAlpha;
+	vmath::vec3 view_position = vmath::vec3(prevXpos + (cXpos - prevXpos) * alpha, 0.0f, prevZpos + (cZpos - prevZpos) * alpha);
+	vmath::vec3 view_direction = vmath::normalize(prev_direction + (direction - prev_direction) * alpha);
+
 	vmath::vec3 light_pos = vmath::vec3(view_position[0], lightY, view_position[2]);
 
 	// Set up view and perspective matrix
 	vmath::mat4 view_matrix = vmath::lookat(view_position,
-		view_position + direction,
+		view_position + view_direction,
 		vmath::vec3(0.0f, 1.0f, 0.0f));
 	view_matrix *= translationMatrix;
 
@@ -332,6 +748,22 @@ void maze_render_app::render(double currentTime)
 	uniforms_block* block;
 	vmath::mat4 model_matrix;
 
+	gpu.begin_frame();
+
+	//An idle frame redraws the water over the last full one taken before the
+	//grass, then the grass and sprites over it. Depth is kept too, so only
+	//pixels where the water was in front of the walls pass the depth test,
+	//and frame_tex still holds the reflection.
+	if (idleFrame && scene_cached) {
+		copy_frame(scene_cache_buf, output_buf);
+		glViewport(0, 0, info.windowWidth, info.windowHeight);
+		glEnable(GL_DEPTH_TEST);
+		draw_water(view_matrix, perspective_matrix, currentTime);
+		draw_see_through(view_matrix, perspective_matrix, light_pos);
+		finish_frame();
+		return;
+	}
+
 	glBindFramebuffer(GL_FRAMEBUFFER, frame_buf);
 
 	glViewport(0, 0, viewport_w, viewport_h);
@@ -340,7 +772,12 @@ void maze_render_app::render(double currentTime)
 	glEnable(GL_DEPTH_TEST);
 
 #pragma region Wall Reflection Rendering
-	glUseProgram(walls_program);
+	gpu.begin("reflect walls");
+	PROFILE_BEGIN("reflect walls");
+	glUseProgram(walls_reflected_program);
+
+	glUniform1i(glGetUniformLocation(walls_reflected_program, "tex"), 0);
+	glUniform1i(glGetUniformLocation(walls_reflected_program, "bump_map"), 1);
 
 	glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
 	glBindTexture(GL_TEXTURE_2D, wall_tex_buffer);
@@ -361,9 +798,8 @@ void maze_render_app::render(double currentTime)
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
 	//Draw walls
-	glUniform4f(glGetUniformLocation(walls_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
-	glUniform1f(glGetUniformLocation(walls_program, "reflecting"), -1.0f);
-	glUniform1f(glGetUniformLocation(walls_program, "time"), currentTime);
+	glUniform4f(glGetUniformLocation(walls_reflected_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
+	glUniform1f(glGetUniformLocation(walls_reflected_program, "time"), currentTime);
 
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
 	block = (uniforms_block *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms_block), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
@@ -378,20 +814,23 @@ void maze_render_app::render(double currentTime)
 
 	//change_settings(1, 1, 0, 0);
 	glCullFace(GL_BACK);
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+	draw_arrays(GL_TRIANGLES, 0, vertices.size());
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
 	//End Walls
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
 
 #pragma region Grass Reflection rendering
-	glUseProgram(grass_program);
+	gpu.begin("reflect grass");
+	PROFILE_BEGIN("reflect grass");
+	glUseProgram(grass_reflected_program);
 
-	glUniform1i(glGetUniformLocation(grass_program, "grass"), 2);
+	glUniform1i(glGetUniformLocation(grass_reflected_program, "grass"), 2);
 	glActiveTexture(GL_TEXTURE0 + 2); // Texture unit 2
 	glBindTexture(GL_TEXTURE_2D, grass_tex);
 
-	glUniform4f(glGetUniformLocation(grass_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
-	glUniform1f(glGetUniformLocation(grass_program, "reflecting"), -1.0f);
+	glUniform4f(glGetUniformLocation(grass_reflected_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
 
 	glBindVertexArray(grass_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, grass_buffer);
@@ -413,22 +852,35 @@ void maze_render_app::render(double currentTime)
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	glDrawArrays(GL_TRIANGLES, 0, grass_points.size());
+	draw_arrays(GL_TRIANGLES, 0, grass_points.size());
 
 	glDisable(GL_BLEND);
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
 
-#pragma region Trophy sprite reflection
-	glUseProgram(sprite_program);
-
-	glUniform1i(glGetUniformLocation(sprite_program, "tex"), 4);
-	glActiveTexture(GL_TEXTURE0 + 4); // Texture unit 4
-	glBindTexture(GL_TEXTURE_2D, trophy_tex);
+#pragma region Collect sprites
+	//The trophy and the crowd, sorted for the main camera and used for both passes
+	{
+		PROFILE_ZONE("collect sprites");
+		sprites.begin();
+		sprites.add(trophy_tex, sprite_batch::BLEND_ALPHA, vmath::vec3(endXpos, 0.0f, endZpos), trophy_scale);
+		const crowd::snapshot * walking = walkers.latest();
+		if (walking != NULL) {
+			for (size_t i = 0; i < walking->x.size(); i++) {
+				sprites.add(trophy_tex, sprite_batch::BLEND_CUTOUT, vmath::vec3(walking->x[i], crowd_scale - 1.0f, walking->z[i]),
+					crowd_scale, vmath::vec4(0.0f, 0.0f, 1.0f, 1.0f), crowd_tint);
+			}
+		}
+		sprites.upload(view_matrix);
+	}
+#pragma endregion
 
-	glUniform3f(glGetUniformLocation(sprite_program, "pos"), endXpos, 0.0f, endZpos);
-	glUniform1f(glGetUniformLocation(sprite_program, "scalar"), trophy_scale);
-	glUniform1f(glGetUniformLocation(sprite_program, "reflecting"), -1.0f);
+#pragma region Sprite reflections
+	gpu.begin("reflect sprites");
+	PROFILE_BEGIN("reflect sprites");
+	glUseProgram(sprite_reflected_program);
 
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
 	block = (uniforms_block *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms_block), GL_MAP_WRITE_BIT);
@@ -441,14 +893,13 @@ void maze_render_app::render(double currentTime)
 	block->proj_matrix = perspective_matrix;
 
 	glCullFace(GL_FRONT);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisable(GL_BLEND);
+	draw_sprites(sprite_reflected_program);
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, output_buf);
 	glViewport(0, 0, info.windowWidth, info.windowHeight);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -456,47 +907,12 @@ void maze_render_app::render(double currentTime)
 
 	//Draw everything normal now
 #pragma region Floor Rendering (water)
-	glUseProgram(floor_program);
-	
-	glUniform1i(glGetUniformLocation(floor_program, "floor_tex"), 3);
-	glActiveTexture(GL_TEXTURE0 + 3); // Texture unit
-	glBindTexture(GL_TEXTURE_2D, frame_tex);
-	
-	glBindVertexArray(floor_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, fbuffer);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, fnormal_buffer);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, ftc_buffer);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glUniform2f(glGetUniformLocation(floor_program, "window_size"), (float)info.windowWidth, (float)info.windowHeight);
-	glUniform1f(glGetUniformLocation(floor_program, "curr_time"), currentTime);
-
-	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
-	block = (uniforms_block *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms_block), GL_MAP_WRITE_BIT);
-
-	//model_matrix =
-	//	vmath::scale(1.0f);
-
-	block->mv_matrix = view_matrix;// *model_matrix;
-	block->view_matrix = view_matrix;
-	block->proj_matrix = perspective_matrix;
-
-	//change_settings(1, 1, 0, 0);
-	glCullFace(GL_FRONT);
-	//glEnable(GL_BLEND);
-	glDrawArrays(GL_TRIANGLES, 0, fvertices.size());
-	//glDisable(GL_BLEND);
-	glUnmapBuffer(GL_UNIFORM_BUFFER);
-	#pragma endregion
+	draw_water(view_matrix, perspective_matrix, currentTime);
+#pragma endregion
 
 #pragma region Wall Render
+	gpu.begin("walls");
+	PROFILE_BEGIN("walls");
 	//Walls
 	glUseProgram(walls_program);
 
@@ -523,7 +939,6 @@ void maze_render_app::render(double currentTime)
 
 	//Draw walls
 	glUniform4f(glGetUniformLocation(walls_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
-	glUniform1f(glGetUniformLocation(walls_program, "reflecting"), 1.0f);
 	glUniform1f(glGetUniformLocation(walls_program, "time"), currentTime);
 
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
@@ -538,12 +953,38 @@ void maze_render_app::render(double currentTime)
 
 	//change_settings(1, 1, 0, 0);
 	glCullFace(GL_FRONT);
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+	draw_arrays(GL_TRIANGLES, 0, vertices.size());
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
 	//End Walls
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
 
+	//Keep the frame when the next one is likely idle, so it only has to
+	//redraw the water and what is drawn over it. Grass writes depth where it
+	//is see-through, so the cache is taken before it or the water under it
+	//would fail the depth test and stay still.
+	scene_cached = scene_cache_buf != 0 && idle();
+	if (scene_cached) {
+		copy_frame(output_buf, scene_cache_buf);
+		glBindFramebuffer(GL_FRAMEBUFFER, output_buf);
+	}
+
+	draw_see_through(view_matrix, perspective_matrix, light_pos);
+
+	finish_frame();
+}
+
+//Grass and sprites over the walls and water, blended or cut out where they
+//are see-through, so they go after the water whenever it is redrawn
+void maze_render_app::draw_see_through(const vmath::mat4 & view_matrix, const vmath::mat4 & perspective_matrix, const vmath::vec3 & light_pos)
+{
+	uniforms_block* block;
+	vmath::mat4 model_matrix;
+
 #pragma region Grass rendering
+	gpu.begin("grass");
+	PROFILE_BEGIN("grass");
 	glUseProgram(grass_program);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -553,7 +994,6 @@ void maze_render_app::render(double currentTime)
 	glBindTexture(GL_TEXTURE_2D, grass_tex);
 
 	glUniform4f(glGetUniformLocation(grass_program, "light_pos"), light_pos[0], light_pos[1], light_pos[2], 1.0f);
-	glUniform1f(glGetUniformLocation(grass_program, "reflecting"), 1.0f);
 
 	glBindVertexArray(grass_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, grass_buffer);
@@ -571,22 +1011,18 @@ void maze_render_app::render(double currentTime)
 	block->proj_matrix = perspective_matrix;
 
 	glCullFace(GL_FRONT);
-	glDrawArrays(GL_TRIANGLES, 0, grass_points.size());
+	draw_arrays(GL_TRIANGLES, 0, grass_points.size());
 	glDisable(GL_BLEND);
 	//glEnable(GL_DEPTH_TEST);
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
 
-#pragma region Render trophy sprite
+#pragma region Render sprites
+	gpu.begin("sprites");
+	PROFILE_BEGIN("sprites");
 	glUseProgram(sprite_program);
-	
-	glUniform1i(glGetUniformLocation(sprite_program, "tex"), 4);
-	glActiveTexture(GL_TEXTURE0 + 4); // Texture unit 4
-	glBindTexture(GL_TEXTURE_2D, trophy_tex);
-
-	glUniform3f(glGetUniformLocation(sprite_program, "pos"), endXpos, 0.0f, endZpos);
-	glUniform1f(glGetUniformLocation(sprite_program, "scalar"), trophy_scale);
-	glUniform1f(glGetUniformLocation(sprite_program, "reflecting"), 1.0f);
 
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
 	block = (uniforms_block *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms_block), GL_MAP_WRITE_BIT);
@@ -599,16 +1035,196 @@ void maze_render_app::render(double currentTime)
 	block->proj_matrix = perspective_matrix;
 
 	glCullFace(GL_FRONT);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisable(GL_BLEND);
+	draw_sprites(sprite_program);
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	PROFILE_END();
+	gpu.end();
 #pragma endregion
+}
+
+void maze_render_app::draw_water(const vmath::mat4 & view_matrix, const vmath::mat4 & perspective_matrix, double currentTime)
+{
+	uniforms_block* block;
+
+	gpu.begin("water");
+	PROFILE_BEGIN("water");
+	glUseProgram(floor_program);
+	
+	glUniform1i(glGetUniformLocation(floor_program, "floor_tex"), 3);
+	glActiveTexture(GL_TEXTURE0 + 3); // Texture unit
+	glBindTexture(GL_TEXTURE_2D, frame_tex);
+	
+	glBindVertexArray(floor_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, fbuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, fnormal_buffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, ftc_buffer);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glUniform2f(glGetUniformLocation(floor_program, "window_size"), (float)info.windowWidth, (float)info.windowHeight);
+	glUniform1f(glGetUniformLocation(floor_program, "curr_time"), currentTime);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniforms_buffer);
+	block = (uniforms_block *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, sizeof(uniforms_block), GL_MAP_WRITE_BIT);
+
+	//model_matrix =
+	//	vmath::scale(1.0f);
+
+	block->mv_matrix = view_matrix;// *model_matrix;
+	block->view_matrix = view_matrix;
+	block->proj_matrix = perspective_matrix;
+
+	//change_settings(1, 1, 0, 0);
+	glCullFace(GL_FRONT);
+	//glEnable(GL_BLEND);
+	draw_arrays(GL_TRIANGLES, 0, fvertices.size());
+	//glDisable(GL_BLEND);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	PROFILE_END();
+	gpu.end();
+}
+
+void maze_render_app::copy_frame(GLuint from, GLuint to)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+	glBlitFramebuffer(0, 0, info.windowWidth, info.windowHeight, 0, 0, info.windowWidth, info.windowHeight,
+		GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, to);
+}
+
+void maze_render_app::resize_window_buffers(int width, int height)
+{
+	if (output_buf != 0) {
+		glBindRenderbuffer(GL_RENDERBUFFER, output_color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, output_depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	}
+	if (scene_cache_buf != 0) {
+		glBindRenderbuffer(GL_RENDERBUFFER, scene_cache_color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, scene_cache_depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	//The next frame is drawn in full and caches the scene again
+	scene_cached = false;
+}
+
+void maze_render_app::finish_frame()
+{
+	gpu.end_frame();
+
+	//Before the HUD so it doesn't end up in the recording
+	if (capture_source == CAPTURE_FRAME)
+		recorder.capture(output_buf, output_buf == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0, info.windowWidth, info.windowHeight);
+	else if (capture_source == CAPTURE_REFLECTION)
+		recorder.capture(frame_buf, GL_COLOR_ATTACHMENT0, viewport_w, viewport_h);
+	recorder.update();
+
+	const PACINGSTATS & paced = pacingStats();
+	//One HUD row, the overlay is 32 columns
+	char line[33];
+	format_line(line, sizeof(line), "frame %6.2f ms  worst %6.2f", paced.meanMs, paced.worstMs);
+	gpu.hud_line(line);
+	format_line(line, sizeof(line), "jitter %5.2f ms  late %d", paced.jitterMs, paced.late);
+	gpu.hud_line(line);
+	format_line(line, sizeof(line), "vsync %s  cap %g  low lat %s", info.flags.vsync ? "on" : "off", info.frameRateCap, info.flags.lowLatency ? "on" : "off");
+	gpu.hud_line(line);
+	if (clampedFrames > 0) {
+		format_line(line, sizeof(line), "sim behind %d  lost %.2f s", clampedFrames, droppedTime);
+		gpu.hud_line(line);
+	}
+	gpu.draw_hud();
+
+	if (bench.active())
+		frame_cpu_ms = (cpu_profiler::now_ns() - cpu_start_ns) / 1000000.0;
+}
+
+//Standing still with nothing else moving: the water is the only thing that changes
+bool maze_render_app::idle()
+{
+	if (bench.active() || capture_source != CAPTURE_OFF || agents.size() > 0 || walkers.size() > 0)
+		return false;
+	if (stream_textures && streamer.pending() > 0)
+		return false;
+	for (int i = 0; i < 6; i++) {
+		if (dirPress[i])
+			return false;
+	}
+	return cXpos == prevXpos && cZpos == prevZpos &&
+		direction[0] == prev_direction[0] && direction[1] == prev_direction[1] && direction[2] == prev_direction[2];
+}
+
+void maze_render_app::draw_arrays(GLenum mode, GLint first, GLsizei count) {
+	glDrawArrays(mode, first, count);
+	frame_draw_calls++;
+	frame_vertices += count;
+}
+
+void maze_render_app::draw_sprites(GLuint program) {
+	sprites.draw(program, 4);
+	frame_draw_calls += (int)sprites.draw_calls();
+	frame_vertices += (int)sprites.size() * 6;
+}
+
+void maze_render_app::benchmark_frame() {
+	double now = glfwGetTime();
 
+	//Close out the previous frame now that its swap has returned
+	if (frame_start > 0.0) {
+		bench.add_frame((now - frame_start) * 1000.0, frame_cpu_ms, frame_draw_calls, frame_vertices);
+		if (gpu.collected_frames() != bench_gpu_frames) {
+			bench_gpu_frames = gpu.collected_frames();
+			bench.add_gpu(gpu.last_frame_ms());
+		}
+	}
+	frame_start = now;
+	frame_draw_calls = 0;
+	frame_vertices = 0;
+	cpu_start_ns = cpu_profiler::now_ns();
+
+	if (bench.finished() || input.replay_done(sim_tick)) {
+		for (size_t i = 0; i < gpu.pass_count(); i++)
+			bench.add_pass(gpu.pass_name(i), gpu.pass_mean_ms(i));
+		const PACINGSTATS & paced = pacingStats();
+		bench.set_pacing(paced.meanMs, paced.jitterMs, paced.worstMs, paced.late, clampedFrames, droppedTime);
+		bench.write_report((const char *)glGetString(GL_RENDERER), info.windowWidth, info.windowHeight);
+		glfwSetWindowShouldClose(window, GL_TRUE);
+		return;
+	}
+
+	//A replay steps once per frame, so frame n shows the same state on any machine
+	if (input.replaying()) {
+		update(input.settings().step);
+		return;
+	}
+
+	vmath::vec3 position, dir;
+	bench.camera(bench.frame(), position, dir);
+	cXpos = prevXpos = position[0];
+	cZpos = prevZpos = position[2];
+	direction = prev_direction = dir;
 }
 
 void maze_render_app::onKey(int key, int action)
+{
+	//While replaying, the recording does the walking
+	bool moves = key == 'W' || key == 'A' || key == 'S' || key == 'D' || key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT;
+	if (input.replaying() && moves)
+		return;
+	input.key(sim_tick, key, action);
+	apply_key(key, action);
+}
+
+void maze_render_app::apply_key(int key, int action)
 {
 	// Check to see if key was pressed
 	if (action == GLFW_PRESS)
@@ -632,6 +1248,32 @@ void maze_render_app::onKey(int key, int action)
 			case GLFW_KEY_LEFT:
 				dirPress[5] = true;
 				break;
+			case GLFW_KEY_F3:
+				gpu.visible = !gpu.visible;
+				break;
+			case GLFW_KEY_F7:
+				setVsync(!info.flags.vsync);
+				break;
+			case GLFW_KEY_F5:
+			case GLFW_KEY_F6: {
+				capture_mode mode = (key == GLFW_KEY_F5) ? CAPTURE_FRAME : CAPTURE_REFLECTION;
+				capture_source = (capture_source == mode) ? CAPTURE_OFF : mode;
+				std::cout << (capture_source == CAPTURE_OFF ? "capture stopped, " : "capture started, ")
+					<< recorder.frames_queued() << " frames so far, " << recorder.dropped() << " dropped, "
+					<< recorder.throttles() << " waited for the encoders" << std::endl;
+				break;
+			}
+			case GLFW_KEY_F4:
+				if (!cpu_profiler::capturing()) {
+					cpu_profiler::start();
+					std::cout << "CPU capture started" << std::endl;
+				}
+				else {
+					cpu_profiler::stop();
+					if (cpu_profiler::write_trace(cpu_trace_file))
+						std::cout << "wrote " << cpu_trace_file << std::endl;
+				}
+				break;
 			default:
 				break;
 		}
@@ -671,9 +1313,29 @@ void maze_render_app::onMouseButton(int button, int action)
 
 }
 
-void maze_render_app::onMouseMove(int x, int y)
+void maze_render_app::beginStage(const char * name)
 {
+	PROFILE_BEGIN(name);
+}
 
+void maze_render_app::endStage()
+{
+	PROFILE_END();
+}
+
+void maze_render_app::onResize(int w, int h)
+{
+	sb7::application::onResize(w, h);
+	resize_window_buffers(w, h);
+}
+
+void maze_render_app::onMouseMove(int x, int y)
+{
+	if (input.replaying())
+		return;
+	input.mouse_move(sim_tick, x, y);
+	mouse_x = x;
+	mouse_y = y;
 }
 
 // Modified from tutorial at the following website:
@@ -693,56 +1355,52 @@ vmath::vec3 maze_render_app::getArcballVector(int x, int y) {
 	return vecP;
 }
 
+void maze_render_app::load_texture(std::string filename, GLuint * tex_buf) {
+	if (stream_textures)
+		streamer.request(filename, tex_buf);
+	else
+		load_image(filename, tex_buf);
+}
+
 //Method to load png images from disk to texture
 void maze_render_app::load_image(std::string filename, GLuint * tex_buf) {
+	//Upload from the mapped texture cache, only decoding the png when it changed
+	if (texture_cache::load(filename, use_compressed_textures, tex_buf))
+		return;
+
+	//Cache unavailable, decode and upload directly
 	std::vector<unsigned char> image;
 	unsigned iwidth, iheight;
 	unsigned err = lodepng::decode(image, iwidth, iheight, filename);
 	if (err != 0) {
 		std::cout << "error" << err << ": " << lodepng_error_text(err) << std::endl;
+		return;
 	}
-	size_t u2 = 1, v2 = 1;
-	while (u2 < iwidth) u2 *= 2;
-	while (v2 < iheight) v2 *= 2;
-	double u3 = (double)iwidth / u2;
-	double v3 = (double)iheight / v2;
-
-	std::vector<unsigned char> tex(u2*v2 * 4);
-	for (size_t y = 0; y < iheight; y++)
-	for (size_t x = 0; x < iwidth; x++)
-	for (size_t c = 0; c < 4; c++) {
-		tex[4 * u2*y + 4 * x + c] = image[4 * iwidth*y + 4 * x + c];
-	}
-	
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+
 	glGenTextures(1, tex_buf);
 	glBindTexture(GL_TEXTURE_2D, *tex_buf);
 	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, iwidth, iheight);
-	
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
 	glTexSubImage2D(GL_TEXTURE_2D,  // 2D texture
 		0,					// Level 0
 		0, 0,				// Offset 0, 0
-		iwidth, iheight,    // 256 x 256 texels, replace entire image
+		iwidth, iheight,    // replace entire image
 		GL_RGBA,			// Four channel data
 		GL_UNSIGNED_BYTE,   // data type
-		&tex[0]);
+		&image[0]);
 }
 
-bool maze_render_app::load_shader(GLuint & prog, char* vert_file, char* frag_file) {
-	GLuint vert_shader = sb7::shader::load(vert_file, GL_VERTEX_SHADER);
-	GLuint frag_shader = sb7::shader::load(frag_file, GL_FRAGMENT_SHADER);
-	glAttachShader(prog, vert_shader);
-	glAttachShader(prog, frag_shader);
-	glLinkProgram(prog);
+bool maze_render_app::load_shader(GLuint & prog, const char* vert_file, const char* frag_file) {
+	return program_cache::load(prog, vert_file, frag_file);
+}
 
-	glDetachShader(prog, vert_shader);
-	glDetachShader(prog, frag_shader);
-	glDeleteShader(vert_shader);
-	glDeleteShader(frag_shader);
+bool maze_render_app::load_variants(GLuint & prog, GLuint & reflected_prog, const char* vert_file, const char* frag_file) {
+	shader_variant::define_list reflected;
+	reflected.push_back("REFLECTED");
 
-	GLint success = 0;
-	glGetProgramiv(prog, GL_LINK_STATUS, &success);
-	return (success != GL_FALSE);
+	bool res = shader_variant::load(prog, vert_file, frag_file, "normal", shader_variant::define_list(), &std::cout);
+	return shader_variant::load(reflected_prog, vert_file, frag_file, "reflected", reflected, &std::cout) && res;
 }
 
 //http://stackoverflow.com/questions/4711238/using-ifstream-as-fscanf
@@ -861,7 +1519,11 @@ bool maze_render_app::load_object(std::string filename, std::vector<vmath::vec4>
 	return true;
 }
 
-void maze_render_app::generate_grass(int** level, int width, int height, std::vector< vmath::vec3 > & out_grass) {
+void maze_render_app::generate_grass(int** level, int width, int height, unsigned seed, std::vector< vmath::vec3 > & out_grass) {
+	//Its own generator, this runs on a worker. Scaled by hand since the
+	//standard distributions differ between libraries.
+	std::mt19937 rng(seed);
+	const float scale = 1.0f / 4294967296.0f;
 	for (int r = 0; r < height; r++) {
 		for (int c = 0; c < width; c++) {
 			if (level[r][c] == 0) {
@@ -869,8 +1531,8 @@ void maze_render_app::generate_grass(int** level, int width, int height, std::ve
 				float col = convert_to_vert(c, width);
 				for (float n = 0.0f; n < grass_blades; n++) {
 					for (float m = 0.0f; m < grass_blades; m++) {
-						float x = (n / grass_blades) + (static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
-						float z = (m / grass_blades) + (static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
+						float x = (n / grass_blades) + rng() * scale;
+						float z = (m / grass_blades) + rng() * scale;
 						out_grass.push_back(vmath::vec3(x + col, 0.0f, z + row));
 						out_grass.push_back(vmath::vec3(x + col, 0.0f, z + row));
 						out_grass.push_back(vmath::vec3(x + col, 0.0f, z + row));
@@ -891,51 +1553,3 @@ float maze_render_app::convert_to_vert(int coord, int dim) {
 int maze_render_app::convert_to_coord(float pos, int dim) {
 	return (floor(pos + 1.0f) + dim) / 2;
 }
-
-//This is awful
-void maze_render_app::wall_collision(float & xPos, float & zPos, vmath::vec3 direction, int height, int width, int** level) {
-	vmath::vec3 cr = vmath::cross(direction, vmath::vec3(0.0, 1.0, 0.0));
-	vmath::vec3 curr = vmath::vec3(xPos, 0.0f, zPos);
-	float scalar = 0.30f;
-	std::vector< vmath::vec3 > dirs;
-	dirs.push_back(curr + (direction*scalar));
-	dirs.push_back(curr - (direction*scalar));
-	dirs.push_back(curr + (cr*scalar));
-	dirs.push_back(curr - (cr*scalar));
-	//cast into 4 directions, make sure none collide
-	for (int i = 0; i < 4; i++) {
-		vmath::vec3 point = dirs[i];
-		float x = point[0];
-		float z = point[2];
-
-		int row = maze_render_app::convert_to_coord(z, height);
-		int col = maze_render_app::convert_to_coord(x, width);
-		if (level[row][col] == 1) {
-			//collision, need to resolve
-			float xdiff = x - floor(x);
-			float zdiff = z - floor(z);
-
-			float xdiff2 = xdiff - 1.0f;
-			float zdiff2 = zdiff - 1.0f;
-
-			float xsmal = (xdiff < abs(xdiff2)) ? xdiff : xdiff2;
-			float zsmal = (zdiff < abs(zdiff2)) ? zdiff : zdiff2;
-
-			if (abs(xsmal) > abs(zsmal)) {
-				//eject out to nearest col
-				xPos -= xsmal;
-				break;
-			}
-			else {
-				//nearest row
-				zPos -= zsmal;
-				break;
-			}
-		}
-		else if (level[row][col] == 3) {
-			//you win
-		}
-	}
-}
-
-DECLARE_MAIN(maze_render_app)
\ No newline at end of file
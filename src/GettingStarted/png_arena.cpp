@@ -0,0 +1,157 @@
+#include "png_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread_pool.h"
+
+//lodepng.cpp declares these itself when built with LODEPNG_NO_COMPILE_ALLOCATORS
+void * lodepng_malloc(size_t size);
+void * lodepng_realloc(void * ptr, size_t new_size);
+void lodepng_free(void * ptr);
+
+//Every block starts with its size and whether it was counted against the
+//arena, padded so blocks stay 16 byte aligned. Blocks that don't fit in the
+//arena come from malloc with the same header.
+struct block_header
+{
+	size_t size;
+	size_t counted;
+};
+static const size_t header_size = 16;
+static const size_t grow_granularity = 1 << 20;
+
+//__declspec(thread) can't run constructors, so the arena is plain zeroed data
+static THREAD_LOCAL unsigned char * arena_base;
+static THREAD_LOCAL size_t arena_size;
+static THREAD_LOCAL size_t arena_used;
+//Bytes of counted blocks that had to come from malloc, and the most the
+//arena plus those ever held during the current scope
+static THREAD_LOCAL size_t overflow_used;
+static THREAD_LOCAL size_t demand_peak;
+static THREAD_LOCAL unsigned arena_depth;
+
+static size_t block_size(size_t size)
+{
+	return header_size + ((size + 15) & ~(size_t)15);
+}
+
+static block_header * header_of(void * ptr)
+{
+	return (block_header *)((unsigned char *)ptr - header_size);
+}
+
+static bool in_arena(const void * ptr)
+{
+	const unsigned char * p = (const unsigned char *)ptr;
+	return arena_base != NULL && p >= arena_base && p < arena_base + arena_size;
+}
+
+//The block that ends at the bump pointer can grow, shrink and be popped in place
+static bool is_last(void * ptr)
+{
+	return (unsigned char *)header_of(ptr) + block_size(header_of(ptr)->size) == arena_base + arena_used;
+}
+
+static void note_demand()
+{
+	if (arena_used + overflow_used > demand_peak)
+		demand_peak = arena_used + overflow_used;
+}
+
+void * lodepng_malloc(size_t size)
+{
+	size_t total = block_size(size);
+	block_header * block;
+
+	if (arena_depth > 0 && arena_used + total <= arena_size) {
+		block = (block_header *)(arena_base + arena_used);
+		block->counted = 1;
+		arena_used += total;
+	}
+	else {
+		block = (block_header *)malloc(total);
+		if (block == NULL)
+			return NULL;
+		block->counted = arena_depth > 0;
+		if (block->counted)
+			overflow_used += total;
+	}
+	block->size = size;
+	note_demand();
+	return (unsigned char *)block + header_size;
+}
+
+void lodepng_free(void * ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	block_header * block = header_of(ptr);
+	if (in_arena(ptr)) {
+		//Everything else goes when the scope closes
+		if (is_last(ptr))
+			arena_used -= block_size(block->size);
+		return;
+	}
+
+	if (block->counted && arena_depth > 0)
+		overflow_used -= block_size(block->size);
+	free(block);
+}
+
+void * lodepng_realloc(void * ptr, size_t new_size)
+{
+	if (ptr == NULL)
+		return lodepng_malloc(new_size);
+
+	block_header * block = header_of(ptr);
+	if (in_arena(ptr) && is_last(ptr)) {
+		size_t end = ((unsigned char *)block - arena_base) + block_size(new_size);
+		if (end <= arena_size) {
+			block->size = new_size;
+			arena_used = end;
+			note_demand();
+			return ptr;
+		}
+	}
+
+	void * moved = lodepng_malloc(new_size);
+	if (moved == NULL)
+		return NULL;
+	memcpy(moved, ptr, block->size < new_size ? block->size : new_size);
+	lodepng_free(ptr);
+	return moved;
+}
+
+namespace png_arena
+{
+
+scope::scope()
+{
+	arena_depth++;
+}
+
+scope::~scope()
+{
+	if (--arena_depth > 0)
+		return;
+
+	//Grow to what the last decode needed, while nothing lives in the arena
+	if (demand_peak > arena_size) {
+		size_t wanted = (demand_peak + grow_granularity - 1) / grow_granularity * grow_granularity;
+		free(arena_base);
+		arena_base = (unsigned char *)malloc(wanted);
+		arena_size = arena_base != NULL ? wanted : 0;
+	}
+	arena_used = 0;
+	overflow_used = 0;
+	demand_peak = 0;
+}
+
+size_t capacity()
+{
+	return arena_size;
+}
+
+}
@@ -0,0 +1,35 @@
+#ifndef __PNG_ARENA_H__
+#define __PNG_ARENA_H__
+
+#include <stddef.h>
+
+//Backing store for lodepng's allocations. The project builds lodepng with
+//LODEPNG_NO_COMPILE_ALLOCATORS and png_arena.cpp defines lodepng_malloc,
+//lodepng_realloc and lodepng_free. While a scope is open on a thread, the
+//inflate and scanline buffers lodepng asks for on that thread are bumped out
+//of the thread's arena and all released at once when the scope closes.
+//Outside a scope they come from malloc as usual.
+//The arena keeps its memory and grows to the largest decode it has seen, so
+//after the first few textures decoding allocates nothing.
+namespace png_arena
+{
+
+//Nothing lodepng allocates inside a scope may outlive it: declare the
+//lodepng::State after the scope so it is destroyed first.
+class scope
+{
+public:
+	scope();
+	~scope();
+
+private:
+	scope(const scope &);
+	scope & operator=(const scope &);
+};
+
+//Bytes reserved by the calling thread's arena
+size_t capacity();
+
+}
+
+#endif /* __PNG_ARENA_H__ */
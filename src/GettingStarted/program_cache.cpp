@@ -0,0 +1,169 @@
+#include "program_cache.h"
+
+#include <shader.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "texture_cache.h"
+
+namespace program_cache
+{
+
+static const unsigned program_magic = 0x4d505247; //"GRPM"
+
+//Written in front of the driver binary
+struct entry_header
+{
+	unsigned magic;
+	unsigned binary_format;
+	unsigned long long key;
+	unsigned binary_size;
+	unsigned reserved;
+};
+
+static std::string entry_name(const std::string & name)
+{
+	return std::string(texture_cache::cache_dir) + name + ".program";
+}
+
+static unsigned long long program_key(const std::string & vert_source, const std::string & frag_source)
+{
+	const char * strings[] = {
+		vert_source.c_str(),
+		frag_source.c_str(),
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION)
+	};
+
+	//Hash the terminators too so the parts can't run into each other
+	unsigned long long key = hash_bytes(NULL, 0);
+	for (int i = 0; i < 5; i++) {
+		const char * s = strings[i] != NULL ? strings[i] : "";
+		key = hash_bytes(s, strlen(s) + 1, key);
+	}
+	return key;
+}
+
+static bool link_status(GLuint prog)
+{
+	GLint success = 0;
+	glGetProgramiv(prog, GL_LINK_STATUS, &success);
+	return (success != GL_FALSE);
+}
+
+static bool load_binary(GLuint prog, const std::string & filename, unsigned long long key)
+{
+	mapped_file file;
+	if (!file.open(filename.c_str()) || file.size() < sizeof(entry_header))
+		return false;
+
+	entry_header header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != program_magic || header.key != key
+		|| header.binary_size != file.size() - sizeof(header))
+		return false;
+
+	glProgramBinary(prog, header.binary_format, file.data() + sizeof(header), header.binary_size);
+	return link_status(prog);
+}
+
+static void save_binary(GLuint prog, const std::string & filename, unsigned long long key)
+{
+	GLint length = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<unsigned char> binary(length);
+	GLenum binary_format = 0;
+	glGetProgramBinary(prog, length, &length, &binary_format, binary.data());
+
+	entry_header header;
+	header.magic = program_magic;
+	header.binary_format = binary_format;
+	header.key = key;
+	header.binary_size = (unsigned)length;
+	header.reserved = 0;
+
+	texture_cache::make_cache_dir();
+	FILE * file = fopen(filename.c_str(), "wb");
+	if (file == NULL) {
+		std::cout << "error: could not write program cache " << filename << std::endl;
+		return;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(binary.data(), 1, length, file);
+	fclose(file);
+}
+
+bool read_source(const char * filename, std::string & out_source)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file) {
+		std::cout << "error: could not open shader " << filename << std::endl;
+		return false;
+	}
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	out_source = ss.str();
+	return true;
+}
+
+bool link(GLuint prog, const std::string & name, const std::string & vert_source, const std::string & frag_source)
+{
+	//Drivers that can't hand back a binary still report zero formats
+	GLint format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	bool cacheable = format_count > 0;
+
+	unsigned long long key = 0;
+	std::string filename = entry_name(name);
+	if (cacheable) {
+		key = program_key(vert_source, frag_source);
+		if (load_binary(prog, filename, key))
+			return true;
+	}
+
+	//Miss, stale entry or a binary the driver rejected: build from source
+	GLuint vert_shader = sb7::shader::from_string(vert_source.c_str(), GL_VERTEX_SHADER);
+	GLuint frag_shader = sb7::shader::from_string(frag_source.c_str(), GL_FRAGMENT_SHADER);
+	glAttachShader(prog, vert_shader);
+	glAttachShader(prog, frag_shader);
+	if (cacheable)
+		glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(prog);
+
+	glDetachShader(prog, vert_shader);
+	glDetachShader(prog, frag_shader);
+	glDeleteShader(vert_shader);
+	glDeleteShader(frag_shader);
+
+	if (!link_status(prog))
+		return false;
+	if (cacheable)
+		save_binary(prog, filename, key);
+	return true;
+}
+
+bool load(GLuint prog, const char * vert_file, const char * frag_file)
+{
+	std::string vert_source, frag_source;
+	if (!read_source(vert_file, vert_source) || !read_source(frag_file, frag_source))
+		return false;
+
+	std::string name = vert_file;
+	size_t suffix = name.rfind("-vertex.glsl");
+	if (suffix != std::string::npos)
+		name = name.substr(0, suffix);
+	return link(prog, name, vert_source, frag_source);
+}
+
+}
@@ -0,0 +1,25 @@
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__
+
+#include <sb7.h>
+
+#include <string>
+
+//Driver program binaries kept in bin\media\cache\<name>.program. An entry is
+//keyed by a hash of both shader sources and the GL vendor, renderer and
+//version, so a shader edit or a driver update falls back to compiling.
+namespace program_cache
+{
+
+bool read_source(const char * filename, std::string & out_source);
+
+//Link prog from the two sources, loading the cached binary when it matches.
+//Must run on the GL thread.
+bool link(GLuint prog, const std::string & name, const std::string & vert_source, const std::string & frag_source);
+
+//Read, then link. name is the vertex shader's filename without "-vertex.glsl".
+bool load(GLuint prog, const char * vert_file, const char * frag_file);
+
+}
+
+#endif /* __PROGRAM_CACHE_H__ */
@@ -0,0 +1,230 @@
+#include "shader_variant.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <sstream>
+
+#include "program_cache.h"
+
+namespace shader_variant
+{
+
+std::string with_defines(const std::string & source, const define_list & defines)
+{
+	std::string block;
+	for (size_t i = 0; i < defines.size(); i++)
+		block += "#define " + defines[i] + "\n";
+
+	//#version has to stay the first statement in the file
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+		return block + source;
+	size_t line_end = source.find('\n', version);
+	if (line_end == std::string::npos)
+		return source + "\n" + block;
+	return source.substr(0, line_end + 1) + block + source.substr(line_end + 1);
+}
+
+#pragma region Vertex output scanner
+//Drop comments and lines switched off by the preprocessor
+static std::string active_text(const std::string & source, const define_list & defines)
+{
+	std::string text;
+	std::vector<bool> active(1, true);
+	bool in_block_comment = false;
+
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line)) {
+		std::string code;
+		for (size_t i = 0; i < line.size(); i++) {
+			if (in_block_comment) {
+				if (line.compare(i, 2, "*/") == 0) {
+					in_block_comment = false;
+					i++;
+				}
+			}
+			else if (line.compare(i, 2, "/*") == 0) {
+				in_block_comment = true;
+				i++;
+			}
+			else if (line.compare(i, 2, "//") == 0)
+				break;
+			else
+				code += line[i];
+		}
+
+		std::istringstream words(code);
+		std::string directive, name;
+		words >> directive >> name;
+		bool defined = std::find(defines.begin(), defines.end(), name) != defines.end();
+
+		if (directive == "#ifdef")
+			active.push_back(active.back() && defined);
+		else if (directive == "#ifndef")
+			active.push_back(active.back() && !defined);
+		else if (directive == "#else" && active.size() > 1)
+			active.back() = active[active.size() - 2] && !active.back();
+		else if (directive == "#endif" && active.size() > 1)
+			active.pop_back();
+		else if (directive.empty() || directive[0] != '#') {
+			if (active.back())
+				text += code + "\n";
+		}
+	}
+	return text;
+}
+
+static std::vector<std::string> tokenize(const std::string & text)
+{
+	std::vector<std::string> tokens;
+	size_t i = 0;
+	while (i < text.size()) {
+		if (isspace((unsigned char)text[i])) {
+			i++;
+		}
+		else if (isalnum((unsigned char)text[i]) || text[i] == '_') {
+			size_t start = i;
+			while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '.'))
+				i++;
+			tokens.push_back(text.substr(start, i - start));
+		}
+		else {
+			tokens.push_back(std::string(1, text[i]));
+			i++;
+		}
+	}
+	return tokens;
+}
+
+//Components and vec4 slots of one GLSL type, 0 if it isn't a plain type
+static void type_size(const std::string & type, unsigned & components, unsigned & locations)
+{
+	components = 0;
+	locations = 1;
+	if (type == "float" || type == "int" || type == "uint" || type == "bool") {
+		components = 1;
+	}
+	else if (type.size() == 4 && type.compare(0, 3, "vec") == 0) {
+		components = type[3] - '0';
+	}
+	else if (type.size() == 5 && (type.compare(1, 3, "vec") == 0)) {
+		components = type[4] - '0';
+	}
+	else if (type.compare(0, 3, "mat") == 0 && type.size() >= 4) {
+		unsigned columns = type[3] - '0';
+		unsigned rows = (type.size() == 6 && type[4] == 'x') ? (unsigned)(type[5] - '0') : columns;
+		components = columns * rows;
+		locations = columns;
+	}
+}
+
+//Add up a run of declarations such as "vec3 L ; float a , b [ 2 ] ;"
+static void add_declarations(const std::vector<std::string> & tokens, size_t begin, size_t end, interface_size & size)
+{
+	static const char * qualifiers[] = { "flat", "smooth", "noperspective", "centroid", "sample", "invariant", "out" };
+
+	size_t i = begin;
+	while (i < end) {
+		while (i < end && std::find(qualifiers, qualifiers + 7, tokens[i]) != qualifiers + 7)
+			i++;
+		if (i >= end)
+			break;
+
+		unsigned components, locations;
+		type_size(tokens[i++], components, locations);
+		while (i < end && tokens[i] != ";") {
+			if (tokens[i] == ",") {
+				i++;
+				continue;
+			}
+			unsigned count = 1;
+			if (i + 3 < end && tokens[i + 1] == "[" && tokens[i + 3] == "]") {
+				count = (unsigned)atoi(tokens[i + 2].c_str());
+				i += 3;
+			}
+			size.components += components * count;
+			size.locations += locations * count;
+			i++;
+		}
+		i++;
+	}
+}
+
+interface_size vertex_outputs(const std::string & source, const define_list & defines)
+{
+	interface_size size = { 0, 0 };
+	std::vector<std::string> tokens = tokenize(active_text(source, defines));
+
+	//Walk global statements, skipping function bodies
+	size_t start = 0;
+	int depth = 0;
+	for (size_t i = 0; i < tokens.size(); i++) {
+		if (tokens[i] == "{")
+			depth++;
+		else if (tokens[i] == "}")
+			depth--;
+		if (depth != 0)
+			continue;
+
+		bool statement_end = tokens[i] == ";";
+		bool body_end = tokens[i] == "}";
+		if (!statement_end && !body_end)
+			continue;
+
+		//Skip layout(...) and interpolation qualifiers to reach the storage qualifier
+		size_t s = start;
+		if (s < i && tokens[s] == "layout") {
+			while (s < i && tokens[s] != ")")
+				s++;
+			s++;
+		}
+		while (s < i && (tokens[s] == "flat" || tokens[s] == "smooth" || tokens[s] == "noperspective"
+			|| tokens[s] == "centroid" || tokens[s] == "invariant"))
+			s++;
+		bool is_output = s < i && tokens[s] == "out";
+
+		if (body_end && is_output)
+			continue; //interface block, wait for the instance name and ';'
+
+		if (statement_end && is_output) {
+			size_t open = std::find(tokens.begin() + s, tokens.begin() + i, "{") - tokens.begin();
+			if (open < i) {
+				size_t close = std::find(tokens.begin() + open, tokens.begin() + i, "}") - tokens.begin();
+				add_declarations(tokens, open + 1, close, size);
+			}
+			else {
+				add_declarations(tokens, s, i + 1, size);
+			}
+		}
+		start = i + 1;
+	}
+	return size;
+}
+#pragma endregion
+
+bool load(GLuint prog, const char * vert_file, const char * frag_file,
+	const char * variant, const define_list & defines, std::ostream * report)
+{
+	std::string vert_source, frag_source;
+	if (!program_cache::read_source(vert_file, vert_source) || !program_cache::read_source(frag_file, frag_source))
+		return false;
+
+	std::string name = vert_file;
+	size_t suffix = name.rfind("-vertex.glsl");
+	if (suffix != std::string::npos)
+		name = name.substr(0, suffix);
+	name += std::string(".") + variant;
+
+	if (report != NULL) {
+		interface_size size = vertex_outputs(vert_source, defines);
+		*report << name << ": " << size.components << " interpolants in "
+			<< size.locations << " locations" << std::endl;
+	}
+
+	return program_cache::link(prog, name,
+		with_defines(vert_source, defines), with_defines(frag_source, defines));
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef __SHADER_VARIANT_H__
+#define __SHADER_VARIANT_H__
+
+#include <sb7.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//Compile-time variants of a shader pair. Each variant is the same source with
+//a set of #defines injected after the #version line, so branches such as the
+//reflection flip are resolved by the preprocessor instead of a uniform.
+namespace shader_variant
+{
+
+typedef std::vector<std::string> define_list;
+
+//Copy of source with "#define NAME" lines inserted after #version
+std::string with_defines(const std::string & source, const define_list & defines);
+
+//What the vertex stage hands to the fragment stage
+struct interface_size
+{
+	unsigned components; //scalar interpolants
+	unsigned locations;  //vec4 slots
+};
+
+//Count the outputs of a vertex shader with the given defines active.
+//Understands #ifdef/#ifndef/#else/#endif and interface blocks, which is
+//all the shaders in this repo use.
+interface_size vertex_outputs(const std::string & source, const define_list & defines);
+
+//Build prog through the program cache as <vert name>.<variant>. When report
+//is set, one line with the interface size is written to it.
+bool load(GLuint prog, const char * vert_file, const char * frag_file,
+	const char * variant, const define_list & defines, std::ostream * report = NULL);
+
+}
+
+#endif /* __SHADER_VARIANT_H__ */
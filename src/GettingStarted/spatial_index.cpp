@@ -0,0 +1,123 @@
+#include "spatial_index.h"
+
+spatial_index::spatial_index()
+	: free_head(invalid),
+	  count(0),
+	  width(0),
+	  height(0),
+	  origin_x(0.0f),
+	  origin_z(0.0f),
+	  cell_size(1.0f),
+	  inv_cell_size(1.0f)
+{
+
+}
+
+void spatial_index::init(int w, int h, float x, float z, float size, unsigned capacity)
+{
+	width = w > 0 ? w : 1;
+	height = h > 0 ? h : 1;
+	origin_x = x;
+	origin_z = z;
+	cell_size = size;
+	inv_cell_size = 1.0f / size;
+	objects.reserve(capacity);
+	heads.assign(width * height, (handle)invalid);
+	clear();
+}
+
+void spatial_index::init(const grid_collision::grid & level, unsigned capacity)
+{
+	init(level.width, level.height, level.origin_x, level.origin_z, level.cell_size, capacity);
+}
+
+void spatial_index::clear()
+{
+	//Keep the slots, they are the free list from now on
+	for (size_t i = 0; i < heads.size(); i++)
+		heads[i] = invalid;
+	free_head = invalid;
+	for (size_t i = objects.size(); i-- > 0;) {
+		objects[i].cell = -1;
+		objects[i].next = free_head;
+		free_head = (handle)i;
+	}
+	count = 0;
+}
+
+int spatial_index::cell_row(float z) const
+{
+	int row = (int)floorf((z - origin_z) * inv_cell_size);
+	return row < 0 ? 0 : (row >= height ? height - 1 : row);
+}
+
+int spatial_index::cell_col(float x) const
+{
+	int col = (int)floorf((x - origin_x) * inv_cell_size);
+	return col < 0 ? 0 : (col >= width ? width - 1 : col);
+}
+
+void spatial_index::link(handle h, int cell)
+{
+	object & o = objects[h];
+	o.cell = cell;
+	o.prev = invalid;
+	o.next = heads[cell];
+	if (o.next != invalid)
+		objects[o.next].prev = h;
+	heads[cell] = h;
+}
+
+void spatial_index::unlink(handle h)
+{
+	object & o = objects[h];
+	if (o.prev != invalid)
+		objects[o.prev].next = o.next;
+	else
+		heads[o.cell] = o.next;
+	if (o.next != invalid)
+		objects[o.next].prev = o.prev;
+}
+
+spatial_index::handle spatial_index::insert(float x, float z, unsigned user)
+{
+	handle h = free_head;
+	if (h != invalid) {
+		free_head = objects[h].next;
+	}
+	else {
+		h = (handle)objects.size();
+		objects.push_back(object());
+	}
+
+	object & o = objects[h];
+	o.x = x;
+	o.z = z;
+	o.user = user;
+	link(h, cell_row(z) * width + cell_col(x));
+	count++;
+	return h;
+}
+
+void spatial_index::move(handle h, float x, float z)
+{
+	object & o = objects[h];
+	o.x = x;
+	o.z = z;
+	int cell = cell_row(z) * width + cell_col(x);
+	if (cell != o.cell) {
+		unlink(h);
+		link(h, cell);
+	}
+}
+
+void spatial_index::remove(handle h)
+{
+	if (h >= objects.size() || objects[h].cell < 0)
+		return;
+	unlink(h);
+	objects[h].cell = -1;
+	objects[h].next = free_head;
+	free_head = h;
+	count--;
+}
@@ -0,0 +1,147 @@
+#ifndef __SPATIAL_INDEX_H__
+#define __SPATIAL_INDEX_H__
+
+#include <math.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "grid_collision.h"
+
+//Points of interest on the xz plane (collectibles, triggers, agents) bucketed
+//by maze cell. Every cell heads an intrusive doubly linked list threaded
+//through the object slots, so insert, move and remove are O(1) and a move
+//inside the same cell only stores the new position. Removed slots go on a
+//free list and are reused; once the slots have grown to the peak object count
+//nothing allocates.
+//
+//Queries take the visitor as a template parameter rather than a
+//std::function so a capturing lambda doesn't allocate per call. Visitors
+//get the handle and must not insert or remove while visiting.
+class spatial_index
+{
+public:
+	typedef unsigned handle;
+	static const handle invalid = 0xFFFFFFFFu;
+
+	spatial_index();
+
+	//width x height cells of cell_size, (origin_x, origin_z) is the outer
+	//corner of cell (0, 0). Positions outside are kept in the nearest edge cell.
+	void init(int width, int height, float origin_x, float origin_z, float cell_size, unsigned capacity = 0);
+	//Same cells as a collision grid
+	void init(const grid_collision::grid & level, unsigned capacity = 0);
+	void clear();
+
+	//user is any value the caller wants back, such as an index into its own arrays
+	handle insert(float x, float z, unsigned user);
+	void move(handle h, float x, float z);
+	void remove(handle h);
+
+	size_t size() const { return count; }
+	float x(handle h) const { return objects[h].x; }
+	float z(handle h) const { return objects[h].z; }
+	unsigned user(handle h) const { return objects[h].user; }
+
+	int cell_row(float z) const;
+	int cell_col(float x) const;
+
+	//visit(handle) for every object in a cell
+	template <typename F>
+	void for_each_in_cell(int row, int col, F visit) const;
+	//visit(handle) for every object within radius of (x, z)
+	template <typename F>
+	void for_each_near(float x, float z, float radius, F visit) const;
+	//visit(handle) for the objects in each cell the segment from (x, z) to
+	//(x + dx, z + dz) crosses, cell by cell from the start and stopping at
+	//the edge of the grid. visit returns false to stop, the test against the
+	//ray itself is up to it.
+	template <typename F>
+	void for_each_on_ray(float x, float z, float dx, float dz, F visit) const;
+
+private:
+	struct object
+	{
+		float x, z;
+		unsigned user;
+		int cell; //-1 while the slot is free
+		handle prev, next; //within the cell, or the free list
+	};
+
+	void link(handle h, int cell);
+	void unlink(handle h);
+
+	std::vector<object> objects;
+	std::vector<handle> heads;
+	handle free_head;
+	size_t count;
+
+	int width, height;
+	float origin_x, origin_z;
+	float cell_size, inv_cell_size;
+};
+
+template <typename F>
+void spatial_index::for_each_in_cell(int row, int col, F visit) const
+{
+	if (row < 0 || col < 0 || row >= height || col >= width)
+		return;
+	for (handle h = heads[row * width + col]; h != invalid; h = objects[h].next)
+		visit(h);
+}
+
+template <typename F>
+void spatial_index::for_each_near(float x, float z, float radius, F visit) const
+{
+	int row0 = cell_row(z - radius), row1 = cell_row(z + radius);
+	int col0 = cell_col(x - radius), col1 = cell_col(x + radius);
+	float radius_sq = radius * radius;
+	for (int row = row0; row <= row1; row++) {
+		for (int col = col0; col <= col1; col++) {
+			for (handle h = heads[row * width + col]; h != invalid; h = objects[h].next) {
+				float ox = objects[h].x - x, oz = objects[h].z - z;
+				if (ox * ox + oz * oz <= radius_sq)
+					visit(h);
+			}
+		}
+	}
+}
+
+template <typename F>
+void spatial_index::for_each_on_ray(float x, float z, float dx, float dz, F visit) const
+{
+	int row = cell_row(z), col = cell_col(x);
+	int end_row = cell_row(z + dz), end_col = cell_col(x + dx);
+
+	//Fraction of the segment to the next column and row boundary, and per cell
+	int step_col = dx > 0.0f ? 1 : -1, step_row = dz > 0.0f ? 1 : -1;
+	float next_x = origin_x + (col + (dx > 0.0f ? 1 : 0)) * cell_size;
+	float next_z = origin_z + (row + (dz > 0.0f ? 1 : 0)) * cell_size;
+	float t_col = dx != 0.0f ? (next_x - x) / dx : 2.0f;
+	float t_row = dz != 0.0f ? (next_z - z) / dz : 2.0f;
+	float dt_col = dx != 0.0f ? cell_size / fabsf(dx) : 2.0f;
+	float dt_row = dz != 0.0f ? cell_size / fabsf(dz) : 2.0f;
+
+	for (;;) {
+		for (handle h = heads[row * width + col]; h != invalid; h = objects[h].next) {
+			if (!visit(h))
+				return;
+		}
+		if (row == end_row && col == end_col)
+			return;
+		if (t_col < t_row) {
+			if (t_col > 1.0f || col + step_col < 0 || col + step_col >= width)
+				return;
+			col += step_col;
+			t_col += dt_col;
+		}
+		else {
+			if (t_row > 1.0f || row + step_row < 0 || row + step_row >= height)
+				return;
+			row += step_row;
+			t_row += dt_row;
+		}
+	}
+}
+
+#endif /* __SPATIAL_INDEX_H__ */
@@ -0,0 +1,181 @@
+#include "sprite_batch.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+
+//Frames of instances the ring holds before it is orphaned and starts over
+static const unsigned ring_frames = 3;
+
+sprite_batch::sprite_batch()
+	: vao(0),
+	  buffer(0),
+	  capacity(0),
+	  ring_next(0),
+	  initialized(false)
+{
+
+}
+
+sprite_batch::~sprite_batch()
+{
+
+}
+
+void sprite_batch::init(unsigned sprites)
+{
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	//0: position and scale, 1: atlas rect, 2: tint
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void *)offsetof(instance, position));
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance), (void *)offsetof(instance, rect));
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(instance), (void *)offsetof(instance, tint));
+	for (GLuint i = 0; i < 3; i++) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+	glBindVertexArray(0);
+
+	capacity = 0;
+	initialized = true;
+	reserve(sprites > 0 ? sprites : 1);
+	staged.reserve(capacity);
+	keys.reserve(capacity);
+}
+
+void sprite_batch::shutdown()
+{
+	if (!initialized)
+		return;
+	glDeleteBuffers(1, &buffer);
+	glDeleteVertexArrays(1, &vao);
+	initialized = false;
+}
+
+//Grow so a frame of count sprites fits, the old contents are dropped
+void sprite_batch::reserve(unsigned count)
+{
+	if (count <= capacity)
+		return;
+	while (capacity < count)
+		capacity = capacity > 0 ? capacity * 2 : count;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)capacity * ring_frames * sizeof(instance), NULL, GL_STREAM_DRAW);
+	ring_next = 0;
+}
+
+void sprite_batch::begin()
+{
+	staged.clear();
+	keys.clear();
+	runs.clear();
+}
+
+void sprite_batch::add(GLuint atlas, blend_mode mode, const vmath::vec3 & position, float scale,
+	const vmath::vec4 & rect, const vmath::vec4 & tint)
+{
+	instance s;
+	for (int i = 0; i < 3; i++)
+		s.position[i] = position[i];
+	s.scale = scale;
+	for (int i = 0; i < 4; i++) {
+		s.rect[i] = rect[i];
+		float c = tint[i] < 0.0f ? 0.0f : (tint[i] > 1.0f ? 1.0f : tint[i]);
+		s.tint[i] = (unsigned char)(c * 255.0f + 0.5f);
+	}
+
+	sort_key key = { mode, atlas, 0.0f, (unsigned)staged.size() };
+	staged.push_back(s);
+	keys.push_back(key);
+}
+
+//Cutout first, grouped by atlas. Then blended back to front.
+bool sprite_batch::draw_order(const sort_key & a, const sort_key & b)
+{
+	if (a.mode != b.mode)
+		return a.mode < b.mode;
+	if (a.mode == BLEND_ALPHA && a.depth != b.depth)
+		return a.depth < b.depth;
+	if (a.atlas != b.atlas)
+		return a.atlas < b.atlas;
+	return a.index < b.index;
+}
+
+void sprite_batch::upload(const vmath::mat4 & mv_matrix)
+{
+	runs.clear();
+	unsigned count = (unsigned)keys.size();
+	if (count == 0 || !initialized)
+		return;
+
+	//Only blended sprites need a depth, cutout ones just group by atlas and
+	//usually arrive grouped already
+	for (unsigned i = 0; i < count; i++) {
+		if (keys[i].mode == BLEND_ALPHA) {
+			const float * p = staged[keys[i].index].position;
+			keys[i].depth = mv_matrix[0][2] * p[0] + mv_matrix[1][2] * p[1] + mv_matrix[2][2] * p[2] + mv_matrix[3][2];
+		}
+	}
+	if (!std::is_sorted(keys.begin(), keys.end(), draw_order))
+		std::sort(keys.begin(), keys.end(), draw_order);
+
+	reserve(count);
+	GLbitfield access = GL_MAP_WRITE_BIT;
+	if (ring_next + count > capacity * ring_frames) {
+		ring_next = 0;
+		access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+	}
+	else {
+		access |= GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	instance * out = (instance *)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)ring_next * sizeof(instance),
+		(GLsizeiptr)count * sizeof(instance), access);
+	if (out == NULL)
+		return;
+
+	for (unsigned i = 0; i < count; i++) {
+		const sort_key & key = keys[i];
+		out[i] = staged[key.index];
+		if (runs.empty() || runs.back().mode != key.mode || runs.back().atlas != key.atlas) {
+			run r = { key.mode, key.atlas, ring_next + i, 0 };
+			runs.push_back(r);
+		}
+		runs.back().count++;
+	}
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	ring_next += count;
+}
+
+void sprite_batch::draw(GLuint program, GLint unit)
+{
+	if (runs.empty())
+		return;
+
+	glBindVertexArray(vao);
+	glUniform1i(glGetUniformLocation(program, "tex"), unit);
+	GLint cutoff = glGetUniformLocation(program, "alpha_cutoff");
+	glActiveTexture(GL_TEXTURE0 + unit);
+
+	for (size_t i = 0; i < runs.size(); i++) {
+		const run & r = runs[i];
+		if (i == 0 || runs[i - 1].mode != r.mode) {
+			if (r.mode == BLEND_ALPHA) {
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				glUniform1f(cutoff, 0.0f);
+			}
+			else {
+				glDisable(GL_BLEND);
+				glUniform1f(cutoff, 0.5f);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, r.atlas);
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 6, r.count, r.first);
+	}
+	glDisable(GL_BLEND);
+}
@@ -0,0 +1,97 @@
+#ifndef __SPRITE_BATCH_H__
+#define __SPRITE_BATCH_H__
+
+#include <sb7.h>
+#include <vmath.h>
+
+#include <vector>
+
+//Camera facing sprites drawn with instancing. Sprites are collected between
+//begin() and upload(), which writes their position, scale, atlas rect and
+//tint into a streaming instance buffer: each frame takes the next part of a
+//ring that is orphaned when it wraps, so the GPU is never waited on.
+//draw() then issues one instanced call per atlas and blend mode.
+//
+//Cutout sprites write depth and discard transparent texels, so they can go
+//in any order. Alpha blended ones are drawn afterwards back to front, an
+//atlas whose blended sprites are interleaved in depth with another atlas'
+//takes one call per run.
+//
+//The program is sprite-vertex.glsl / sprite-fragment.glsl. It reads
+//mv_matrix and proj_matrix from the "constants" uniform block as before.
+class sprite_batch
+{
+public:
+	enum blend_mode
+	{
+		BLEND_CUTOUT,
+		BLEND_ALPHA
+	};
+
+	sprite_batch();
+	~sprite_batch();
+
+	//sprites a frame can hold before the buffer has to grow
+	void init(unsigned sprites = 4096);
+	void shutdown();
+
+	void begin();
+	//rect is (u0, v0, u1, v1) inside atlas, tint multiplies the texel
+	void add(GLuint atlas, blend_mode mode, const vmath::vec3 & position, float scale,
+		const vmath::vec4 & rect = vmath::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		const vmath::vec4 & tint = vmath::vec4(1.0f));
+	//Sort for the camera in mv_matrix and write the instances
+	void upload(const vmath::mat4 & mv_matrix);
+	//Draw what was uploaded with program, which must be in use. Atlases are
+	//bound to texture unit. Can be called more than once, e.g. for a reflection.
+	void draw(GLuint program, GLint unit);
+
+	size_t size() const { return keys.size(); }
+	//Instanced calls one draw() makes
+	size_t draw_calls() const { return runs.size(); }
+
+private:
+	sprite_batch(const sprite_batch &);
+	sprite_batch & operator=(const sprite_batch &);
+
+	//Matches the attributes set up in init()
+	struct instance
+	{
+		float position[3];
+		float scale;
+		float rect[4];
+		unsigned char tint[4];
+	};
+
+	struct sort_key
+	{
+		blend_mode mode;
+		GLuint atlas;
+		float depth; //view space z, more negative is further away
+		unsigned index;
+	};
+
+	struct run
+	{
+		blend_mode mode;
+		GLuint atlas;
+		GLuint first;
+		GLsizei count;
+	};
+
+	static bool draw_order(const sort_key & a, const sort_key & b);
+	void reserve(unsigned count);
+
+	std::vector<instance> staged;
+	std::vector<sort_key> keys;
+	std::vector<run> runs;
+
+	GLuint vao;
+	GLuint buffer;
+	//Sprites per frame, the buffer holds ring_frames times that
+	unsigned capacity;
+	unsigned ring_next;
+	bool initialized;
+};
+
+#endif /* __SPRITE_BATCH_H__ */
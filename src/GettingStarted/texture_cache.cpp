@@ -0,0 +1,138 @@
+#include "texture_cache.h"
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+
+#include "../lodepng.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include "png_arena.h"
+#include "texture_compress.h"
+
+namespace texture_cache
+{
+
+const char cache_dir[] = "bin\\media\\cache\\";
+static const char hash_key[] = "maze.source_hash";
+
+void make_cache_dir()
+{
+#ifdef WIN32
+	_mkdir(cache_dir);
+#else
+	mkdir(cache_dir, 0755);
+#endif
+}
+
+std::string entry_name(const std::string & source, bool compressed)
+{
+	size_t slash = source.find_last_of("\\/");
+	std::string base = (slash == std::string::npos) ? source : source.substr(slash + 1);
+	base = base.substr(0, base.find_last_of('.'));
+	return std::string(cache_dir) + base + (compressed ? ".bc.ktx" : ".rgba.ktx");
+}
+
+//Decode straight into the level's storage, lodepng's own buffers live in the
+//thread's arena for the duration of the call
+static unsigned decode_level(const unsigned char * png, size_t size, texture_compress::mip_level & out)
+{
+	png_arena::scope arena;
+	lodepng::State state;
+
+	unsigned err = lodepng_inspect(&out.width, &out.height, &state, png, size);
+	if (err != 0)
+		return err;
+
+	out.data.resize((size_t)out.width * out.height * 4);
+	return lodepng::decode_into(&out.data[0], out.width * 4, out.data.size(), out.width, out.height, state, png, size);
+}
+
+size_t cached_texture::total_size() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < levels.size(); i++)
+		total += levels[i].size;
+	return total;
+}
+
+std::string source_hash(const mapped_file & src)
+{
+	char hash[17];
+	sprintf(hash, "%016llx", hash_bytes(src.data(), src.size()));
+	return hash;
+}
+
+//Warm path: the entry was built from this exact file
+bool open_entry(const std::string & source, bool compressed, const std::string & hash, cached_texture & out)
+{
+	std::string entry = entry_name(source, compressed);
+	std::string cached_hash;
+	if (out.file.open(entry.c_str())
+		&& texture_compress::find_ktx_value(out.file.data(), out.file.size(), hash_key, cached_hash)
+		&& cached_hash == hash
+		&& texture_compress::parse_ktx(out.file.data(), out.file.size(), out.fmt, out.levels)
+		&& texture_compress::format_supported(out.fmt)) {
+		return true;
+	}
+	out.file.close();
+	return false;
+}
+
+//Cold path: decode into the top level, build mips, encode and write the entry back
+bool build_entry(const mapped_file & src, const std::string & source, bool compressed, const std::string & hash,
+	cached_texture & out)
+{
+	std::string entry = entry_name(source, compressed);
+	std::vector<texture_compress::mip_level> mips(1);
+	unsigned err = decode_level(src.data(), src.size(), mips[0]);
+	if (err != 0) {
+		std::cout << "error" << err << ": " << lodepng_error_text(err) << std::endl;
+		return false;
+	}
+
+	out.fmt = texture_compress::FORMAT_RGBA8;
+	if (compressed) {
+		out.fmt = texture_compress::choose_format(source, &mips[0].data[0], mips[0].width, mips[0].height);
+		if (!texture_compress::format_supported(out.fmt))
+			out.fmt = texture_compress::FORMAT_RGBA8;
+	}
+
+	texture_compress::build_mips(mips);
+	texture_compress::compress_mips(mips, out.fmt, out.owned);
+	texture_compress::view_levels(out.owned, out.levels);
+
+	make_cache_dir();
+	if (!texture_compress::save_ktx(entry, out.fmt, out.owned, hash_key, hash.c_str()))
+		std::cout << "Unable to write texture cache entry " << entry << std::endl;
+
+	return true;
+}
+
+bool fetch(const std::string & source, bool compressed, cached_texture & out)
+{
+	mapped_file src;
+	if (!src.open(source.c_str()))
+		return false;
+
+	std::string hash = source_hash(src);
+	return open_entry(source, compressed, hash, out) || build_entry(src, source, compressed, hash, out);
+}
+
+bool load(const std::string & source, bool compressed, GLuint * tex)
+{
+	cached_texture texture;
+	if (!fetch(source, compressed, texture))
+		return false;
+
+	texture_compress::upload_levels(texture.fmt, texture.levels, tex);
+	return true;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef __TEXTURE_CACHE_H__
+#define __TEXTURE_CACHE_H__
+
+#include <sb7.h>
+
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "texture_compress.h"
+
+//Cache of ready-to-upload texel data. Each source image gets one KTX entry
+//holding its full mip chain (block compressed or RGBA8), tagged with a hash
+//of the source file. Entries are memory mapped and uploaded in place, and the
+//png is only decoded again when its contents change.
+namespace texture_cache
+{
+
+//Directory shared by every on-disk cache, created on first write
+extern const char cache_dir[];
+void make_cache_dir();
+
+//Path of the cache entry for a source image
+std::string entry_name(const std::string & source, bool compressed);
+
+//Encoded mip chain of a source image, either pointing into the mapped cache
+//entry or into levels that were just built
+struct cached_texture
+{
+	texture_compress::format fmt;
+	std::vector<texture_compress::level_view> levels;
+
+	mapped_file file;
+	std::vector<texture_compress::mip_level> owned;
+
+	size_t total_size() const;
+};
+
+//CPU side of load, safe to call from any thread
+bool fetch(const std::string & source, bool compressed, cached_texture & out);
+
+//The two halves of fetch, for callers that decode some sources themselves.
+//hash is source_hash of the source's contents.
+std::string source_hash(const mapped_file & src);
+bool open_entry(const std::string & source, bool compressed, const std::string & hash, cached_texture & out);
+bool build_entry(const mapped_file & src, const std::string & source, bool compressed, const std::string & hash,
+	cached_texture & out);
+
+//Upload source through the cache, rebuilding the entry on a miss.
+//Returns false if the source could not be read or decoded.
+bool load(const std::string & source, bool compressed, GLuint * tex);
+
+}
+
+#endif /* __TEXTURE_CACHE_H__ */
@@ -0,0 +1,524 @@
+#include "texture_compress.h"
+
+#include <sb7ktx.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "mapped_file.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
+#endif
+
+namespace texture_compress
+{
+
+static const unsigned char ktx_identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+//Bytes per 4x4 block, or 0 for uncompressed formats
+static unsigned block_bytes(format fmt)
+{
+	switch (fmt) {
+	case FORMAT_DXT1: return 8;
+	case FORMAT_DXT5: return 16;
+	case FORMAT_BC5: return 16;
+	default: return 0;
+	}
+}
+
+static format from_gl_internal_format(GLenum internal_format)
+{
+	switch (internal_format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return FORMAT_DXT1;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return FORMAT_DXT5;
+	case GL_COMPRESSED_RG_RGTC2: return FORMAT_BC5;
+	default: return FORMAT_RGBA8;
+	}
+}
+
+GLenum gl_internal_format(format fmt)
+{
+	switch (fmt) {
+	case FORMAT_DXT1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case FORMAT_DXT5: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return GL_RGBA8;
+	}
+}
+
+//-1 until detect_support has queried the context
+static int s3tc_supported = -1;
+
+void detect_support()
+{
+	s3tc_supported = sb6IsExtensionSupported("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+}
+
+bool format_supported(format fmt)
+{
+	//S3TC is an extension on desktop GL, RGTC is core since 3.0
+	if (fmt == FORMAT_DXT1 || fmt == FORMAT_DXT5) {
+		if (s3tc_supported < 0)
+			detect_support();
+		return s3tc_supported != 0;
+	}
+	return true;
+}
+
+void build_mips(const unsigned char * rgba, unsigned width, unsigned height, std::vector<mip_level> & out_levels)
+{
+	out_levels.clear();
+	out_levels.push_back(mip_level());
+	out_levels[0].width = width;
+	out_levels[0].height = height;
+	out_levels[0].data.assign(rgba, rgba + width * height * 4);
+	build_mips(out_levels);
+}
+
+void build_mips(std::vector<mip_level> & levels)
+{
+	levels.resize(1);
+	unsigned width = levels[0].width;
+	unsigned height = levels[0].height;
+
+	while (width > 1 || height > 1) {
+		unsigned nw = std::max(width / 2, 1u);
+		unsigned nh = std::max(height / 2, 1u);
+		mip_level next;
+		next.width = nw;
+		next.height = nh;
+		next.data.resize(nw * nh * 4);
+
+		const unsigned char * src = &levels.back().data[0];
+		for (unsigned y = 0; y < nh; y++) {
+			unsigned y0 = std::min(y * 2, height - 1);
+			unsigned y1 = std::min(y * 2 + 1, height - 1);
+			for (unsigned x = 0; x < nw; x++) {
+				unsigned x0 = std::min(x * 2, width - 1);
+				unsigned x1 = std::min(x * 2 + 1, width - 1);
+				for (unsigned c = 0; c < 4; c++) {
+					unsigned sum = src[4 * (y0 * width + x0) + c] + src[4 * (y0 * width + x1) + c]
+						+ src[4 * (y1 * width + x0) + c] + src[4 * (y1 * width + x1) + c];
+					next.data[4 * (y * nw + x) + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+
+		levels.push_back(next);
+		width = nw;
+		height = nh;
+	}
+}
+
+format choose_format(const std::string & filename, const unsigned char * rgba, unsigned width, unsigned height)
+{
+	if (filename.find("normal") != std::string::npos)
+		return FORMAT_BC5;
+
+	for (unsigned i = 0; i < width * height; i++) {
+		if (rgba[4 * i + 3] != 255)
+			return FORMAT_DXT5;
+	}
+	return FORMAT_DXT1;
+}
+
+#pragma region Block encoders
+static unsigned short to_565(const float c[3])
+{
+	int r = (int)(std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void from_565(unsigned short c, int out[3])
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+//Gather a 4x4 block of RGBA8 texels, clamping at the image edges
+static void fetch_block(const mip_level & in, unsigned bx, unsigned by, unsigned char block[64])
+{
+	for (unsigned y = 0; y < 4; y++) {
+		unsigned sy = std::min(by * 4 + y, in.height - 1);
+		for (unsigned x = 0; x < 4; x++) {
+			unsigned sx = std::min(bx * 4 + x, in.width - 1);
+			memcpy(&block[4 * (y * 4 + x)], &in.data[4 * (sy * in.width + sx)], 4);
+		}
+	}
+}
+
+//DXT1 color block. Endpoints are the extremes of the block projected onto
+//its principal axis (found with a few power iterations).
+static void encode_color_block(const unsigned char block[64], unsigned char out[8])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	for (int c = 0; c < 3; c++)
+		mean[c] += block[4 * i + c] / 16.0f;
+
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float r = block[4 * i + 0] - mean[0];
+		float g = block[4 * i + 1] - mean[1];
+		float b = block[4 * i + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 4; iter++) {
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float len = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+		if (len < 1e-6f)
+			break;
+		axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+	}
+	float axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	float tmin = 0.0f, tmax = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float t = (block[4 * i + 0] - mean[0]) * axis[0]
+			+ (block[4 * i + 1] - mean[1]) * axis[1]
+			+ (block[4 * i + 2] - mean[2]) * axis[2];
+		t /= axis_len2;
+		tmin = std::min(tmin, t);
+		tmax = std::max(tmax, t);
+	}
+
+	float hi[3], lo[3];
+	for (int c = 0; c < 3; c++) {
+		hi[c] = mean[c] + axis[c] * tmax;
+		lo[c] = mean[c] + axis[c] * tmin;
+	}
+	unsigned short c0 = to_565(hi);
+	unsigned short c1 = to_565(lo);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+
+	unsigned indices = 0;
+	if (c0 != c1) {
+		int palette[4][3];
+		from_565(c0, palette[0]);
+		from_565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0, best_dist = 0x7FFFFFFF;
+			for (int p = 0; p < 4; p++) {
+				int dr = block[4 * i + 0] - palette[p][0];
+				int dg = block[4 * i + 1] - palette[p][1];
+				int db = block[4 * i + 2] - palette[p][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= (unsigned)best << (2 * i);
+		}
+	}
+
+	out[4] = indices & 0xFF;
+	out[5] = (indices >> 8) & 0xFF;
+	out[6] = (indices >> 16) & 0xFF;
+	out[7] = (indices >> 24) & 0xFF;
+}
+
+//BC4 block for a single channel, used for DXT5 alpha and both BC5 channels
+static void encode_channel_block(const unsigned char block[64], int channel, unsigned char out[8])
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++) {
+		lo = std::min(lo, (int)block[4 * i + channel]);
+		hi = std::max(hi, (int)block[4 * i + channel]);
+	}
+
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+
+	unsigned long long bits = 0;
+	if (hi != lo) {
+		int range = hi - lo;
+		for (int i = 0; i < 16; i++) {
+			//t in [0, 7] from lo to hi, remapped to the 8-value palette order
+			int t = ((block[4 * i + channel] - lo) * 7 + range / 2) / range;
+			unsigned long long idx = (t == 7) ? 0 : (t == 0) ? 1 : (unsigned long long)(8 - t);
+			bits |= idx << (3 * i);
+		}
+	}
+
+	for (int b = 0; b < 6; b++)
+		out[2 + b] = (unsigned char)((bits >> (8 * b)) & 0xFF);
+}
+#pragma endregion
+
+void compress_level(const mip_level & in, format fmt, mip_level & out)
+{
+	out.width = in.width;
+	out.height = in.height;
+
+	unsigned bytes = block_bytes(fmt);
+	if (bytes == 0) {
+		out.data = in.data;
+		return;
+	}
+
+	int blocks_x = (int)((in.width + 3) / 4);
+	int blocks_y = (int)((in.height + 3) / 4);
+	out.data.resize(blocks_x * blocks_y * bytes);
+
+	//Every block is independent, so rows of blocks are split across threads
+#pragma omp parallel for schedule(dynamic)
+	for (int by = 0; by < blocks_y; by++) {
+		unsigned char block[64];
+		for (int bx = 0; bx < blocks_x; bx++) {
+			unsigned char * dst = &out.data[(by * blocks_x + bx) * bytes];
+			fetch_block(in, bx, by, block);
+			switch (fmt) {
+			case FORMAT_DXT1:
+				encode_color_block(block, dst);
+				break;
+			case FORMAT_DXT5:
+				encode_channel_block(block, 3, dst);
+				encode_color_block(block, dst + 8);
+				break;
+			case FORMAT_BC5:
+				encode_channel_block(block, 0, dst);
+				encode_channel_block(block, 1, dst + 8);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void compress_mips(std::vector<mip_level> & mips, format fmt, std::vector<mip_level> & out_levels)
+{
+	//RGBA8 levels are already encoded, hand them over instead of copying
+	if (block_bytes(fmt) == 0) {
+		out_levels.swap(mips);
+		return;
+	}
+
+	out_levels.resize(mips.size());
+	for (size_t i = 0; i < mips.size(); i++)
+		compress_level(mips[i], fmt, out_levels[i]);
+}
+
+//Allocate storage for the whole chain and set filtering to match
+static void create_texture(GLenum internal_format, unsigned levels, unsigned width, unsigned height, GLuint * tex)
+{
+	glGenTextures(1, tex);
+	glBindTexture(GL_TEXTURE_2D, *tex);
+	glTexStorage2D(GL_TEXTURE_2D, levels, internal_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+static void upload_level(format fmt, unsigned level, unsigned width, unsigned height, const unsigned char * data, size_t size)
+{
+	if (fmt == FORMAT_RGBA8) {
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	else {
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, gl_internal_format(fmt), (GLsizei)size, data);
+	}
+}
+
+void view_levels(const std::vector<mip_level> & levels, std::vector<level_view> & out_views)
+{
+	out_views.resize(levels.size());
+	for (size_t i = 0; i < levels.size(); i++) {
+		out_views[i].width = levels[i].width;
+		out_views[i].height = levels[i].height;
+		out_views[i].data = &levels[i].data[0];
+		out_views[i].size = levels[i].data.size();
+	}
+}
+
+void upload_levels(format fmt, const std::vector<level_view> & levels, GLuint * tex)
+{
+	create_texture(gl_internal_format(fmt), (unsigned)levels.size(), levels[0].width, levels[0].height, tex);
+	for (size_t i = 0; i < levels.size(); i++)
+		upload_level(fmt, (unsigned)i, levels[i].width, levels[i].height, levels[i].data, levels[i].size);
+}
+
+void upload_top_level(const level_view & top, GLuint * tex)
+{
+	unsigned levels = 1;
+	for (unsigned size = std::max(top.width, top.height); size > 1; size /= 2)
+		levels++;
+	create_texture(GL_RGBA8, levels, top.width, top.height, tex);
+	upload_level(FORMAT_RGBA8, 0, top.width, top.height, top.data, top.size);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void upload_levels(format fmt, const std::vector<mip_level> & levels, GLuint * tex)
+{
+	std::vector<level_view> views;
+	view_levels(levels, views);
+	upload_levels(fmt, views, tex);
+}
+
+bool save_ktx(const std::string & filename, format fmt, const std::vector<mip_level> & levels,
+	const char * key, const char * value)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file.is_open() || levels.empty())
+		return false;
+
+	bool compressed = block_bytes(fmt) != 0;
+
+	//Key and value are both stored null terminated, padded to 4 bytes
+	std::vector<unsigned char> keyvalue;
+	if (key != NULL && value != NULL) {
+		unsigned int kv_size = (unsigned int)(strlen(key) + strlen(value) + 2);
+		keyvalue.resize(4 + ((kv_size + 3) & ~3u), 0);
+		memcpy(&keyvalue[0], &kv_size, 4);
+		memcpy(&keyvalue[4], key, strlen(key) + 1);
+		memcpy(&keyvalue[4 + strlen(key) + 1], value, strlen(value) + 1);
+	}
+
+	sb7::ktx::file::header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.identifier, ktx_identifier, sizeof(ktx_identifier));
+	h.endianness = 0x04030201;
+	h.gltype = compressed ? 0 : GL_UNSIGNED_BYTE;
+	h.gltypesize = 1;
+	h.glformat = compressed ? 0 : GL_RGBA;
+	h.glinternalformat = gl_internal_format(fmt);
+	h.glbaseinternalformat = (fmt == FORMAT_BC5) ? GL_RG : (fmt == FORMAT_DXT1) ? GL_RGB : GL_RGBA;
+	h.pixelwidth = levels[0].width;
+	h.pixelheight = levels[0].height;
+	h.faces = 1;
+	h.miplevels = (unsigned int)levels.size();
+	h.keypairbytes = (unsigned int)keyvalue.size();
+	file.write((const char *)&h, sizeof(h));
+	if (!keyvalue.empty())
+		file.write((const char *)&keyvalue[0], keyvalue.size());
+
+	//Level sizes are always multiples of 4 (RGBA8 texels or 8 byte blocks)
+	for (size_t i = 0; i < levels.size(); i++) {
+		unsigned int size = (unsigned int)levels[i].data.size();
+		file.write((const char *)&size, sizeof(size));
+		file.write((const char *)&levels[i].data[0], size);
+	}
+
+	return file.good();
+}
+
+static const sb7::ktx::file::header * check_ktx_header(const unsigned char * data, size_t size)
+{
+	if (size < sizeof(sb7::ktx::file::header))
+		return NULL;
+
+	const sb7::ktx::file::header * h = (const sb7::ktx::file::header *)data;
+	if (memcmp(h->identifier, ktx_identifier, sizeof(ktx_identifier)) != 0 || h->endianness != 0x04030201)
+		return NULL;
+	if (h->pixelheight == 0 || h->pixeldepth != 0 || h->faces != 1 || h->miplevels == 0)
+		return NULL;
+	if (sizeof(*h) + h->keypairbytes > size)
+		return NULL;
+	return h;
+}
+
+bool find_ktx_value(const unsigned char * data, size_t size, const char * key, std::string & out_value)
+{
+	const sb7::ktx::file::header * h = check_ktx_header(data, size);
+	if (h == NULL)
+		return false;
+
+	const unsigned char * p = data + sizeof(*h);
+	const unsigned char * end = p + h->keypairbytes;
+	while (p + 4 <= end) {
+		unsigned int kv_size;
+		memcpy(&kv_size, p, 4);
+		const char * kv = (const char *)(p + 4);
+		if (p + 4 + kv_size > end)
+			break;
+
+		size_t key_len = strnlen(kv, kv_size);
+		if (key_len < kv_size && strcmp(kv, key) == 0) {
+			const char * value = kv + key_len + 1;
+			out_value.assign(value, strnlen(value, kv_size - key_len - 1));
+			return true;
+		}
+		p += 4 + ((kv_size + 3) & ~3u);
+	}
+	return false;
+}
+
+bool parse_ktx(const unsigned char * data, size_t size, format & out_fmt, std::vector<level_view> & out_levels)
+{
+	const sb7::ktx::file::header * h = check_ktx_header(data, size);
+	if (h == NULL)
+		return false;
+
+	out_fmt = from_gl_internal_format(h->glinternalformat);
+	if (out_fmt == FORMAT_RGBA8 && (h->glinternalformat != GL_RGBA8 || h->gltype != GL_UNSIGNED_BYTE))
+		return false;
+
+	unsigned w = h->pixelwidth, ht = h->pixelheight;
+	const unsigned char * p = data + sizeof(*h) + h->keypairbytes;
+	out_levels.resize(h->miplevels);
+	for (unsigned int i = 0; i < h->miplevels; i++) {
+		unsigned int level_size;
+		if (p + 4 > data + size)
+			return false;
+		memcpy(&level_size, p, 4);
+		if (p + 4 + level_size > data + size)
+			return false;
+
+		out_levels[i].width = w;
+		out_levels[i].height = ht;
+		out_levels[i].data = p + 4;
+		out_levels[i].size = level_size;
+
+		p += 4 + ((level_size + 3) & ~3u);
+		w = std::max(w / 2, 1u);
+		ht = std::max(ht / 2, 1u);
+	}
+	return true;
+}
+
+bool upload_ktx(const unsigned char * data, size_t size, GLuint * tex)
+{
+	format fmt;
+	std::vector<level_view> levels;
+	if (!parse_ktx(data, size, fmt, levels) || !format_supported(fmt))
+		return false;
+
+	upload_levels(fmt, levels, tex);
+	return true;
+}
+
+bool load_ktx(const std::string & filename, GLuint * tex)
+{
+	mapped_file file;
+	if (!file.open(filename.c_str()))
+		return false;
+	return upload_ktx(file.data(), file.size(), tex);
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef __TEXTURE_COMPRESS_H__
+#define __TEXTURE_COMPRESS_H__
+
+#include <sb7.h>
+
+#include <string>
+#include <vector>
+
+//Block compression of textures (DXT1/DXT5/BC5) and KTX read/write.
+//Color maps without alpha become DXT1, color maps with alpha become DXT5 and
+//normal maps become BC5 (two channel, z is rebuilt in the shader).
+namespace texture_compress
+{
+
+enum format
+{
+	FORMAT_RGBA8,
+	FORMAT_DXT1,
+	FORMAT_DXT5,
+	FORMAT_BC5
+};
+
+//One level of a mip chain. For compressed formats data holds 4x4 blocks.
+struct mip_level
+{
+	unsigned width;
+	unsigned height;
+	std::vector<unsigned char> data;
+};
+
+//Box filter an RGBA8 image down to 1x1, level 0 is a copy of the input.
+void build_mips(const unsigned char * rgba, unsigned width, unsigned height, std::vector<mip_level> & out_levels);
+//Same, starting from levels[0] in place
+void build_mips(std::vector<mip_level> & levels);
+
+//Pick a format from the filename (normal maps) and the alpha channel
+format choose_format(const std::string & filename, const unsigned char * rgba, unsigned width, unsigned height);
+
+//Compress one RGBA8 level, blocks are encoded in parallel
+void compress_level(const mip_level & in, format fmt, mip_level & out);
+
+GLenum gl_internal_format(format fmt);
+//Query the context for S3TC. Must run on the GL thread before format_supported
+//is called from any other thread.
+void detect_support();
+bool format_supported(format fmt);
+
+//A level that lives in someone else's memory (a mapped file or staging buffer)
+struct level_view
+{
+	unsigned width;
+	unsigned height;
+	const unsigned char * data;
+	size_t size;
+};
+
+//Encode every level of a chain from build_mips as fmt. For RGBA8 the levels
+//are moved out of mips rather than copied.
+void compress_mips(std::vector<mip_level> & mips, format fmt, std::vector<mip_level> & out_levels);
+
+//Create an immutable texture from encoded levels
+void upload_levels(format fmt, const std::vector<mip_level> & levels, GLuint * tex);
+void upload_levels(format fmt, const std::vector<level_view> & levels, GLuint * tex);
+//RGBA8 top level only, the GPU filters the rest of the chain
+void upload_top_level(const level_view & top, GLuint * tex);
+void view_levels(const std::vector<mip_level> & levels, std::vector<level_view> & out_views);
+
+//KTX 1.1 files with a full mip chain and an optional key/value pair
+bool save_ktx(const std::string & filename, format fmt, const std::vector<mip_level> & levels,
+	const char * key = NULL, const char * value = NULL);
+bool find_ktx_value(const unsigned char * data, size_t size, const char * key, std::string & out_value);
+//Point out_levels at the levels inside a KTX image
+bool parse_ktx(const unsigned char * data, size_t size, format & out_fmt, std::vector<level_view> & out_levels);
+//Uploads straight from data, which can point into a mapped file
+bool upload_ktx(const unsigned char * data, size_t size, GLuint * tex);
+bool load_ktx(const std::string & filename, GLuint * tex);
+
+}
+
+#endif /* __TEXTURE_COMPRESS_H__ */
@@ -0,0 +1,329 @@
+#include "texture_streamer.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "../lodepng.h"
+#include "cpu_profiler.h"
+#include "png_arena.h"
+#include "thread_pool.h"
+
+//Staged levels start on 16 byte boundaries
+static size_t align16(size_t n)
+{
+	return (n + 15) & ~(size_t)15;
+}
+
+texture_streamer::texture_streamer()
+	: pool(NULL),
+	  compressed(true),
+	  pbo(0),
+	  staging(NULL),
+	  staging_size(0),
+	  placeholder_color(0),
+	  placeholder_normal(0),
+	  outstanding(0),
+	  stopping(false)
+{
+
+}
+
+texture_streamer::~texture_streamer()
+{
+
+}
+
+GLuint texture_streamer::make_placeholder(unsigned char r, unsigned char g, unsigned char b)
+{
+	const unsigned char texel[4] = { r, g, b, 255 };
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return tex;
+}
+
+void texture_streamer::init(thread_pool * workers, bool use_compressed, size_t staging_bytes)
+{
+	pool = workers;
+	compressed = use_compressed;
+	stopping = false;
+
+	//Workers decide on formats without touching GL
+	texture_compress::detect_support();
+
+	placeholder_color = make_placeholder(128, 128, 128);
+	placeholder_normal = make_placeholder(128, 128, 255); //flat normal
+
+	//Persistent mapping needs GL 4.4 or ARB_buffer_storage. Without it the
+	//workers stage into client memory instead.
+	if (gl3wIsSupported(4, 4) || sb6IsExtensionSupported("GL_ARB_buffer_storage")) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, staging_bytes, NULL, flags);
+		staging = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, staging_bytes, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (staging != NULL) {
+			staging_size = staging_bytes;
+			free_ranges.push_back(std::make_pair((size_t)0, staging_size));
+		}
+	}
+}
+
+void texture_streamer::shutdown()
+{
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		stopping = true;
+	}
+	if (pool != NULL)
+		pool->wait_idle();
+
+	for (size_t i = 0; i < finished.size(); i++)
+		delete finished[i];
+	finished.clear();
+
+	for (size_t i = 0; i < uploads.size(); i++) {
+		glClientWaitSync(uploads[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(uploads[i].fence);
+	}
+	uploads.clear();
+	free_ranges.clear();
+
+	if (pbo != 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &pbo);
+		pbo = 0;
+	}
+	staging = NULL;
+	staging_size = 0;
+
+	glDeleteTextures(1, &placeholder_color);
+	glDeleteTextures(1, &placeholder_normal);
+}
+
+void texture_streamer::request(const std::string & filename, GLuint * tex)
+{
+	*tex = (filename.find("normal") != std::string::npos) ? placeholder_normal : placeholder_color;
+
+	job * j = new job();
+	j->filename = filename;
+	j->target = tex;
+	j->ok = false;
+	j->generate_mips = false;
+	j->staged_offset = 0;
+	j->staged_size = 0;
+
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		outstanding++;
+	}
+	pool->submit([this, j]() { decode(j); });
+}
+
+unsigned texture_streamer::pending()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	return outstanding;
+}
+
+//Worker thread: fetch the mip chain and stage it for upload
+void texture_streamer::decode(job * j)
+{
+	PROFILE_ZONE("decode texture");
+	mapped_file src;
+	if (src.open(j->filename.c_str())) {
+		std::string hash = texture_cache::source_hash(src);
+		texture_cache::cached_texture tex;
+		if (texture_cache::open_entry(j->filename, compressed, hash, tex))
+			stage(j, tex);
+		else if (compressed || !decode_staged(j, src)) {
+			//Compressing needs the decoded image in client memory anyway
+			if (texture_cache::build_entry(src, j->filename, compressed, hash, tex))
+				stage(j, tex);
+		}
+	}
+
+	std::unique_lock<std::mutex> guard(lock);
+	finished.push_back(j);
+}
+
+//Copy an encoded mip chain into staging, or into client memory if it's full
+void texture_streamer::stage(job * j, const texture_cache::cached_texture & tex)
+{
+	j->ok = true;
+	j->fmt = tex.fmt;
+	j->levels = tex.levels;
+
+	size_t total = 0;
+	for (size_t i = 0; i < tex.levels.size(); i++)
+		total += align16(tex.levels[i].size);
+
+	size_t offset = 0;
+	unsigned char * dst;
+	if (staging != NULL && allocate(total, offset)) {
+		j->staged_offset = offset;
+		j->staged_size = total;
+		dst = staging + offset;
+	}
+	else {
+		j->fallback.resize(total);
+		dst = &j->fallback[0];
+	}
+
+	size_t pos = 0;
+	for (size_t i = 0; i < tex.levels.size(); i++) {
+		memcpy(dst + pos, tex.levels[i].data, tex.levels[i].size);
+		//Offsets into the bound unpack buffer are passed as pointers
+		j->levels[i].data = (j->staged_size > 0) ? (const unsigned char *)(offset + pos) : dst + pos;
+		pos += align16(tex.levels[i].size);
+	}
+}
+
+//Decode the png's top level into staging. The mapping is write only, so the
+//rest of the chain is left to glGenerateMipmap and no cache entry is written.
+//Returns false when there is no room, j is untouched then.
+bool texture_streamer::decode_staged(job * j, const mapped_file & src)
+{
+	if (staging == NULL)
+		return false;
+
+	png_arena::scope arena;
+	lodepng::State state;
+	unsigned width, height;
+	unsigned err = lodepng_inspect(&width, &height, &state, src.data(), src.size());
+	if (err != 0) {
+		std::cout << "error" << err << ": " << lodepng_error_text(err) << std::endl;
+		return true;
+	}
+
+	size_t size = (size_t)width * height * 4;
+	size_t offset;
+	if (!allocate(align16(size), offset))
+		return false;
+
+	err = lodepng::decode_into(staging + offset, width * 4, size, width, height, state, src.data(), src.size());
+	if (err != 0) {
+		release(offset, align16(size));
+		std::cout << "error" << err << ": " << lodepng_error_text(err) << std::endl;
+		return true;
+	}
+
+	texture_compress::level_view top;
+	top.width = width;
+	top.height = height;
+	top.data = (const unsigned char *)offset;
+	top.size = size;
+	j->ok = true;
+	j->generate_mips = true;
+	j->fmt = texture_compress::FORMAT_RGBA8;
+	j->levels.assign(1, top);
+	j->staged_offset = offset;
+	j->staged_size = align16(size);
+	return true;
+}
+
+//First fit in the staging buffer. Fails rather than waiting for space: the
+//GL thread that frees it may itself be waiting on this worker.
+bool texture_streamer::allocate(size_t size, size_t & out_offset)
+{
+	if (size > staging_size)
+		return false;
+
+	std::unique_lock<std::mutex> guard(lock);
+	if (stopping)
+		return false;
+
+	for (size_t i = 0; i < free_ranges.size(); i++) {
+		if (free_ranges[i].second >= size) {
+			out_offset = free_ranges[i].first;
+			free_ranges[i].first += size;
+			free_ranges[i].second -= size;
+			if (free_ranges[i].second == 0)
+				free_ranges.erase(free_ranges.begin() + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void texture_streamer::release(size_t offset, size_t size)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	size_t i = 0;
+	while (i < free_ranges.size() && free_ranges[i].first < offset)
+		i++;
+	free_ranges.insert(free_ranges.begin() + i, std::make_pair(offset, size));
+
+	//Merge with the following and preceding ranges
+	if (i + 1 < free_ranges.size() && free_ranges[i].first + free_ranges[i].second == free_ranges[i + 1].first) {
+		free_ranges[i].second += free_ranges[i + 1].second;
+		free_ranges.erase(free_ranges.begin() + i + 1);
+	}
+	if (i > 0 && free_ranges[i - 1].first + free_ranges[i - 1].second == free_ranges[i].first) {
+		free_ranges[i - 1].second += free_ranges[i].second;
+		free_ranges.erase(free_ranges.begin() + i);
+	}
+}
+
+void texture_streamer::update()
+{
+	PROFILE_ZONE("texture uploads");
+	//Staging ranges can be reused once the GPU has consumed their uploads
+	for (size_t i = 0; i < uploads.size();) {
+		GLenum state = glClientWaitSync(uploads[i].fence, 0, 0);
+		if (state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED) {
+			glDeleteSync(uploads[i].fence);
+			release(uploads[i].offset, uploads[i].size);
+			uploads.erase(uploads.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+
+	std::vector<job *> done;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		done.swap(finished);
+	}
+
+	for (size_t i = 0; i < done.size(); i++) {
+		job * j = done[i];
+		if (j->ok) {
+			bool staged = j->staged_size > 0;
+			GLuint tex;
+			if (staged)
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			if (j->generate_mips)
+				texture_compress::upload_top_level(j->levels[0], &tex);
+			else
+				texture_compress::upload_levels(j->fmt, j->levels, &tex);
+			if (staged) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				upload u;
+				u.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				u.offset = j->staged_offset;
+				u.size = j->staged_size;
+				uploads.push_back(u);
+			}
+			*j->target = tex;
+		}
+		else {
+			std::cout << "Unable to load texture " << j->filename << std::endl;
+		}
+		delete j;
+	}
+
+	if (!done.empty()) {
+		std::unique_lock<std::mutex> guard(lock);
+		outstanding -= (unsigned)done.size();
+	}
+}
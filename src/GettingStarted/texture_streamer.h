@@ -0,0 +1,96 @@
+#ifndef __TEXTURE_STREAMER_H__
+#define __TEXTURE_STREAMER_H__
+
+#include <sb7.h>
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+#include "texture_cache.h"
+#include "texture_compress.h"
+
+class thread_pool;
+
+//Loads textures in the background. Worker threads fetch the encoded mip chain
+//(through the texture cache) and write it into a persistently mapped pixel
+//unpack buffer. Uncompressed textures missing from the cache are decoded
+//straight into that buffer and the GPU builds their mips. The GL thread only
+//creates the texture and issues the uploads from that buffer, and until then
+//the requested handle names a placeholder. Workers never wait for staging
+//space: when it runs out they stage in client memory instead.
+class texture_streamer
+{
+public:
+	texture_streamer();
+	~texture_streamer();
+
+	void init(thread_pool * workers, bool compressed, size_t staging_bytes = 32 * 1024 * 1024);
+	void shutdown();
+
+	//*tex is set to a placeholder now and to the real texture once uploaded
+	void request(const std::string & filename, GLuint * tex);
+
+	//Upload finished textures and recycle staging memory. GL thread only,
+	//call once per frame.
+	void update();
+
+	//Textures requested but not uploaded yet
+	unsigned pending();
+
+private:
+	texture_streamer(const texture_streamer &);
+	texture_streamer & operator=(const texture_streamer &);
+
+	struct job
+	{
+		std::string filename;
+		GLuint * target;
+		bool ok;
+		//Only the top level was staged
+		bool generate_mips;
+
+		texture_compress::format fmt;
+		//Level data is a buffer offset when staged, a pointer into fallback otherwise
+		std::vector<texture_compress::level_view> levels;
+		size_t staged_offset;
+		size_t staged_size;
+		std::vector<unsigned char> fallback;
+	};
+
+	struct upload
+	{
+		GLsync fence;
+		size_t offset;
+		size_t size;
+	};
+
+	void decode(job * j);
+	void stage(job * j, const texture_cache::cached_texture & tex);
+	bool decode_staged(job * j, const mapped_file & src);
+	bool allocate(size_t size, size_t & out_offset);
+	void release(size_t offset, size_t size);
+	GLuint make_placeholder(unsigned char r, unsigned char g, unsigned char b);
+
+	thread_pool * pool;
+	bool compressed;
+
+	GLuint pbo;
+	unsigned char * staging;
+	size_t staging_size;
+	//Free staging ranges as (offset, size), sorted by offset
+	std::vector< std::pair<size_t, size_t> > free_ranges;
+
+	GLuint placeholder_color;
+	GLuint placeholder_normal;
+
+	std::mutex lock;
+	std::vector<job *> finished;
+	std::vector<upload> uploads;
+	unsigned outstanding;
+	bool stopping;
+};
+
+#endif /* __TEXTURE_STREAMER_H__ */
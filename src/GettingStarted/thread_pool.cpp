@@ -0,0 +1,192 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+
+#include <memory>
+
+#include "cpu_profiler.h"
+
+static THREAD_LOCAL const thread_pool * worker_pool = NULL;
+static THREAD_LOCAL int worker_index = -1;
+
+thread_pool::thread_pool()
+	: queued(0),
+	  pending(0),
+	  next_queue(0),
+	  stopping(false)
+{
+
+}
+
+thread_pool::~thread_pool()
+{
+	stop();
+}
+
+void thread_pool::start(unsigned num_threads)
+{
+	if (num_threads == 0) {
+		unsigned cores = std::thread::hardware_concurrency();
+		num_threads = (cores > 1) ? cores - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned i = 0; i < num_threads; i++)
+		queues.push_back(new task_queue());
+	for (unsigned i = 0; i < num_threads; i++)
+		workers.push_back(std::thread(&thread_pool::worker_main, this, (int)i));
+}
+
+void thread_pool::stop()
+{
+	{
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		stopping = true;
+	}
+	task_ready.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+	queues.clear();
+	queued = 0;
+	pending = 0;
+}
+
+int thread_pool::current_worker() const
+{
+	return (worker_pool == this) ? worker_index : -1;
+}
+
+void thread_pool::submit(const std::function<void()> & task)
+{
+	int self = current_worker();
+	task_queue * q = (self >= 0) ? queues[self] : queues[next_queue++ % queues.size()];
+
+	pending++;
+	{
+		std::unique_lock<std::mutex> guard(q->lock);
+		q->tasks.push_back(task);
+	}
+	{
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		queued++;
+	}
+	task_ready.notify_one();
+}
+
+void thread_pool::wait_idle()
+{
+	std::unique_lock<std::mutex> guard(sleep_lock);
+	while (pending > 0)
+		all_done.wait(guard);
+}
+
+//State of one parallel_for. Helpers can start after the loop is over, so it
+//lives as long as the last of them holds on to it.
+struct parallel_loop
+{
+	const std::function<void(unsigned)> * body;
+	unsigned count;
+	std::atomic<unsigned> next;
+	std::atomic<unsigned> done;
+	std::mutex lock;
+	std::condition_variable finished;
+};
+
+static void run_loop(parallel_loop & loop)
+{
+	unsigned i;
+	while ((i = loop.next++) < loop.count) {
+		(*loop.body)(i);
+		if (++loop.done == loop.count) {
+			std::unique_lock<std::mutex> guard(loop.lock);
+			loop.finished.notify_all();
+		}
+	}
+}
+
+void thread_pool::parallel_for(unsigned count, const std::function<void(unsigned)> & body, unsigned max_threads)
+{
+	if (count == 0)
+		return;
+
+	std::shared_ptr<parallel_loop> loop = std::make_shared<parallel_loop>();
+	loop->body = &body;
+	loop->count = count;
+	loop->next = 0;
+	loop->done = 0;
+
+	unsigned helpers = size();
+	if (max_threads > 0 && max_threads - 1 < helpers)
+		helpers = max_threads - 1;
+	if (count - 1 < helpers)
+		helpers = count - 1;
+	for (unsigned i = 0; i < helpers; i++)
+		submit([loop]() { run_loop(*loop); });
+
+	run_loop(*loop);
+
+	std::unique_lock<std::mutex> guard(loop->lock);
+	while (loop->done < count)
+		loop->finished.wait(guard);
+}
+
+//Own deque from the back, then steal from the front of the others
+bool thread_pool::pop(int index, std::function<void()> & out_task)
+{
+	{
+		task_queue * q = queues[index];
+		std::unique_lock<std::mutex> guard(q->lock);
+		if (!q->tasks.empty()) {
+			out_task = q->tasks.back();
+			q->tasks.pop_back();
+			return true;
+		}
+	}
+
+	size_t n = queues.size();
+	for (size_t i = 1; i < n; i++) {
+		task_queue * q = queues[(index + i) % n];
+		std::unique_lock<std::mutex> guard(q->lock);
+		if (!q->tasks.empty()) {
+			out_task = q->tasks.front();
+			q->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void thread_pool::worker_main(int index)
+{
+	worker_pool = this;
+	worker_index = index;
+
+	char name[32];
+	sprintf(name, "worker %d", index);
+	PROFILE_THREAD_NAME(name);
+
+	for (;;) {
+		std::function<void()> task;
+		if (pop(index, task)) {
+			queued--;
+			task();
+
+			if (--pending == 0) {
+				std::unique_lock<std::mutex> guard(sleep_lock);
+				all_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		while (queued <= 0 && !stopping)
+			task_ready.wait(guard);
+		if (stopping)
+			return;
+	}
+}
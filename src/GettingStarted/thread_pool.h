@@ -0,0 +1,73 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//VS2013 has no thread_local
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+//Work-stealing thread pool. Every worker owns a deque: tasks submitted from a
+//worker go to the back of its own deque and are popped LIFO, idle workers
+//steal from the front of the others. Tasks submitted from outside the pool
+//are dealt round-robin.
+class thread_pool
+{
+public:
+	thread_pool();
+	~thread_pool();
+
+	//0 picks one thread per core, leaving one for the GL thread
+	void start(unsigned num_threads = 0);
+	void stop();
+
+	void submit(const std::function<void()> & task);
+	//Block until every submitted task has finished. Not for use from a worker.
+	void wait_idle();
+
+	//Run body(0) to body(count - 1) on up to max_threads threads, the calling
+	//one included (0 for every worker), and return once all have finished.
+	//Indices are handed out one at a time so uneven ones balance out. Only
+	//waits for its own work, unlike wait_idle.
+	void parallel_for(unsigned count, const std::function<void(unsigned)> & body, unsigned max_threads = 0);
+
+	unsigned size() const { return (unsigned)workers.size(); }
+
+	//Index of the calling worker in this pool, or -1
+	int current_worker() const;
+
+private:
+	thread_pool(const thread_pool &);
+	thread_pool & operator=(const thread_pool &);
+
+	struct task_queue
+	{
+		std::mutex lock;
+		std::deque< std::function<void()> > tasks;
+	};
+
+	void worker_main(int index);
+	bool pop(int index, std::function<void()> & out_task);
+
+	std::vector<std::thread> workers;
+	std::vector<task_queue *> queues;
+
+	std::mutex sleep_lock;
+	std::condition_variable task_ready;
+	std::condition_variable all_done;
+	std::atomic<int> queued;
+	std::atomic<int> pending;
+	std::atomic<unsigned> next_queue;
+	bool stopping;
+};
+
+#endif /* __THREAD_POOL_H__ */
@@ -0,0 +1,207 @@
+#include "vmath_batch.h"
+
+#include <math.h>
+
+//VMATH_SSE and VMATH_AVX come from vmath.h
+#if defined(VMATH_AVX)
+#define BATCH_WIDTH 8
+#elif defined(VMATH_SSE)
+#define BATCH_WIDTH 4
+#else
+#define BATCH_WIDTH 1
+#endif
+
+namespace vmath_batch
+{
+
+//The lanes of one batch, so the loops below read the same for AVX and SSE
+#if BATCH_WIDTH == 8
+typedef __m256 lanes;
+static inline lanes load(const float * p) { return _mm256_loadu_ps(p); }
+static inline void store(float * p, lanes v) { _mm256_storeu_ps(p, v); }
+static inline lanes splat(float f) { return _mm256_set1_ps(f); }
+static inline lanes add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+static inline lanes sub(lanes a, lanes b) { return _mm256_sub_ps(a, b); }
+static inline lanes mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+static inline lanes sqrt_lanes(lanes a) { return _mm256_sqrt_ps(a); }
+static inline lanes all_set() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+static inline lanes and_lanes(lanes a, lanes b) { return _mm256_and_ps(a, b); }
+static inline lanes greater_equal(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline int mask(lanes a) { return _mm256_movemask_ps(a); }
+#elif BATCH_WIDTH == 4
+typedef __m128 lanes;
+static inline lanes load(const float * p) { return _mm_loadu_ps(p); }
+static inline void store(float * p, lanes v) { _mm_storeu_ps(p, v); }
+static inline lanes splat(float f) { return _mm_set1_ps(f); }
+static inline lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+static inline lanes sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+static inline lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+static inline lanes sqrt_lanes(lanes a) { return _mm_sqrt_ps(a); }
+static inline lanes all_set() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+static inline lanes and_lanes(lanes a, lanes b) { return _mm_and_ps(a, b); }
+static inline lanes greater_equal(lanes a, lanes b) { return _mm_cmpge_ps(a, b); }
+static inline int mask(lanes a) { return _mm_movemask_ps(a); }
+#endif
+
+//Batches cover count rounded down to BATCH_WIDTH, the loops finish the rest
+static inline size_t batched(size_t count)
+{
+	return BATCH_WIDTH > 1 ? count - count % BATCH_WIDTH : 0;
+}
+
+//Write one byte per lane, returns how many are set
+static inline size_t write_mask(int bits, unsigned char * out)
+{
+	size_t set = 0;
+	for (int lane = 0; lane < BATCH_WIDTH; lane++) {
+		out[lane] = (unsigned char)((bits >> lane) & 1);
+		set += out[lane];
+	}
+	return set;
+}
+
+void transform_points(const vmath::mat4 & m, const float * x, const float * y, const float * z, size_t count,
+	float * out_x, float * out_y, float * out_z, float * out_w)
+{
+	float * out[4] = { out_x, out_y, out_z, out_w };
+
+	for (int row = 0; row < 4; row++) {
+		if (out[row] == NULL)
+			continue;
+		const float m0 = m[0][row], m1 = m[1][row], m2 = m[2][row], m3 = m[3][row];
+		float * o = out[row];
+		size_t i = 0;
+#if BATCH_WIDTH > 1
+		const size_t end = batched(count);
+		const lanes c0 = splat(m0), c1 = splat(m1), c2 = splat(m2), c3 = splat(m3);
+		for (; i < end; i += BATCH_WIDTH)
+			store(o + i, add(add(add(mul(c0, load(x + i)), mul(c1, load(y + i))), mul(c2, load(z + i))), c3));
+#endif
+		for (; i < count; i++)
+			o[i] = m0 * x[i] + m1 * y[i] + m2 * z[i] + m3;
+	}
+}
+
+void extract_frustum(const vmath::mat4 & view_proj, frustum & out)
+{
+	//Clip space -w <= x, y, z <= w, as combinations of the rows of the matrix
+	for (int p = 0; p < 6; p++) {
+		int axis = p / 2;
+		float sign = (p & 1) ? -1.0f : 1.0f;
+		float length_sq = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			out.planes[p][c] = view_proj[c][3] + sign * view_proj[c][axis];
+			if (c < 3)
+				length_sq += out.planes[p][c] * out.planes[p][c];
+		}
+		float scale = length_sq > 0.0f ? 1.0f / sqrtf(length_sq) : 0.0f;
+		for (int c = 0; c < 4; c++)
+			out.planes[p][c] *= scale;
+	}
+}
+
+size_t cull_spheres(const frustum & f, const float * x, const float * y, const float * z, const float * radius,
+	size_t count, unsigned char * out_visible)
+{
+	size_t visible = 0, i = 0;
+
+#if BATCH_WIDTH > 1
+	const size_t end = batched(count);
+	for (; i < end; i += BATCH_WIDTH) {
+		const lanes px = load(x + i), py = load(y + i), pz = load(z + i);
+		const lanes neg_r = sub(splat(0.0f), load(radius + i));
+		lanes inside = all_set();
+		for (int p = 0; p < 6; p++) {
+			const float * pl = f.planes[p];
+			lanes d = add(add(add(mul(splat(pl[0]), px), mul(splat(pl[1]), py)), mul(splat(pl[2]), pz)), splat(pl[3]));
+			inside = and_lanes(inside, greater_equal(d, neg_r));
+		}
+		visible += write_mask(mask(inside), out_visible + i);
+	}
+#endif
+	for (; i < count; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const float * pl = f.planes[p];
+			inside = pl[0] * x[i] + pl[1] * y[i] + pl[2] * z[i] + pl[3] >= -radius[i];
+		}
+		out_visible[i] = inside ? 1 : 0;
+		visible += out_visible[i];
+	}
+	return visible;
+}
+
+size_t cull_aabbs(const frustum & f, const float * min_x, const float * min_y, const float * min_z,
+	const float * max_x, const float * max_y, const float * max_z,
+	size_t count, unsigned char * out_visible)
+{
+	//A box is outside a plane when its corner furthest along the normal is.
+	//The normal is the same for every box, so the corner is picked once per plane.
+	const float * corner[6][3];
+	for (int p = 0; p < 6; p++) {
+		corner[p][0] = f.planes[p][0] >= 0.0f ? max_x : min_x;
+		corner[p][1] = f.planes[p][1] >= 0.0f ? max_y : min_y;
+		corner[p][2] = f.planes[p][2] >= 0.0f ? max_z : min_z;
+	}
+
+	size_t visible = 0, i = 0;
+
+#if BATCH_WIDTH > 1
+	const size_t end = batched(count);
+	const lanes zero = splat(0.0f);
+	for (; i < end; i += BATCH_WIDTH) {
+		lanes inside = all_set();
+		for (int p = 0; p < 6; p++) {
+			const float * pl = f.planes[p];
+			lanes d = add(add(add(mul(splat(pl[0]), load(corner[p][0] + i)), mul(splat(pl[1]), load(corner[p][1] + i))),
+				mul(splat(pl[2]), load(corner[p][2] + i))), splat(pl[3]));
+			inside = and_lanes(inside, greater_equal(d, zero));
+		}
+		visible += write_mask(mask(inside), out_visible + i);
+	}
+#endif
+	for (; i < count; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const float * pl = f.planes[p];
+			inside = pl[0] * corner[p][0][i] + pl[1] * corner[p][1][i] + pl[2] * corner[p][2][i] + pl[3] >= 0.0f;
+		}
+		out_visible[i] = inside ? 1 : 0;
+		visible += out_visible[i];
+	}
+	return visible;
+}
+
+void distances_squared(const vmath::vec3 & p, const float * x, const float * y, const float * z, size_t count, float * out)
+{
+	size_t i = 0;
+
+#if BATCH_WIDTH > 1
+	const size_t end = batched(count);
+	const lanes px = splat(p[0]), py = splat(p[1]), pz = splat(p[2]);
+	for (; i < end; i += BATCH_WIDTH) {
+		lanes dx = sub(load(x + i), px), dy = sub(load(y + i), py), dz = sub(load(z + i), pz);
+		store(out + i, add(add(mul(dx, dx), mul(dy, dy)), mul(dz, dz)));
+	}
+#endif
+	for (; i < count; i++) {
+		float dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+		out[i] = dx * dx + dy * dy + dz * dz;
+	}
+}
+
+void distances(const vmath::vec3 & p, const float * x, const float * y, const float * z, size_t count, float * out)
+{
+	distances_squared(p, x, y, z, count, out);
+
+	size_t i = 0;
+#if BATCH_WIDTH > 1
+	const size_t end = batched(count);
+	for (; i < end; i += BATCH_WIDTH)
+		store(out + i, sqrt_lanes(load(out + i)));
+#endif
+	for (; i < count; i++)
+		out[i] = sqrtf(out[i]);
+}
+
+}
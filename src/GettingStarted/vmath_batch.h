@@ -0,0 +1,49 @@
+#ifndef __VMATH_BATCH_H__
+#define __VMATH_BATCH_H__
+
+#include <stddef.h>
+
+#include <vmath.h>
+
+//Batch versions of the vmath operations culling and collision run over many
+//items. Inputs are structure-of-arrays, one array per coordinate, so each
+//instruction handles 8 items (AVX) or 4 (SSE). Builds without either use
+//plain loops. Arrays need no particular alignment and any count works.
+//Every sum adds in the same order as the per-item vmath code would, so the
+//results match it exactly.
+namespace vmath_batch
+{
+
+//out = m * (x, y, z, 1) as a column vector, like gl_Position = m * vec4(p, 1).
+//No perspective divide. out_w may be NULL.
+void transform_points(const vmath::mat4 & m, const float * x, const float * y, const float * z, size_t count,
+	float * out_x, float * out_y, float * out_z, float * out_w);
+
+//Six planes (a, b, c, d) with unit normals pointing inwards: a point is inside
+//when a * x + b * y + c * z + d >= 0
+struct frustum
+{
+	float planes[6][4];
+};
+
+//Planes of the clip volume of a view-projection matrix, in world space
+void extract_frustum(const vmath::mat4 & view_proj, frustum & out);
+
+//out_visible[i] is 1 when sphere i is at least partly inside the frustum, 0
+//otherwise. Returns how many are visible.
+size_t cull_spheres(const frustum & f, const float * x, const float * y, const float * z, const float * radius,
+	size_t count, unsigned char * out_visible);
+
+//Same for axis aligned boxes
+size_t cull_aabbs(const frustum & f, const float * min_x, const float * min_y, const float * min_z,
+	const float * max_x, const float * max_y, const float * max_z,
+	size_t count, unsigned char * out_visible);
+
+//out[i] = vmath::distance(p, point i)
+void distances(const vmath::vec3 & p, const float * x, const float * y, const float * z, size_t count, float * out);
+//Squared, for comparisons that don't need the root
+void distances_squared(const vmath::vec3 & p, const float * x, const float * y, const float * z, size_t count, float * out);
+
+}
+
+#endif /* __VMATH_BATCH_H__ */
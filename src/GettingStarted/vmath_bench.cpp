@@ -0,0 +1,193 @@
+#include "vmath_bench.h"
+
+#include <vmath.h>
+
+#include <iostream>
+
+#include "cpu_profiler.h"
+#include "vmath_batch.h"
+
+namespace vmath_bench
+{
+namespace simd
+{
+#include "vmath_kernels.h"
+}
+
+//Best time per item over the repeats
+static double time_kernel(kernel_fn fn, const float * a, const float * b, float * out, size_t count, int repeats)
+{
+	unsigned long long best = ~0ull;
+	for (int r = 0; r < repeats; r++) {
+		unsigned long long start = cpu_profiler::now_ns();
+		fn(a, b, out, count);
+		unsigned long long elapsed = cpu_profiler::now_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return (double)best / count;
+}
+
+template <typename F>
+static double time_call(F call, size_t count, int repeats)
+{
+	unsigned long long best = ~0ull;
+	for (int r = 0; r < repeats; r++) {
+		unsigned long long start = cpu_profiler::now_ns();
+		call();
+		unsigned long long elapsed = cpu_profiler::now_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return (double)best / count;
+}
+
+template <typename T>
+static bool same(const std::vector<T> & a, const std::vector<T> & b)
+{
+	for (size_t i = 0; i < a.size(); i++) {
+		if (!(a[i] == b[i]))
+			return false;
+	}
+	return true;
+}
+
+static void add_result(std::vector<result> & out_results, const char * name, double simd_ns, double scalar_ns, bool exact)
+{
+	result r;
+	r.name = name;
+	r.simd_ns = simd_ns;
+	r.scalar_ns = scalar_ns;
+	r.exact = exact;
+	if (!r.exact)
+		std::cout << "error: vmath " << r.name << " differs from the scalar loops" << std::endl;
+	out_results.push_back(r);
+}
+
+//vmath_batch on structure-of-arrays against the same work done one vec3 at a time
+static void run_batch(std::vector<result> & out_results, size_t count, int repeats)
+{
+	std::vector<vmath::vec3> points(count), extents(count);
+	std::vector<float> x(count), y(count), z(count), radius(count);
+	std::vector<float> min_x(count), min_y(count), min_z(count), max_x(count), max_y(count), max_z(count);
+	for (size_t i = 0; i < count; i++) {
+		points[i] = vmath::vec3(vmath::random<float>(), vmath::random<float>(), vmath::random<float>()) * 200.0f - vmath::vec3(100.0f);
+		extents[i] = vmath::vec3(vmath::random<float>(), vmath::random<float>(), vmath::random<float>()) * 4.0f;
+		x[i] = points[i][0];
+		y[i] = points[i][1];
+		z[i] = points[i][2];
+		radius[i] = extents[i][0];
+		min_x[i] = x[i] - extents[i][0];
+		min_y[i] = y[i] - extents[i][1];
+		min_z[i] = z[i] - extents[i][2];
+		max_x[i] = x[i] + extents[i][0];
+		max_y[i] = y[i] + extents[i][1];
+		max_z[i] = z[i] + extents[i][2];
+	}
+
+	const vmath::vec3 eye(3.0f, 1.0f, -2.0f);
+	const vmath::mat4 view_proj = vmath::perspective(50.0f, 16.0f / 9.0f, 0.1f, 100.0f) *
+		vmath::lookat(eye, vmath::vec3(20.0f, 0.0f, 30.0f), vmath::vec3(0.0f, 1.0f, 0.0f));
+	vmath_batch::frustum frustum;
+	vmath_batch::extract_frustum(view_proj, frustum);
+
+	std::vector<float> batch_out(count * 4), loop_out(count * 4);
+	double batch_ns, loop_ns;
+
+	batch_ns = time_call([&]() {
+		vmath_batch::transform_points(view_proj, &x[0], &y[0], &z[0], count,
+			&batch_out[0], &batch_out[count], &batch_out[count * 2], &batch_out[count * 3]);
+	}, count, repeats);
+	loop_ns = time_call([&]() {
+		const vmath::mat4 rows = view_proj.transpose();
+		for (size_t i = 0; i < count; i++) {
+			vmath::vec4 p = vmath::vec4(points[i], 1.0f) * rows;
+			for (int n = 0; n < 4; n++)
+				loop_out[count * n + i] = p[n];
+		}
+	}, count, repeats);
+	add_result(out_results, "batch transform points", batch_ns, loop_ns, same(batch_out, loop_out));
+
+	batch_ns = time_call([&]() {
+		vmath_batch::distances(eye, &x[0], &y[0], &z[0], count, &batch_out[0]);
+	}, count, repeats);
+	loop_ns = time_call([&]() {
+		for (size_t i = 0; i < count; i++)
+			loop_out[i] = vmath::distance(eye, points[i]);
+	}, count, repeats);
+	batch_out.resize(count);
+	loop_out.resize(count);
+	add_result(out_results, "batch distances", batch_ns, loop_ns, same(batch_out, loop_out));
+
+	std::vector<unsigned char> batch_visible(count), loop_visible(count);
+	size_t batch_count = 0, loop_count = 0;
+
+	batch_ns = time_call([&]() {
+		batch_count = vmath_batch::cull_spheres(frustum, &x[0], &y[0], &z[0], &radius[0], count, &batch_visible[0]);
+	}, count, repeats);
+	loop_ns = time_call([&]() {
+		loop_count = 0;
+		for (size_t i = 0; i < count; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++) {
+				const float * pl = frustum.planes[p];
+				inside = vmath::dot(vmath::vec3(pl[0], pl[1], pl[2]), points[i]) + pl[3] >= -radius[i];
+			}
+			loop_visible[i] = inside ? 1 : 0;
+			loop_count += loop_visible[i];
+		}
+	}, count, repeats);
+	add_result(out_results, "batch cull spheres", batch_ns, loop_ns, batch_count == loop_count && same(batch_visible, loop_visible));
+
+	batch_ns = time_call([&]() {
+		batch_count = vmath_batch::cull_aabbs(frustum, &min_x[0], &min_y[0], &min_z[0], &max_x[0], &max_y[0], &max_z[0],
+			count, &batch_visible[0]);
+	}, count, repeats);
+	loop_ns = time_call([&]() {
+		loop_count = 0;
+		for (size_t i = 0; i < count; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++) {
+				const float * pl = frustum.planes[p];
+				vmath::vec3 corner = points[i] + vmath::vec3(pl[0] >= 0.0f ? extents[i][0] : -extents[i][0],
+					pl[1] >= 0.0f ? extents[i][1] : -extents[i][1], pl[2] >= 0.0f ? extents[i][2] : -extents[i][2]);
+				inside = vmath::dot(vmath::vec3(pl[0], pl[1], pl[2]), corner) + pl[3] >= 0.0f;
+			}
+			loop_visible[i] = inside ? 1 : 0;
+			loop_count += loop_visible[i];
+		}
+	}, count, repeats);
+	add_result(out_results, "batch cull aabbs", batch_ns, loop_ns, batch_count == loop_count && same(batch_visible, loop_visible));
+}
+
+void run(std::vector<result> & out_results, size_t count, int repeats)
+{
+	out_results.clear();
+
+	//Inputs in [-1, 1)
+	std::vector<float> a(count * 16), b(count * 16);
+	for (size_t i = 0; i < a.size(); i++) {
+		a[i] = vmath::random<float>() * 2.0f - 1.0f;
+		b[i] = vmath::random<float>() * 2.0f - 1.0f;
+	}
+	std::vector<float> simd_out(count * 16), scalar_out(count * 16);
+
+	for (int k = 0; k < simd::kernel_count; k++) {
+		const kernel & fast = simd::kernels[k];
+		const kernel & plain = scalar::kernels[k];
+
+		double simd_ns = time_kernel(fast.fn, &a[0], &b[0], &simd_out[0], count, repeats);
+		double scalar_ns = time_kernel(plain.fn, &a[0], &b[0], &scalar_out[0], count, repeats);
+
+		//== so 0 and -0 count as equal, the loops start their sums from 0
+		simd_out.resize(count * fast.out_floats);
+		scalar_out.resize(count * fast.out_floats);
+		add_result(out_results, fast.name, simd_ns, scalar_ns, same(simd_out, scalar_out));
+		simd_out.resize(count * 16);
+		scalar_out.resize(count * 16);
+	}
+
+	run_batch(out_results, count, repeats);
+}
+
+}
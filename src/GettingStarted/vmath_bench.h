@@ -0,0 +1,54 @@
+#ifndef __VMATH_BENCH_H__
+#define __VMATH_BENCH_H__
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+//Micro-benchmarks for the SIMD kernels in vmath.h and vmath_batch. Every
+//vmath kernel is also built on the plain template loops (vmath_bench_scalar.cpp
+//compiles vmath.h with VMATH_NO_SIMD), every batch operation is repeated one
+//vec3 at a time, and the two must give exactly the same results. Benchmark
+//mode runs this at startup and puts the results in its report.
+namespace vmath_bench
+{
+
+struct result
+{
+	std::string name;
+	double simd_ns; //per item, best of the repeats
+	double scalar_ns;
+	bool exact;
+};
+
+//Run every kernel over count random items, repeats times each
+void run(std::vector<result> & out_results, size_t count = 4096, int repeats = 50);
+
+//A kernel reads 16 floats per item from a and from b and writes out_floats
+//floats per item to out
+typedef void (*kernel_fn)(const float * a, const float * b, float * out, size_t count);
+
+struct kernel
+{
+	const char * name;
+	kernel_fn fn;
+	int out_floats;
+};
+
+//Both tables come from vmath_kernels.h, in the same order
+namespace simd
+{
+extern const kernel kernels[];
+extern const int kernel_count;
+}
+
+namespace scalar
+{
+extern const kernel kernels[];
+extern const int kernel_count;
+}
+
+}
+
+#endif /* __VMATH_BENCH_H__ */
@@ -0,0 +1,15 @@
+//The benchmark kernels on vmath's plain template loops. vmath is renamed so
+//these instantiations can't be merged with the SIMD ones at link time.
+#define VMATH_NO_SIMD 1
+#define vmath vmath_scalar
+#include <vmath.h>
+
+#include "vmath_bench.h"
+
+namespace vmath_bench
+{
+namespace scalar
+{
+#include "vmath_kernels.h"
+}
+}
@@ -0,0 +1,112 @@
+//Kernel bodies for vmath_bench, included once by vmath_bench.cpp with the SIMD
+//vmath and once by vmath_bench_scalar.cpp with the plain loops. No include
+//guard on purpose, the includer opens the namespace.
+
+static vmath::mat4 load_mat4(const float * p)
+{
+	return vmath::mat4(vmath::vec4(p[0], p[1], p[2], p[3]),
+		vmath::vec4(p[4], p[5], p[6], p[7]),
+		vmath::vec4(p[8], p[9], p[10], p[11]),
+		vmath::vec4(p[12], p[13], p[14], p[15]));
+}
+
+static void store_mat4(float * p, const vmath::mat4 & m)
+{
+	for (int i = 0; i < 16; i++)
+		p[i] = ((const float *)m)[i];
+}
+
+static void mat4_mul(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		store_mat4(out + i * 16, load_mat4(a + i * 16) * load_mat4(b + i * 16));
+}
+
+static void vec4_mat4(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * v = a + i * 16;
+		vmath::vec4 r = vmath::vec4(v[0], v[1], v[2], v[3]) * load_mat4(b + i * 16);
+		for (int n = 0; n < 4; n++)
+			out[i * 4 + n] = r[n];
+	}
+}
+
+static void vec4_arithmetic(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16, * q = b + i * 16;
+		vmath::vec4 x(p[0], p[1], p[2], p[3]), y(q[0], q[1], q[2], q[3]);
+		vmath::vec4 r = ((x + y) * q[4] - x * y) / (q[5] + 2.0f);
+		for (int n = 0; n < 4; n++)
+			out[i * 4 + n] = r[n];
+	}
+}
+
+static void vec4_dot(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16, * q = b + i * 16;
+		out[i] = vmath::dot(vmath::vec4(p[0], p[1], p[2], p[3]), vmath::vec4(q[0], q[1], q[2], q[3]));
+	}
+}
+
+static void vec4_normalize(const float * a, const float *, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16;
+		vmath::vec4 r = vmath::normalize(vmath::vec4(p[0], p[1], p[2], p[3]));
+		for (int n = 0; n < 4; n++)
+			out[i * 4 + n] = r[n];
+	}
+}
+
+static void vec3_normalize(const float * a, const float *, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16;
+		vmath::vec3 r = vmath::normalize(vmath::vec3(p[0], p[1], p[2]));
+		for (int n = 0; n < 3; n++)
+			out[i * 3 + n] = r[n];
+	}
+}
+
+static void vec3_cross(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16, * q = b + i * 16;
+		vmath::vec3 r = vmath::cross(vmath::vec3(p[0], p[1], p[2]), vmath::vec3(q[0], q[1], q[2]));
+		for (int n = 0; n < 3; n++)
+			out[i * 3 + n] = r[n];
+	}
+}
+
+static void lookat(const float * a, const float * b, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16, * q = b + i * 16;
+		store_mat4(out + i * 16, vmath::lookat(vmath::vec3(p[0], p[1], p[2]),
+			vmath::vec3(q[0], q[1], q[2]) * 10.0f, vmath::vec3(0.0f, 1.0f, 0.0f)));
+	}
+}
+
+static void rotate_xyz(const float * a, const float *, float * out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const float * p = a + i * 16;
+		store_mat4(out + i * 16, vmath::rotate(p[0] * 360.0f, p[1] * 360.0f, p[2] * 360.0f));
+	}
+}
+
+extern const kernel kernels[] = {
+	{ "mat4 * mat4", mat4_mul, 16 },
+	{ "vec4 * mat4", vec4_mat4, 4 },
+	{ "vec4 arithmetic", vec4_arithmetic, 4 },
+	{ "dot vec4", vec4_dot, 1 },
+	{ "normalize vec4", vec4_normalize, 4 },
+	{ "normalize vec3", vec3_normalize, 3 },
+	{ "cross vec3", vec3_cross, 3 },
+	{ "lookat", lookat, 16 },
+	{ "rotate xyz", rotate_xyz, 16 }
+};
+extern const int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
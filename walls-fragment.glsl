@@ -8,13 +8,10 @@ out vec4 color;
 
 in VS_OUT
 {
-	mat4 mv_matrix;
     vec3 L;
     vec3 V;
 	vec2 tc;
-	float light_dist;
 	float attenuation;
-	float reflecting;
 } fs_in;
 
 // Material properties
@@ -27,12 +24,13 @@ void main(void)
 {
 	vec3 bumpN = (texture(bump_map, fs_in.tc)).xyz;// vec2(fs_in.tc.x, fs_in.tc.y * fs_in.reflecting))).xyz;
 	bumpN = (bumpN-0.5)*2.0;
+	bumpN.z = sqrt(max(1.0 - dot(bumpN.xy, bumpN.xy), 0.0)); //BC5 normal maps only store x and y
 
 	vec3 testV = fs_in.V;
-	if (fs_in.reflecting < 0) {
-		bumpN.y = -bumpN.y;
-		testV.y = -testV.y;
-	}
+#ifdef REFLECTED
+	bumpN.y = -bumpN.y;
+	testV.y = -testV.y;
+#endif
 
 
 	// Normalize the incoming N, L and V vectors